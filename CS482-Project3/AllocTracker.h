@@ -0,0 +1,351 @@
+//////////////////////////////////////////////////////
+// AllocTracker.h - Global new/delete replacement   //
+// that counts calls and bytes per subsystem tag,   //
+// and a per-frame check for steady-state frames.   //
+//////////////////////////////////////////////////////
+
+#ifndef _H_ALLOC_TRACKER_
+#define _H_ALLOC_TRACKER_
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+
+// Allocations are charged to the innermost ALLOC_SCOPE on the allocating
+// thread; frees go back to the tag that allocated the block.
+enum ALLOC_TAG {
+	ALLOC_UNTAGGED, ALLOC_SIMULATION, ALLOC_RENDER, ALLOC_HUD, ALLOC_TRACK,
+	ALLOC_TERRAIN, ALLOC_TELEMETRY, ALLOC_TRACE, NUM_ALLOC_TAGS
+};
+const char* const ALLOC_TAG_NAMES[NUM_ALLOC_TAGS] = {
+	"untagged", "simulation", "render", "hud", "track", "terrain", "telemetry", "trace"
+};
+
+// Frames ignored at the start of a test run while streaming and caches
+// settle, and how many offending frames a failed test describes.
+const int ALLOC_TEST_WARMUP_FRAMES = 600;
+const int ALLOC_TEST_REPORTED_FRAMES = 8;
+
+// Process-wide totals for one tag, each on its own cache line so threads
+// allocating under different tags do not contend.
+struct alignas(64) AllocCounters {
+	std::atomic<unsigned long long> calls;
+	std::atomic<unsigned long long> bytes;
+	std::atomic<unsigned long long> frees;
+	std::atomic<unsigned long long> freedBytes;
+};
+
+// The calling thread's current tag and what it has allocated since its
+// counts were last taken. Zero-initialized, so usable before main.
+struct AllocThreadState {
+	ALLOC_TAG tag;
+	unsigned long long calls[NUM_ALLOC_TAGS];
+	unsigned long long bytes[NUM_ALLOC_TAGS];
+};
+
+AllocCounters allocCounters[NUM_ALLOC_TAGS];
+thread_local AllocThreadState allocThread;
+
+// Every block is preceded by its size and tag. 16 bytes keeps the
+// alignment malloc gives.
+struct AllocHeader {
+	size_t size;
+	uint32_t tag;
+	uint32_t magic;
+};
+const uint32_t ALLOC_HEADER_MAGIC = 0xA110C8ED;
+const size_t ALLOC_HEADER_SIZE = 16;
+static_assert(sizeof(AllocHeader) <= ALLOC_HEADER_SIZE, "allocation header too large");
+
+// Stamp a block's header and charge it to the thread's current tag.
+void ChargeAllocation(AllocHeader* header, size_t size) {
+	ALLOC_TAG tag = allocThread.tag;
+	header->size = size;
+	header->tag = tag;
+	header->magic = ALLOC_HEADER_MAGIC;
+	allocCounters[tag].calls.fetch_add(1, std::memory_order_relaxed);
+	allocCounters[tag].bytes.fetch_add(size, std::memory_order_relaxed);
+	allocThread.calls[tag]++;
+	allocThread.bytes[tag] += size;
+}
+
+void ChargeFree(AllocHeader* header) {
+	if (header->magic == ALLOC_HEADER_MAGIC && header->tag < NUM_ALLOC_TAGS)
+	{
+		allocCounters[header->tag].frees.fetch_add(1, std::memory_order_relaxed);
+		allocCounters[header->tag].freedBytes.fetch_add(header->size, std::memory_order_relaxed);
+	}
+	header->magic = 0;
+}
+
+void* TrackedAllocate(size_t size) {
+	char* block = (char*)malloc(ALLOC_HEADER_SIZE + size);
+	if (block == NULL)
+		return NULL;
+	ChargeAllocation((AllocHeader*)block, size);
+	return block + ALLOC_HEADER_SIZE;
+}
+
+void TrackedFree(void* pointer) {
+	if (pointer == NULL)
+		return;
+	char* block = (char*)pointer - ALLOC_HEADER_SIZE;
+	ChargeFree((AllocHeader*)block);
+	free(block);
+}
+
+// Over-aligned blocks keep the same header directly below the pointer,
+// with the address malloc returned just below that.
+const size_t ALLOC_ALIGNED_PREFIX = ALLOC_HEADER_SIZE + sizeof(void*);
+
+void* TrackedAllocateAligned(size_t size, size_t alignment) {
+	char* block = (char*)malloc(ALLOC_ALIGNED_PREFIX + alignment + size);
+	if (block == NULL)
+		return NULL;
+	uintptr_t address = ((uintptr_t)block + ALLOC_ALIGNED_PREFIX + alignment - 1) & ~(uintptr_t)(alignment - 1);
+	char* pointer = (char*)address;
+	((void**)(pointer - ALLOC_HEADER_SIZE))[-1] = block;
+	ChargeAllocation((AllocHeader*)(pointer - ALLOC_HEADER_SIZE), size);
+	return pointer;
+}
+
+void TrackedFreeAligned(void* pointer) {
+	if (pointer == NULL)
+		return;
+	char* header = (char*)pointer - ALLOC_HEADER_SIZE;
+	void* block = ((void**)header)[-1];
+	ChargeFree((AllocHeader*)header);
+	free(block);
+}
+
+// Charges allocations in the enclosing scope to a tag.
+class AllocScope {
+public:
+	explicit AllocScope(ALLOC_TAG tag) : previous(allocThread.tag) { allocThread.tag = tag; }
+	~AllocScope() { allocThread.tag = previous; }
+
+private:
+	ALLOC_TAG previous;
+
+	AllocScope(const AllocScope&);
+	AllocScope& operator=(const AllocScope&);
+};
+
+// Defining NO_ALLOC_TRACKING leaves the standard new/delete in place and
+// compiles every scope out.
+#define ALLOC_CONCAT_(a, b) a##b
+#define ALLOC_CONCAT(a, b) ALLOC_CONCAT_(a, b)
+#ifdef NO_ALLOC_TRACKING
+#define ALLOC_SCOPE(tag)
+#else
+#define ALLOC_SCOPE(tag) AllocScope ALLOC_CONCAT(allocScope, __LINE__)(tag)
+
+void* operator new(size_t size) {
+	void* pointer = TrackedAllocate(size);
+	if (pointer == NULL)
+		throw std::bad_alloc();
+	return pointer;
+}
+
+void* operator new[](size_t size) {
+	void* pointer = TrackedAllocate(size);
+	if (pointer == NULL)
+		throw std::bad_alloc();
+	return pointer;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+	return TrackedAllocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+	return TrackedAllocate(size);
+}
+
+void operator delete(void* pointer) noexcept {
+	TrackedFree(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+	TrackedFree(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+	TrackedFree(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept {
+	TrackedFree(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept {
+	TrackedFree(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept {
+	TrackedFree(pointer);
+}
+
+// Types aligned beyond what malloc guarantees (alignas(64) rings, buffers
+// and counters) use these when the compiler supports aligned new; without
+// it they come through the forms above.
+#ifdef __cpp_aligned_new
+void* operator new(size_t size, std::align_val_t alignment) {
+	void* pointer = TrackedAllocateAligned(size, (size_t)alignment);
+	if (pointer == NULL)
+		throw std::bad_alloc();
+	return pointer;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+	void* pointer = TrackedAllocateAligned(size, (size_t)alignment);
+	if (pointer == NULL)
+		throw std::bad_alloc();
+	return pointer;
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+	return TrackedAllocateAligned(size, (size_t)alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+	return TrackedAllocateAligned(size, (size_t)alignment);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept {
+	TrackedFreeAligned(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t) noexcept {
+	TrackedFreeAligned(pointer);
+}
+
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept {
+	TrackedFreeAligned(pointer);
+}
+
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept {
+	TrackedFreeAligned(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept {
+	TrackedFreeAligned(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept {
+	TrackedFreeAligned(pointer);
+}
+#endif
+#endif
+
+// Counts the frames of the thread that calls frameFinished (the render
+// thread). In test mode, after a warm-up, every frame that allocated is
+// a failure, and the first few are kept to show which tags allocated.
+class AllocFrameMonitor {
+public:
+	AllocFrameMonitor();
+	void startTest(int frames);
+	bool testing() const;
+	bool frameFinished();
+	bool testPassed() const;
+	unsigned long long lastFrameCalls() const;
+	void report(std::ostream& out) const;
+
+private:
+	struct FrameRecord {
+		unsigned long long frame;
+		unsigned long long calls[NUM_ALLOC_TAGS];
+		unsigned long long bytes[NUM_ALLOC_TAGS];
+	};
+	unsigned long long frames;
+	unsigned long long allocatingFrames;
+	unsigned long long mostCalls;
+	unsigned long long lastCalls;
+	int testFrames;
+	unsigned long long testedFrames;
+	unsigned long long failedFrames;
+	FrameRecord failures[ALLOC_TEST_REPORTED_FRAMES];
+};
+
+AllocFrameMonitor::AllocFrameMonitor()
+	: frames(0), allocatingFrames(0), mostCalls(0), lastCalls(0), testFrames(0), testedFrames(0), failedFrames(0) {
+}
+
+// Check the next frames after the warm-up; frameFinished returns true
+// once they have all been seen.
+void AllocFrameMonitor::startTest(int frames) {
+	testFrames = frames;
+}
+
+bool AllocFrameMonitor::testing() const {
+	return testFrames > 0;
+}
+
+// Take the calling thread's counts for the frame that just ended.
+bool AllocFrameMonitor::frameFinished() {
+	FrameRecord record;
+	record.frame = frames++;
+	unsigned long long calls = 0;
+	for (int t = 0; t < NUM_ALLOC_TAGS; t++)
+	{
+		record.calls[t] = allocThread.calls[t];
+		record.bytes[t] = allocThread.bytes[t];
+		calls += allocThread.calls[t];
+		allocThread.calls[t] = 0;
+		allocThread.bytes[t] = 0;
+	}
+	lastCalls = calls;
+	if (calls > 0)
+		allocatingFrames++;
+	mostCalls = calls > mostCalls ? calls : mostCalls;
+
+	if (!testing() || record.frame < (unsigned long long)ALLOC_TEST_WARMUP_FRAMES)
+		return false;
+	if (calls > 0 && failedFrames++ < (unsigned long long)ALLOC_TEST_REPORTED_FRAMES)
+		failures[failedFrames - 1] = record;
+	return ++testedFrames >= (unsigned long long)testFrames;
+}
+
+bool AllocFrameMonitor::testPassed() const {
+	return failedFrames == 0;
+}
+
+unsigned long long AllocFrameMonitor::lastFrameCalls() const {
+	return lastCalls;
+}
+
+// Totals and live bytes per tag, the frame summary and, in test mode, the verdict.
+void AllocFrameMonitor::report(std::ostream& out) const {
+	out << "Allocations by subsystem (calls, bytes, live blocks, live bytes):" << std::endl;
+	for (int t = 0; t < NUM_ALLOC_TAGS; t++)
+	{
+		unsigned long long calls = allocCounters[t].calls.load(std::memory_order_relaxed);
+		unsigned long long bytes = allocCounters[t].bytes.load(std::memory_order_relaxed);
+		unsigned long long frees = allocCounters[t].frees.load(std::memory_order_relaxed);
+		unsigned long long freed = allocCounters[t].freedBytes.load(std::memory_order_relaxed);
+		if (calls == 0)
+			continue;
+		out << "  " << std::left << std::setw(11) << ALLOC_TAG_NAMES[t] << std::right << std::setw(10) << calls
+			<< std::setw(14) << bytes << std::setw(10) << calls - frees << std::setw(14) << bytes - freed << std::endl;
+	}
+	out << "Frames: " << frames << ", " << allocatingFrames << " allocated on the render thread (most "
+		<< mostCalls << " calls in one frame)" << std::endl;
+	if (!testing())
+		return;
+	out << "Allocation test: " << failedFrames << " of " << testedFrames << " steady-state frames allocated -> "
+		<< (testPassed() ? "PASS" : "FAIL") << std::endl;
+	for (unsigned long long i = 0; i < failedFrames && i < (unsigned long long)ALLOC_TEST_REPORTED_FRAMES; i++)
+	{
+		const FrameRecord& record = failures[i];
+		out << "  frame " << record.frame << ":";
+		for (int t = 0; t < NUM_ALLOC_TAGS; t++)
+			if (record.calls[t] > 0)
+				out << " " << ALLOC_TAG_NAMES[t] << " " << record.calls[t] << " (" << record.bytes[t] << " bytes)";
+		out << std::endl;
+	}
+}
+
+#endif
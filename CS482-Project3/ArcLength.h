@@ -0,0 +1,198 @@
+//////////////////////////////////////////////////////
+// ArcLength.h - Centerline sample table mapping    //
+// distance along the track to position/direction.  //
+//////////////////////////////////////////////////////
+
+#ifndef _H_ARC_LENGTH_
+#define _H_ARC_LENGTH_
+
+#include <vector>
+#include <cmath>
+#include "Track.h"
+
+// Distances are stored per segment (a run of samples) with the segment
+// lengths in a Fenwick tree, so re-measuring a few segments after an edit
+// costs O(edit + log segments) instead of rewriting every later distance.
+class ArcLengthTable {
+public:
+	//world-space centerline samples and their unit directions
+	std::vector<GLfloatPoint> points;
+	std::vector<GLfloatPoint> directions;
+	//distance from the first sample of the sample's segment
+	std::vector<double_t> localDistance;
+	//segment s covers samples [segmentStart[s], segmentStart[s + 1])
+	std::vector<int> segmentStart;
+	//length of each segment, including the step to the next segment
+	std::vector<double_t> segmentLength;
+
+	void build(Track& track, int samples, int segments);
+	void rebuildSegments(Track& track, int firstSegment, int count);
+	void rebuildLengthTree();
+	int segmentCount() const;
+	int segmentOfSample(int sample) const;
+	double_t totalLength() const;
+	double_t distanceAt(int sample) const;
+	double_t wrap(double_t d) const;
+	int segmentAt(double_t d) const;
+	void frameAt(double_t d, GLfloatPoint& point, GLfloatPoint& forward) const;
+
+private:
+	//Fenwick tree over segmentLength
+	std::vector<double_t> lengthTree;
+	void addLength(int segment, double_t delta);
+	double_t lengthBefore(int segment) const;
+	void measureSegment(int segment);
+};
+
+void ArcLengthTable::build(Track& track, int samples, int segments) {
+	points.resize(samples);
+	directions.resize(samples);
+	localDistance.resize(samples);
+	segmentStart.resize(segments + 1);
+	for (int s = 0; s <= segments; s++)
+		segmentStart[s] = s*samples / segments;
+	segmentLength.assign(segments, 0);
+	lengthTree.assign(segments + 1, 0);
+	rebuildSegments(track, 0, segments);
+}
+
+//resample and re-measure segments [firstSegment, firstSegment + count), wrapping around the loop
+void ArcLengthTable::rebuildSegments(Track& track, int firstSegment, int count) {
+	const int samples = (int)points.size();
+	const double_t dt = track.length() / samples;
+	const int segments = segmentCount();
+	for (int k = 0; k < count; k++) {
+		int s = (firstSegment + k) % segments;
+		for (int i = segmentStart[s]; i < segmentStart[s + 1]; i++) {
+			points[i] = track.center(dt*i);
+			directions[i] = track.direction(dt*i, dt);
+		}
+	}
+	//a segment's length also depends on the first sample of the next one
+	for (int k = 0; k < count; k++)
+		measureSegment((firstSegment + k) % segments);
+	measureSegment((firstSegment + segments - 1) % segments);
+}
+
+//recompute the Fenwick tree after the public tables were filled directly (e.g. from a cache)
+void ArcLengthTable::rebuildLengthTree() {
+	lengthTree.assign(segmentLength.size() + 1, 0);
+	for (int s = 0; s < segmentCount(); s++)
+		addLength(s, segmentLength[s]);
+}
+
+void ArcLengthTable::measureSegment(int segment) {
+	const int samples = (int)points.size();
+	double_t d = 0;
+	for (int i = segmentStart[segment]; i < segmentStart[segment + 1]; i++) {
+		localDistance[i] = d;
+		const GLfloatPoint& a = points[i];
+		const GLfloatPoint& b = points[(i + 1) % samples];
+		d += sqrt((b.x - a.x)*(b.x - a.x) + (b.y - a.y)*(b.y - a.y) + (b.z - a.z)*(b.z - a.z));
+	}
+	addLength(segment, d - segmentLength[segment]);
+	segmentLength[segment] = d;
+}
+
+void ArcLengthTable::addLength(int segment, double_t delta) {
+	for (int i = segment + 1; i < (int)lengthTree.size(); i += i & -i)
+		lengthTree[i] += delta;
+}
+
+//total length of the segments before this one
+double_t ArcLengthTable::lengthBefore(int segment) const {
+	double_t sum = 0;
+	for (int i = segment; i > 0; i -= i & -i)
+		sum += lengthTree[i];
+	return sum;
+}
+
+int ArcLengthTable::segmentCount() const {
+	return (int)segmentLength.size();
+}
+
+int ArcLengthTable::segmentOfSample(int sample) const {
+	int lo = 0, hi = segmentCount() - 1;
+	while (lo < hi) {
+		int mid = (lo + hi + 1) / 2;
+		if (segmentStart[mid] <= sample)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return lo;
+}
+
+double_t ArcLengthTable::totalLength() const {
+	return segmentLength.empty() ? 0 : lengthBefore(segmentCount());
+}
+
+//distance from sample 0 to the sample; sample == number of samples gives the full lap
+double_t ArcLengthTable::distanceAt(int sample) const {
+	if (sample >= (int)points.size())
+		return totalLength();
+	int s = segmentOfSample(sample);
+	return lengthBefore(s) + localDistance[sample];
+}
+
+//bring any distance into [0, totalLength)
+double_t ArcLengthTable::wrap(double_t d) const {
+	double_t total = totalLength();
+	if (total <= 0)
+		return 0;
+	d = fmod(d, total);
+	return d < 0 ? d + total : d;
+}
+
+//index of the sample that starts the step containing d
+int ArcLengthTable::segmentAt(double_t d) const {
+	d = wrap(d);
+	//descend the Fenwick tree to the last segment starting at or before d
+	int segment = 0;
+	int step = 1;
+	while (step * 2 < (int)lengthTree.size())
+		step *= 2;
+	for (; step > 0; step /= 2) {
+		int next = segment + step;
+		if (next < (int)lengthTree.size() && lengthTree[next] <= d) {
+			segment = next;
+			d -= lengthTree[next];
+		}
+	}
+	if (segment >= segmentCount())
+		segment = segmentCount() - 1;
+	int lo = segmentStart[segment], hi = segmentStart[segment + 1] - 1;
+	while (lo < hi) {
+		int mid = (lo + hi + 1) / 2;
+		if (localDistance[mid] <= d)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return lo;
+}
+
+//interpolated centerline point and unit direction at distance d (wraps around the lap)
+void ArcLengthTable::frameAt(double_t d, GLfloatPoint& point, GLfloatPoint& forward) const {
+	d = wrap(d);
+	const int n = (int)points.size();
+	int i = segmentAt(d);
+	int j = (i + 1) % n;
+	double_t d0 = distanceAt(i);
+	double_t span = distanceAt(i + 1) - d0;
+	double_t u = span > 0 ? (d - d0) / span : 0;
+	if (u > 1)
+		u = 1;
+	point.x = points[i].x + u*(points[j].x - points[i].x);
+	point.y = points[i].y + u*(points[j].y - points[i].y);
+	point.z = points[i].z + u*(points[j].z - points[i].z);
+	forward.x = directions[i].x + u*(directions[j].x - directions[i].x);
+	forward.y = directions[i].y + u*(directions[j].y - directions[i].y);
+	forward.z = directions[i].z + u*(directions[j].z - directions[i].z);
+	double_t len = sqrt(forward.x*forward.x + forward.y*forward.y + forward.z*forward.z);
+	forward.x /= len;
+	forward.y /= len;
+	forward.z /= len;
+}
+
+#endif
@@ -0,0 +1,492 @@
+//////////////////////////////////////////////////////
+// BatchSimulation.h - Headless lap simulation of   //
+// track/scenario variants across all cores, with   //
+// lap and per-segment statistics in one CSV file.  //
+//////////////////////////////////////////////////////
+
+#ifndef _H_BATCH_SIMULATION_
+#define _H_BATCH_SIMULATION_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Simulation.h"
+#include "TrackDefinition.h"
+#include "Trace.h"
+
+// A variant's laps are split into runs of this many, each driven from the
+// start line by whichever worker picks it up. Runs are merged in order, so
+// the results do not depend on the number of threads.
+const int BATCH_LAPS_PER_RUN = 50;
+// A vehicle that has not finished a lap in this many sub-steps is stuck.
+const long long BATCH_MAX_LAP_SUBSTEPS = 1000000;
+const double BATCH_SUBSTEP_SECONDS = SUBSTEP_MS / 1000.0;
+
+// Scenario files, one directive per line ('#' starts a comment):
+//   speed <mph>                   starting speed (default the app's)
+//   lane left|right               starting lane
+//   at <fraction> speed <mph>     every lap, on reaching this fraction of it
+//   at <fraction> accelerate|decelerate|left|right
+// Speeds are held within the limits of the arrow keys.
+struct ScenarioEvent {
+	double lapFraction;
+	bool setsSpeed;
+	VEHICLE_COMMAND command;
+	//lap angle per tick, for speed events
+	GLfloat angleIncrement;
+};
+
+struct Scenario {
+	GLfloat startIncrement;
+	SOR startLane;
+	std::vector<ScenarioEvent> events;
+};
+
+// Lap angle increment per tick for a speed in MPH, within the key limits.
+GLfloat AngleIncrementForSpeed(GLfloat mph) {
+	GLfloat increment = mph * 2 * PI * REFRESH_RATE / (TRACK_LENGTH_IN_MILES * MILLISECONDS_PER_HOUR);
+	return std::min(std::max(increment, MIN_USER_ANGLE_INCREMENT), MAX_USER_ANGLE_INCREMENT);
+}
+
+bool ParseLaneName(const std::string& name, SOR& lane) {
+	if (name == "left")
+		lane = LHS;
+	else if (name == "right")
+		lane = RHS;
+	else
+		return false;
+	return true;
+}
+
+bool ParseScenarioAction(std::istringstream& fields, ScenarioEvent& event) {
+	std::string action;
+	if (!(fields >> action))
+		return false;
+	GLfloat mph;
+	event.setsSpeed = action == "speed";
+	event.angleIncrement = 0;
+	if (event.setsSpeed)
+	{
+		if (!(fields >> mph) || mph <= 0)
+			return false;
+		event.angleIncrement = AngleIncrementForSpeed(mph);
+		return true;
+	}
+	if (action == "accelerate")
+		event.command = ACCELERATE;
+	else if (action == "decelerate")
+		event.command = DECELERATE;
+	else if (action == "left")
+		event.command = MOVE_LEFT;
+	else if (action == "right")
+		event.command = MOVE_RIGHT;
+	else
+		return false;
+	return true;
+}
+
+bool EventBefore(const ScenarioEvent& a, const ScenarioEvent& b) {
+	return a.lapFraction < b.lapFraction;
+}
+
+// Parse a scenario from text. On failure returns false and describes the problem in error.
+bool ParseScenario(const std::string& text, Scenario& scenario, std::string& error)
+{
+	scenario.startIncrement = INITIAL_USER_ANGLE_INCREMENT;
+	scenario.startLane = INITIAL_SIDE_OF_ROAD;
+	scenario.events.clear();
+
+	std::istringstream input(text);
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(input, line))
+	{
+		lineNumber++;
+		size_t comment = line.find('#');
+		if (comment != std::string::npos)
+			line.erase(comment);
+		std::istringstream fields(line);
+		std::string keyword;
+		if (!(fields >> keyword))
+			continue;
+
+		bool ok;
+		GLfloat mph;
+		if (keyword == "speed")
+		{
+			ok = (fields >> mph) && mph > 0;
+			if (ok)
+				scenario.startIncrement = AngleIncrementForSpeed(mph);
+		}
+		else if (keyword == "lane")
+		{
+			std::string lane;
+			ok = (fields >> lane) && ParseLaneName(lane, scenario.startLane);
+		}
+		else if (keyword == "at")
+		{
+			ScenarioEvent event;
+			ok = (fields >> event.lapFraction) && event.lapFraction >= 0 && event.lapFraction < 1
+				&& ParseScenarioAction(fields, event);
+			if (ok)
+				scenario.events.push_back(event);
+		}
+		else
+			ok = false;
+
+		if (!ok)
+		{
+			std::ostringstream message;
+			message << "line " << lineNumber << ": cannot parse \"" << line << "\"";
+			error = message.str();
+			return false;
+		}
+	}
+	std::stable_sort(scenario.events.begin(), scenario.events.end(), EventBefore);
+	return true;
+}
+
+// Time, lane path and speed through one section of the lap (the whole lap
+// or one track segment), over every simulated lap.
+struct SectionStats {
+	int laps;
+	double time, timeMin, timeMax;
+	double path;
+	double speedMin, speedMax;
+
+	SectionStats() : laps(0), time(0), timeMin(0), timeMax(0), path(0), speedMin(0), speedMax(0) {}
+
+	void merge(const SectionStats& other) {
+		if (other.laps == 0)
+			return;
+		timeMin = laps == 0 ? other.timeMin : std::min(timeMin, other.timeMin);
+		timeMax = laps == 0 ? other.timeMax : std::max(timeMax, other.timeMax);
+		speedMin = laps == 0 ? other.speedMin : std::min(speedMin, other.speedMin);
+		speedMax = laps == 0 ? other.speedMax : std::max(speedMax, other.speedMax);
+		laps += other.laps;
+		time += other.time;
+		path += other.path;
+	}
+};
+
+// What one run (or a whole variant, once its runs are merged) measured.
+// sections[0] is the whole lap and sections[1 + s] track segment s.
+struct BatchResult {
+	int laps;
+	double miles;
+	bool stuck;
+	std::vector<SectionStats> sections;
+
+	BatchResult() : laps(0), miles(0), stuck(false) {}
+
+	void merge(const BatchResult& other) {
+		if (sections.size() < other.sections.size())
+			sections.resize(other.sections.size());
+		for (size_t i = 0; i < other.sections.size(); i++)
+			sections[i].merge(other.sections[i]);
+		laps += other.laps;
+		miles += other.miles;
+		stuck = stuck || other.stuck;
+	}
+};
+
+// One line of the job list: a track (a definition file, or "builtin"),
+// a scenario file ("-" for the default), and how many laps to drive.
+struct BatchVariant {
+	std::string trackName;
+	std::string scenarioName;
+	int laps;
+	Scenario scenario;
+	const TrackAssets* assets;
+	BatchResult result;
+};
+
+// Drive laps through the scenario on one track and measure every sub-step.
+// Every lap starts on the start line at the scenario's speed and lane, so
+// relative events (accelerate, left, ...) act on that lap alone and laps
+// can be split between workers freely. Needs only the track's (read-only)
+// tables.
+void SimulateLaps(const TrackAssets& assets, const Scenario& scenario, int laps, BatchResult& result)
+{
+	TRACE_FUNCTION();
+	const int segments = assets.arcLength.segmentCount();
+	const double milesPerUnit = TRACK_LENGTH_IN_MILES / assets.arcLength.totalLength();
+	std::vector<double> lapTime(segments + 1), lapPath(segments + 1), lapMin(segments + 1), lapMax(segments + 1);
+	result.sections.assign(segments + 1, SectionStats());
+
+	VehicleState vehicle;
+	GLfloat position[3], next[3], forward[3];
+	for (int lap = 0; lap < laps; lap++)
+	{
+		ResetVehicle(vehicle);
+		vehicle.angleIncrement = scenario.startIncrement;
+		vehicle.sideOfRoad = scenario.startLane;
+		vehicle.laneOffset = scenario.startLane == LHS ? LEFT_LANE_OFFSET : RIGHT_LANE_OFFSET;
+		assets.lanePoint(LapDistance(assets, vehicle.lapAngle), vehicle.laneOffset, 0, position, forward);
+		std::fill(lapTime.begin(), lapTime.end(), 0.0);
+		std::fill(lapPath.begin(), lapPath.end(), 0.0);
+		size_t nextEvent = 0;
+		long long substeps = 0;
+		while (vehicle.lapAngle < 2 * PI)
+		{
+			if (++substeps > BATCH_MAX_LAP_SUBSTEPS)
+			{
+				result.stuck = true;
+				return;
+			}
+			// Scenario events fire at the start of the sub-step that reaches them.
+			double fraction = vehicle.lapAngle / (2 * PI);
+			for (; nextEvent < scenario.events.size() && scenario.events[nextEvent].lapFraction <= fraction; nextEvent++)
+			{
+				const ScenarioEvent& event = scenario.events[nextEvent];
+				if (event.setsSpeed)
+					vehicle.angleIncrement = event.angleIncrement;
+				else
+					CommandVehicle(vehicle, event.command);
+			}
+
+			GLfloat distance = LapDistance(assets, vehicle.lapAngle);
+			int section = 1 + assets.arcLength.segmentOfSample(assets.arcLength.segmentAt(distance));
+			StepVehicle(vehicle);
+			assets.lanePoint(LapDistance(assets, vehicle.lapAngle), vehicle.laneOffset, 0, next, forward);
+			double step = sqrt((next[0] - position[0]) * (next[0] - position[0])
+				+ (next[1] - position[1]) * (next[1] - position[1]) + (next[2] - position[2]) * (next[2] - position[2]));
+			double mph = step * milesPerUnit * 3600 / BATCH_SUBSTEP_SECONDS;
+			for (int s = 0; s < 2; s++)
+			{
+				int i = s == 0 ? 0 : section;
+				bool first = lapTime[i] == 0;
+				lapTime[i] += BATCH_SUBSTEP_SECONDS;
+				lapPath[i] += step;
+				lapMin[i] = first ? mph : std::min(lapMin[i], mph);
+				lapMax[i] = first ? mph : std::max(lapMax[i], mph);
+			}
+			for (int k = 0; k < 3; k++)
+				position[k] = next[k];
+		}
+
+		for (int i = 0; i <= segments; i++)
+		{
+			if (lapTime[i] == 0)
+				continue;
+			SectionStats lapStats;
+			lapStats.laps = 1;
+			lapStats.time = lapStats.timeMin = lapStats.timeMax = lapTime[i];
+			lapStats.path = lapPath[i];
+			lapStats.speedMin = lapMin[i];
+			lapStats.speedMax = lapMax[i];
+			result.sections[i].merge(lapStats);
+		}
+		result.laps++;
+		result.miles += vehicle.distanceTraveled;
+	}
+}
+
+// Read and parse a job list; scenario files are parsed here too.
+bool ReadBatchJobs(const std::string& path, std::vector<BatchVariant>& variants, std::string& error)
+{
+	std::string text;
+	if (!ReadTrackFile(path, text))
+	{
+		error = "cannot open " + path;
+		return false;
+	}
+	std::istringstream input(text);
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(input, line))
+	{
+		lineNumber++;
+		size_t comment = line.find('#');
+		if (comment != std::string::npos)
+			line.erase(comment);
+		std::istringstream fields(line);
+		BatchVariant variant;
+		if (!(fields >> variant.trackName))
+			continue;
+		std::ostringstream where;
+		where << path << " line " << lineNumber << ": ";
+		if (!(fields >> variant.scenarioName >> variant.laps) || variant.laps <= 0)
+		{
+			error = where.str() + "expected <track> <scenario> <laps>";
+			return false;
+		}
+		std::string scenarioText, scenarioError;
+		if (variant.scenarioName != "-" && !ReadTrackFile(variant.scenarioName, scenarioText))
+		{
+			error = where.str() + "cannot open " + variant.scenarioName;
+			return false;
+		}
+		if (!ParseScenario(scenarioText, variant.scenario, scenarioError))
+		{
+			error = where.str() + variant.scenarioName + ": " + scenarioError;
+			return false;
+		}
+		variant.assets = NULL;
+		variants.push_back(variant);
+	}
+	if (variants.empty())
+	{
+		error = path + " lists no variants";
+		return false;
+	}
+	return true;
+}
+
+// Run job(i) for i in [0, count) on the given number of threads, each
+// taking the next unclaimed index until none are left.
+template <typename Job>
+void RunParallel(int count, int threads, const Job& job)
+{
+	std::atomic<int> nextJob(0);
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threads; t++)
+		workers.push_back(std::thread([&]() {
+			TraceThreadName("batch worker");
+			for (int i = nextJob++; i < count; i = nextJob++)
+				job(i);
+		}));
+	for (size_t t = 0; t < workers.size(); t++)
+		workers[t].join();
+}
+
+bool WriteBatchResults(const std::string& path, const std::vector<BatchVariant>& variants, std::string& error)
+{
+	std::ofstream out(path.c_str(), std::ios::out | std::ios::trunc);
+	if (!out)
+	{
+		error = "cannot create " + path;
+		return false;
+	}
+	out << "variant,track,scenario,section,laps,time_mean_s,time_min_s,time_max_s,"
+		"path_mean,distance_miles,speed_mean_mph,speed_min_mph,speed_max_mph\n";
+	out.precision(9);
+	for (size_t v = 0; v < variants.size(); v++)
+	{
+		const BatchVariant& variant = variants[v];
+		const double milesPerUnit = TRACK_LENGTH_IN_MILES / variant.assets->arcLength.totalLength();
+		for (size_t i = 0; i < variant.result.sections.size(); i++)
+		{
+			const SectionStats& stats = variant.result.sections[i];
+			if (stats.laps == 0)
+				continue;
+			double miles = i == 0 ? variant.result.miles : stats.path * milesPerUnit;
+			out << v << ',' << variant.trackName << ',' << variant.scenarioName << ',';
+			if (i == 0)
+				out << "lap";
+			else
+				out << "segment " << i - 1;
+			out << ',' << stats.laps << ',' << stats.time / stats.laps << ',' << stats.timeMin << ',' << stats.timeMax
+				<< ',' << stats.path / stats.laps << ',' << miles << ',' << stats.path * milesPerUnit * 3600 / stats.time
+				<< ',' << stats.speedMin << ',' << stats.speedMax << '\n';
+		}
+	}
+	if (!out)
+	{
+		error = "cannot write " + path;
+		return false;
+	}
+	return true;
+}
+
+// Simulate every variant in the job list at the given track tessellation
+// and write the results. No GL context is needed; builtinTrack makes the
+// built-in parametric track.
+bool RunBatch(const std::string& jobsPath, const std::string& resultsPath, int samples, int threads,
+	Track* (*builtinTrack)(), std::string& error)
+{
+	TRACE_FUNCTION();
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	std::vector<BatchVariant> variants;
+	if (!ReadBatchJobs(jobsPath, variants, error))
+		return false;
+	if (threads < 1)
+		threads = std::max(1, (int)std::thread::hardware_concurrency());
+
+	// Each distinct track is built once, in parallel, and shared read-only.
+	std::map<std::string, TrackAssets*> tracks;
+	std::vector<std::string> trackNames;
+	for (size_t v = 0; v < variants.size(); v++)
+		if (tracks.insert(std::make_pair(variants[v].trackName, (TrackAssets*)NULL)).second)
+			trackNames.push_back(variants[v].trackName);
+	std::vector<std::string> trackErrors(trackNames.size());
+	std::vector<TrackAssets*> built(trackNames.size(), (TrackAssets*)NULL);
+	RunParallel((int)trackNames.size(), threads, [&](int t) {
+		std::string text;
+		TrackDefinition def;
+		if (trackNames[t] == "builtin")
+			built[t] = new TrackAssets(builtinTrack(), ROAD_WIDTH, TRACK_THICKNESS);
+		else if (!ReadTrackFile(trackNames[t], text))
+			trackErrors[t] = "cannot open " + trackNames[t];
+		else if (!ParseTrackDefinition(text, def, trackErrors[t]))
+			trackErrors[t] = trackNames[t] + ": " + trackErrors[t];
+		else
+			built[t] = new TrackAssets(new Track(def.controlPoints, def.scale), def.width, def.thickness);
+		if (built[t] != NULL)
+			built[t]->rebuild(samples);
+	});
+	bool tracksOk = true;
+	for (size_t t = 0; t < trackNames.size(); t++)
+	{
+		tracks[trackNames[t]] = built[t];
+		if (built[t] == NULL && tracksOk)
+		{
+			error = trackErrors[t];
+			tracksOk = false;
+		}
+	}
+
+	// Split every variant into runs and simulate them all.
+	struct BatchRun {
+		int variant;
+		int laps;
+		BatchResult result;
+	};
+	std::vector<BatchRun> runs;
+	long long totalLaps = 0;
+	for (size_t v = 0; tracksOk && v < variants.size(); v++)
+	{
+		variants[v].assets = tracks[variants[v].trackName];
+		for (int lap = 0; lap < variants[v].laps; lap += BATCH_LAPS_PER_RUN)
+		{
+			BatchRun run;
+			run.variant = (int)v;
+			run.laps = std::min(BATCH_LAPS_PER_RUN, variants[v].laps - lap);
+			runs.push_back(run);
+		}
+		totalLaps += variants[v].laps;
+	}
+	if (tracksOk)
+	{
+		RunParallel((int)runs.size(), threads, [&](int r) {
+			const BatchVariant& variant = variants[runs[r].variant];
+			SimulateLaps(*variant.assets, variant.scenario, runs[r].laps, runs[r].result);
+		});
+		for (size_t r = 0; r < runs.size(); r++)
+			variants[runs[r].variant].result.merge(runs[r].result);
+		for (size_t v = 0; v < variants.size(); v++)
+			if (variants[v].result.stuck)
+				std::cerr << "variant " << v << " (" << variants[v].trackName << ", " << variants[v].scenarioName
+					<< ") stopped: a lap took over " << BATCH_MAX_LAP_SUBSTEPS << " sub-steps" << std::endl;
+		tracksOk = WriteBatchResults(resultsPath, variants, error);
+	}
+
+	for (size_t t = 0; t < built.size(); t++)
+		delete built[t];
+	if (!tracksOk)
+		return false;
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	std::cout << "Batch: " << variants.size() << " variants, " << totalLaps << " laps on " << threads
+		<< " threads in " << seconds << " s (" << totalLaps / seconds << " laps/s) -> " << resultsPath << std::endl;
+	return true;
+}
+
+#endif
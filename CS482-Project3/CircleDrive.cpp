@@ -9,22 +9,42 @@
 /* driver's seat, from the infield, or from the outfield).   */
 /*************************************************************/
 
+#include <gl/glew.h>		// Must precede the other GL headers //
 #include <gl/freeglut.h>
 #include <iostream>		// For diagnostic I/O              //
 #include <cmath>		// Contains math functions         //
 #include <ctime>		// Accesses system time info       //
 #include <stdlib.h>		// Enables random number generator //
+#include <chrono>		// Times incremental track edits    //
 #include "Font.h"		// Font generation routines        //
 #include "DriveGlobals.h"
 #include "Track.h"
+#include "TrackMesh.h"
+#include "TrackAssets.h"
+#include "TrackReload.h"
+#include "FixedFunctionRenderer.h"
+#include "ShaderRenderer.h"
+#include "MultiView.h"
+#include "Terrain.h"
+#include "Visibility.h"
+#include "Telemetry.h"
+#include "HudPanel.h"
+#include "Trace.h"
+#include "AllocTracker.h"
+#include "SceneCache.h"
+#include "InputQueue.h"
+#include "Simulation.h"
+#include "SimulationThread.h"
+#include "SharedState.h"
+#include "BatchSimulation.h"
+#include "QualityGovernor.h"
+#include "RenderTarget.h"
 using namespace std;
 
 #define HISTORY_BUFFER_SIZE 10
 #define NUM_VERTICIES 100
-#define TRACK_THICKNESS .1
-#define ptA (&point-2)
-#define ptB (&point-1)
-#define ptC (&point)
+#define MIN_TRACK_SAMPLES 16
+#define MAX_TRACK_SAMPLES 3200
 //////////////////////
 // Global variables //
 //////////////////////
@@ -35,78 +55,536 @@ using namespace std;
 GLint currWindowSize[2] = { 900, 600 };
 GLint currViewportSize[2] = { 800, 500 };
 int MULT = 1;
-// The driver's position within the scene. //
-GLfloat time_hour;
-GLfloat time_increment_hour;
+// The driver's position within the scene, as of the snapshot being drawn. //
+VehicleState vehicle;
 GLfloat lookAtAngleDelta;
-GLfloat distanceTraveled;
-GLfloat laneOffset;
-SOR     sideOfRoad;
 
 // The camera's current viewpoint. //
 VIEW cameraViewpoint;
 
-// Flags indicating whether vehicle is changing lanes. //
-bool movingLeft = false;
-bool movingRight = false;
+// The vehicle is stepped on its own thread, which takes the arrow keys as
+// commands and publishes snapshots; the GLUT thread only renders, redrawing
+// whenever a new snapshot is out. The probe times each key until the first
+// frame that shows it. //
+SimulationThread simulation;
+ThreadTiming renderTiming;
+LatencyProbe latencyProbe;
+// How long the idle GLUT thread sleeps between checks for a new snapshot. //
+const int RENDER_IDLE_MS = 1;
 
 // Coordinates of scene components that will be rendered. //
-GLfloat treeBaseRadius[NUMBER_TREES];
-GLfloat treeHeight[NUMBER_TREES];
-GLfloat treePosition[NUMBER_TREES][3];
+// Ground and trees, streamed in chunks around the cameras. //
+TerrainStreamer terrain;
+unsigned terrainSeed = 0;
+std::vector<GLfloat> terrainFoci;
+// What the driver can see from each section of the track, rebuilt in the
+// background whenever the track changes. //
+VisibilityBuilder visibility;
+
+// Backend that draws the 3D scene (the display panel stays fixed-function). //
+Renderer* renderer = NULL;
+
+// Scene detail adapts to hold the frame budget ("-frame-budget <ms>",
+// 0 for fixed full quality); views below full resolution are drawn to
+// sceneTarget and stretched into the window. //
+const double DEFAULT_FRAME_BUDGET_MS = 1000.0 / 60.0;
+QualityGovernor governor;
+FrameTimer frameTimer;
+RenderTarget sceneTarget;
+
+// This frame's draw list and the cameras that view it. //
+SceneList scene;
+ViewSet viewSet;
+bool splitScreen = false;
+
+// Per-tick vehicle state recorded to disk ("-telemetry <file>"). //
+TelemetryWriter telemetry;
+
+// Live vehicle and camera state for other processes ("-shm <name>"). //
+SharedStateExport stateExport;
+unsigned long long renderedFrames = 0;
+
+// Timeline of scoped zones ("-trace <file>"), written at exit or on T. //
+string tracePath = "trace.json";
+
+// Render-thread allocations per frame, shown in the display panel;
+// "-alloc-test <frames>" fails the run if steady-state frames allocate. //
+AllocFrameMonitor allocMonitor;
 
 // Fonts for use in the display panel. //
 GLFONT *TextFont;
 GLFONT *SmallTextFont;
 GLFONT *MediumTextFont;
 GLFONT *LargeTextFont;
-Track* track = NULL;
+// The display panel, redrawn only where a readout changes. //
+enum HUD_WIDGET { DISTANCE_WIDGET, SPEED_WIDGET, LANE_WIDGET, ALLOC_WIDGET, NUM_HUD_WIDGETS };
+HudPanel hud;
+// The track being driven, and the watcher that rebuilds it when its
+// definition file changes.
+TrackAssets* activeTrack = NULL;
+TrackReloader trackReloader;
+string trackPath = "track.def";
+// Startup track geometry cached between runs ("-scene-cache <file>"). //
+string sceneCachePath = "scene.cache";
+int trackSamples = NUM_VERTICIES;
+// Control point being edited (spline tracks only), nudged a step at a time.
+const GLfloat TRACK_EDIT_STEP = 0.05f;
+bool editingTrack = false;
+int selectedControlPoint = 0;
 
 /***********************/
 /* Function prototypes */
 /***********************/
 void KeyboardPress(unsigned char pressedKey, int mouseXPosition, int mouseYPosition);
 void NonASCIIKeyboardPress(int pressedKey, int mouseXPosition, int mouseYPosition);
-void TimerFunction(int value);
+void ReportLatency();
+void ReportThreads();
+void IdleFunction();
 void InitializeScene();
-void InitializeTrees();
-bool TreeCollision(int index);
+void InitializeTerrain();
+void InitializeRenderer(bool useShaders);
+void UploadPrimitives(const QualitySettings& quality);
+void ApplyQuality();
+int QualityTrackSamples();
 void Display();
-void DrawTrack();
-void DrawGround();
-void DrawTrees();
-void DrawVehicle();
+Camera MakeCamera(VIEW viewpoint, const GLfloat vehiclePosition[3], const GLfloat driverLookAtPosition[3],
+	const GLfloat chasePosition[3]);
+void QueueTrack(const PotentiallyVisibleSets* pvs, int section);
+void QueueVehicle(unsigned views);
+void LayoutDisplayPanel();
 void DrawDisplayPanel();
 void InitializeTrack();
+Track* BuiltinTrack();
+void RegenerateTrack();
+void SwapInPendingTrack();
+void UploadTrack();
+void NudgeControlPoint(GLfloat dx, GLfloat dz);
+void ApplyTrackEdits();
+void RequestVisibility();
+PvsInput* MakeVisibilityInput();
+GLfloat LapDistance(GLfloat lapAngle);
+void WriteTrace();
+void ReportAllocations();
+bool PackCheck();
+void StopSimulation();
 void ResizeWindow(GLsizei w, GLsizei h);
-float GenerateRandomNumber(float lowerBound, float upperBound);
 double xCoord(double t);
 double yCoord(double t);
 double zCoord(double t);
+// Load the track from its definition file (or fall back to the built-in
+// parametric track), then watch the file for changes. The tessellated
+// mesh and tables come from the scene cache when it was made from the
+// same definition and sample count, and the cache is rewritten otherwise.
 void InitializeTrack() {
-	track = new Track(xCoord, yCoord, zCoord, -PI_OVER_2, 3 * PI_OVER_2);
+	TRACE_FUNCTION();
+	ALLOC_SCOPE(ALLOC_TRACK);
+	string text, error;
+	TrackDefinition def;
+	unsigned long long hash = 0;
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+
+	if (ReadTrackFile(trackPath, text) && ParseTrackDefinition(text, def, error))
+	{
+		activeTrack = new TrackAssets(new Track(def.controlPoints, def.scale), def.width, def.thickness);
+		hash = HashText(text);
+		cout << "Track: " << trackPath << endl;
+	}
+	else
+	{
+		if (!error.empty())
+			cerr << trackPath << ": " << error << endl;
+		activeTrack = new TrackAssets(BuiltinTrack(), ROAD_WIDTH, TRACK_THICKNESS);
+		cout << "Track: built-in" << endl;
+	}
 
-	track->generateVerticies(NUM_VERTICIES, ROAD_WIDTH, TRACK_THICKNESS);
-	
+	uint64_t cacheKey = SceneCacheKey(hash, trackSamples, activeTrack->width, activeTrack->thickness);
+	bool cached = LoadSceneCache(sceneCachePath, cacheKey, *activeTrack);
+	if (!cached)
+	{
+		activeTrack->rebuild(trackSamples);
+		if (!SaveSceneCache(sceneCachePath, cacheKey, *activeTrack))
+			cerr << "cannot write scene cache " << sceneCachePath << endl;
+	}
+	double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+	cout << "Track " << (cached ? "loaded from " + sceneCachePath : string("built")) << " in " << elapsed << " ms" << endl;
+	UploadTrack();
+	trackReloader.start(trackPath, hash, trackSamples);
+}
+
+// The parametric track used when there is no definition file.
+Track* BuiltinTrack() {
+	return new Track(xCoord, yCoord, zCoord, -PI_OVER_2, 3 * PI_OVER_2);
+}
+
+// Re-tessellate the track at the current sample count, reusing the
+// track's vertex arena and the mesh buffers.
+void RegenerateTrack() {
+	TRACE_FUNCTION();
+	ALLOC_SCOPE(ALLOC_TRACK);
+	activeTrack->rebuild(QualityTrackSamples());
+	trackReloader.setSamples(QualityTrackSamples());
+	UploadTrack();
+	RequestVisibility();
+}
+
+// Hand the active track's mesh to the renderer.
+void UploadTrack() {
+	const TrackMesh& trackMesh = activeTrack->mesh;
+	renderer->uploadMesh(TRACK_MESH, trackMesh.mesh);
+	scene.setMeshBounds(TRACK_MESH, trackMesh.mesh);
+	cout << "Track mesh: " << trackMesh.mesh.verticies.size() << " verticies, "
+		<< trackMesh.mesh.indices.size() / 3 << " triangles, ACMR "
+		<< trackMesh.acmrBefore << " -> " << trackMesh.acmrAfter << endl;
+}
+
+// At a frame boundary, replace the active track with one rebuilt in the
+// background, if any. The vehicle's progress is kept as a lap angle, i.e.
+// a normalized distance, so it lands at the same fraction of the new lap.
+void SwapInPendingTrack() {
+	TRACE_FUNCTION();
+	ALLOC_SCOPE(ALLOC_TRACK);
+	TrackAssets* fresh = trackReloader.takePending();
+	if (fresh == NULL)
+		return;
+	delete activeTrack;
+	activeTrack = fresh;
+	selectedControlPoint = 0;
+	UploadTrack();
+	terrain.trackChanged(*activeTrack);
+	RequestVisibility();
+	cout << "Track reloaded: " << trackPath << endl;
+}
+
+// Move the selected control point within the ground plane; the affected
+// segments are re-tessellated at the next frame.
+void NudgeControlPoint(GLfloat dx, GLfloat dz) {
+	Track* track = activeTrack->track;
+	if (!editingTrack || track->controlPointCount() == 0)
+		return;
+	GLfloatPoint point = track->controlPoint(selectedControlPoint);
+	point.x += dx;
+	point.z += dz;
+	activeTrack->moveControlPoint(selectedControlPoint, point);
+}
+
+// Re-tessellate the segments touched by edits since the last frame and
+// upload just their verticies.
+void ApplyTrackEdits() {
+	if (!activeTrack->dirty)
+		return;
+	TRACE_FUNCTION();
+	ALLOC_SCOPE(ALLOC_TRACK);
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	int redone = activeTrack->updateDirtySegments();
+	const TrackMesh& trackMesh = activeTrack->mesh;
+	for (size_t i = 0; i < activeTrack->updatedRanges.size(); i++)
+	{
+		const SampleRange& range = activeTrack->updatedRanges[i];
+		renderer->updateMeshRange(TRACK_MESH, trackMesh.mesh,
+			range.first * TRACK_RING_VERTICIES, range.count * TRACK_RING_VERTICIES);
+		scene.growMeshBounds(TRACK_MESH, trackMesh.mesh,
+			range.first * TRACK_RING_VERTICIES, range.count * TRACK_RING_VERTICIES);
+	}
+	terrain.trackEdited(*activeTrack);
+	visibility.trackEdited(*activeTrack);
+	double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+	cout << "Track edit: " << redone << " of " << activeTrack->samples << " samples in "
+		<< activeTrack->updatedRanges.size() << " runs, " << elapsed << " ms" << endl;
+}
+
+// Hand the builder the driver cameras of every section of the active
+// track, and drop the sets for the old one.
+void RequestVisibility() {
+	visibility.request(MakeVisibilityInput());
+}
+
+// What a visibility build needs from the active track.
+PvsInput* MakeVisibilityInput() {
+	ALLOC_SCOPE(ALLOC_TRACK);
+	GLfloat eye[3], center[3], forward[3];
+	const GLfloat LANES[PVS_LANES] = { LEFT_LANE_OFFSET, 0.0f, RIGHT_LANE_OFFSET };
+	PvsInput* input = new PvsInput();
+	input->seed = terrainSeed;
+	input->trackLength = activeTrack->arcLength.totalLength();
+	input->trackWidth = activeTrack->width;
+	input->sections = (int)ceil(input->trackLength / PVS_SECTION_LENGTH);
+	const double_t sectionLength = input->trackLength / input->sections;
+	const double_t lookAhead = LapDistance(lookAtAngleDelta);
+	for (int s = 0; s < input->sections; s++)
+		for (int i = 0; i < PVS_SECTION_STEPS; i++)
+			for (int lane = 0; lane < PVS_LANES; lane++)
+			{
+				double_t d = sectionLength * (s + i / double_t(PVS_SECTION_STEPS - 1));
+				activeTrack->lanePoint(d, LANES[lane], DRIVER_LEVEL, eye, forward);
+				activeTrack->lanePoint(d + lookAhead, LANES[lane], DRIVER_LOOK_LEVEL, center, forward);
+				input->cameras.push_back(MakeCamera(DRIVER, eye, center, eye));
+			}
+	input->arcLength = activeTrack->arcLength;
+	for (size_t i = 0; i < activeTrack->railInstances.size(); i++)
+	{
+		const GLfloat* model = activeTrack->railInstances[i].model;
+		input->railPosts.insert(input->railPosts.end(), model + 12, model + 15);
+	}
+	return input;
+}
+
+// Distance along the active track corresponding to a lap angle.
+GLfloat LapDistance(GLfloat lapAngle) {
+	return LapDistance(*activeTrack, lapAngle);
+}
+
+void ReportAllocations() {
+	allocMonitor.report(cout);
+}
+
+// Join the simulation thread at exit, before the globals it writes to are
+// destroyed (handlers registered in main run ahead of those destructors),
+// and only then unmap the shared state it publishes.
+void StopSimulation() {
+	simulation.stop();
+	stateExport.stop();
+}
+
+// Write the zones recorded so far to the trace file.
+void WriteTrace() {
+	if (TraceWrite(tracePath))
+		cout << "Trace: " << tracePath << endl;
+	else
+		cerr << "cannot write trace to " << tracePath << endl;
+}
+
+// "-pack-check": the meshes the renderer would pack (every quality level's
+// primitives, the track at the requested samples, and terrain chunks near
+// the origin and a long way out), checked without opening a window.
+bool PackCheck() {
+	string text, error;
+	TrackDefinition def;
+	TrackAssets* track;
+	if (ReadTrackFile(trackPath, text) && ParseTrackDefinition(text, def, error))
+		track = new TrackAssets(new Track(def.controlPoints, def.scale), def.width, def.thickness);
+	else
+		track = new TrackAssets(BuiltinTrack(), ROAD_WIDTH, TRACK_THICKNESS);
+	track->rebuild(trackSamples);
+
+	std::vector<MeshData> primitives(1 + 2 * NUM_QUALITY_LEVELS);
+	std::vector<NamedMesh> meshes;
+	BuildCubeMesh(primitives[0]);
+	NamedMesh cube = { "cube", &primitives[0] };
+	meshes.push_back(cube);
+	for (int level = 0; level < NUM_QUALITY_LEVELS; level++)
+	{
+		MeshData& cone = primitives[1 + 2 * level];
+		MeshData& sphere = primitives[2 + 2 * level];
+		BuildConeMesh(cone, QUALITY_LEVELS[level].coneSlices, 6);
+		BuildSphereMesh(sphere, QUALITY_LEVELS[level].sphereSlices, QUALITY_LEVELS[level].sphereSlices);
+		NamedMesh named[2] = { { string("cone (") + QUALITY_LEVELS[level].name + ")", &cone },
+			{ string("sphere (") + QUALITY_LEVELS[level].name + ")", &sphere } };
+		meshes.insert(meshes.end(), named, named + 2);
+	}
+	NamedMesh trackMesh = { "track", &track->mesh.mesh };
+	meshes.push_back(trackMesh);
+
+	TerrainChunkData chunks[2];
+	chunks[0].cx = chunks[0].cz = 0;
+	chunks[1].cx = chunks[1].cz = -1000;
+	for (int c = 0; c < 2; c++)
+	{
+		GenerateTerrainChunk(terrainSeed, chunks[c]);
+		NamedMesh ground = { "terrain chunk " + std::to_string(chunks[c].cx) + "," + std::to_string(chunks[c].cz),
+			&chunks[c].ground };
+		meshes.push_back(ground);
+	}
+
+	bool passed = RunPackCheck(meshes, cout);
+	delete track;
+	return passed;
+}
+
+// Pick the shader backend when the context supports GL 3.3, falling back to
+// the fixed-function pipeline, then upload the shared meshes and materials.
+void InitializeRenderer(bool useShaders)
+{
+	TRACE_FUNCTION();
+	MeshData mesh;
+
+	if (useShaders)
+	{
+		renderer = new ShaderRenderer();
+		if (!renderer->initialize())
+		{
+			delete renderer;
+			renderer = NULL;
+		}
+	}
+	if (renderer == NULL)
+	{
+		renderer = new FixedFunctionRenderer();
+		renderer->initialize();
+	}
+	cout << "Renderer: " << renderer->name() << endl;
+
+	BuildCubeMesh(mesh);
+	renderer->uploadMesh(CUBE_MESH, mesh);
+	scene.setMeshBounds(CUBE_MESH, mesh);
+	UploadPrimitives(governor.settings());
+
+	renderer->defineMaterial(ROAD_MATERIAL, MakeMaterial(ROAD_COLOR, ROAD_SHININESS, true));
+	renderer->defineMaterial(RAIL_MATERIAL, MakeMaterial(RAIL_COLOR, RAIL_SHININESS, true));
+	renderer->defineMaterial(MARKER_MATERIAL, MakeMaterial(MARKER_COLOR, MARKER_SHININESS, true));
+	renderer->defineMaterial(GRASS_MATERIAL, MakeMaterial(GRASS_COLOR, GRASS_SHININESS, false));
+	renderer->defineMaterial(TREE_MATERIAL, MakeMaterial(TREE_COLOR, TREE_SHININESS, false));
+	renderer->defineMaterial(VEHICLE_MATERIAL, MakeMaterial(VEHICLE_COLOR, VEHICLE_SHININESS, false));
+	renderer->defineMaterial(TIRE_MATERIAL, MakeMaterial(TIRE_COLOR, TIRE_SHININESS, false));
+}
+
+// Tessellate the tree cones and vehicle spheres at a quality level's detail.
+void UploadPrimitives(const QualitySettings& quality)
+{
+	MeshData mesh;
+	BuildConeMesh(mesh, quality.coneSlices, 6);
+	renderer->uploadMesh(CONE_MESH, mesh);
+	scene.setMeshBounds(CONE_MESH, mesh);
+	BuildSphereMesh(mesh, quality.sphereSlices, quality.sphereSlices);
+	renderer->uploadMesh(SPHERE_MESH, mesh);
+	scene.setMeshBounds(SPHERE_MESH, mesh);
+}
+
+// The requested track tessellation, reduced at lower quality levels.
+int QualityTrackSamples()
+{
+	int samples = trackSamples >> governor.settings().trackSampleShift;
+	return samples < MIN_TRACK_SAMPLES ? MIN_TRACK_SAMPLES : samples;
+}
+
+// Bring the scene to the governor's current level. Render scale is read
+// by Display every frame.
+void ApplyQuality()
+{
+	TRACE_FUNCTION();
+	const QualitySettings& quality = governor.settings();
+	UploadPrimitives(quality);
+	terrain.setStreamRadius(quality.sceneryDistance);
+	if (activeTrack->samples != QualityTrackSamples())
+		RegenerateTrack();
 }
 
 // The main function sets up the data and the
 // environment to display the textured objects.
 void main(int argc, char **argv)
 {
+	// "-fixed" forces the legacy fixed-function renderer;
+	// "-track <file>" picks the track definition to load and watch;
+	// "-seed <n>" repeats a terrain (by default each run gets a new one);
+	// "-telemetry <file>" records every tick; "-telemetry-csv <in> <out>"
+	// converts a recording to CSV and exits; "-trace <file>" records
+	// timing zones from the start and writes them at exit;
+	// "-scene-cache <file>" moves the startup track cache;
+	// "-frame-budget <ms>" sets the frame time the quality governor holds;
+	// "-batch <jobs> <results>" simulates the listed track/scenario
+	// variants without a window and exits ("-threads <n>" limits the
+	// workers, by default one per core); "-alloc-test <frames>" drives for
+	// a warm-up and then that many frames, and exits with failure if any
+	// of them allocated; "-shm <name>" publishes the live vehicle and
+	// camera state in a shared-memory segment of that name, which
+	// "-shm-reader <name>" prints from another process until interrupted;
+	// "-shm-bench <readers>" times the segment under that many readers and
+	// exits; "-pack-check" packs the track, terrain and primitive meshes and
+	// random normals, prints the worst decode errors, and exits with failure
+	// if any is outside tolerance (debug builds also check every upload).
+	bool useShaders = true;
+	string batchJobs, batchResults;
+	int batchThreads = 0;
+	bool packCheck = false;
+	TraceThreadName("main");
+	governor.setBudget(DEFAULT_FRAME_BUDGET_MS);
+	terrainSeed = (unsigned)time(NULL);
+	for (int i = 1; i < argc; i++)
+		if (strcmp(argv[i], "-fixed") == 0)
+			useShaders = false;
+		else if (strcmp(argv[i], "-telemetry-csv") == 0 && i + 2 < argc)
+		{
+			string error;
+			if (!ConvertTelemetryToCsv(argv[i + 1], argv[i + 2], error))
+				cerr << error << endl;
+			return;
+		}
+		else if (strcmp(argv[i], "-shm-reader") == 0 && i + 1 < argc)
+		{
+			string error;
+			if (!RunSharedStateReader(argv[i + 1], error))
+				cerr << error << endl;
+			return;
+		}
+		else if (strcmp(argv[i], "-shm-bench") == 0 && i + 1 < argc)
+		{
+			string error;
+			if (!RunSharedStateBenchmark(atoi(argv[i + 1]), cout, error) && !error.empty())
+				cerr << error << endl;
+			return;
+		}
+		else if (strcmp(argv[i], "-shm") == 0 && i + 1 < argc)
+		{
+			string error;
+			if (!stateExport.start(argv[++i], error))
+				cerr << error << endl;
+		}
+		else if (strcmp(argv[i], "-telemetry") == 0 && i + 1 < argc)
+		{
+			if (!telemetry.start(argv[++i]))
+				cerr << "cannot record telemetry to " << argv[i] << endl;
+		}
+		else if (strcmp(argv[i], "-trace") == 0 && i + 1 < argc)
+		{
+			tracePath = argv[++i];
+			TraceSetEnabled(true);
+			atexit(WriteTrace);
+		}
+		else if (strcmp(argv[i], "-track") == 0 && i + 1 < argc)
+			trackPath = argv[++i];
+		else if (strcmp(argv[i], "-scene-cache") == 0 && i + 1 < argc)
+			sceneCachePath = argv[++i];
+		else if (strcmp(argv[i], "-frame-budget") == 0 && i + 1 < argc)
+			governor.setBudget(atof(argv[++i]));
+		else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc)
+			terrainSeed = (unsigned)strtoul(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "-batch") == 0 && i + 2 < argc)
+		{
+			batchJobs = argv[++i];
+			batchResults = argv[++i];
+		}
+		else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+			batchThreads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-pack-check") == 0)
+			packCheck = true;
+		else if (strcmp(argv[i], "-alloc-test") == 0 && i + 1 < argc)
+		{
+			allocMonitor.startTest(atoi(argv[++i]));
+			atexit(ReportAllocations);
+		}
+	if (packCheck)
+		exit(PackCheck() ? EXIT_SUCCESS : EXIT_FAILURE);
+	if (!batchJobs.empty())
+	{
+		string error;
+		if (!RunBatch(batchJobs, batchResults, trackSamples, batchThreads, BuiltinTrack, error))
+			cerr << error << endl;
+		return;
+	}
+
 	// Set up the display window.
 	glutInit(&argc, argv);
 	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH);
 	glutInitWindowPosition(INIT_WINDOW_POSITION[0], INIT_WINDOW_POSITION[1]);
 	glutInitWindowSize(currWindowSize[0], currWindowSize[1]);
-	glutCreateWindow("DRIVING IN CIRCLES (D=Driver's View; I=Infield View; O=Outfield View)");
+	glutCreateWindow("DRIVING IN CIRCLES (D=Driver's View; I=Infield View; O=Outfield View; C=Chase View; S=Split Screen)");
 
 	// Specify the resizing and refreshing routines.
 	glutReshapeFunc(ResizeWindow);
 	glutKeyboardFunc(KeyboardPress);
 	glutSpecialFunc(NonASCIIKeyboardPress);
 	glutDisplayFunc(Display);
-	glutTimerFunc(REFRESH_RATE, TimerFunction, 1);
+	glutIdleFunc(IdleFunction);
+	atexit(ReportLatency);
 
 	// Set up standard lighting, shading, and depth testing.
 	glEnable(GL_LIGHTING);
@@ -125,493 +603,465 @@ void main(int argc, char **argv)
 	glEnable(GL_ALPHA_TEST);
 
 	// Set up the scene.
-	InitializeScene();
+	glewExperimental = GL_TRUE;
+	bool glewReady = (glewInit() == GLEW_OK);
+	InitializeRenderer(useShaders && glewReady);
 	InitializeTrack();
+	InitializeScene();
+	InitializeTerrain();
+	RequestVisibility();
+	visibility.start();
 	// Set up all fonts, initializing to medium size.
 	SmallTextFont = FontCreate(wglGetCurrentDC(), "Arial", 10, 100, 1);
 	MediumTextFont = FontCreate(wglGetCurrentDC(), "Arial", 14, 600, 1);
 	LargeTextFont = FontCreate(wglGetCurrentDC(), "Arial", 20, 900, 1);
 	TextFont = MediumTextFont;
 
+	simulation.setTrackLength(activeTrack->arcLength.totalLength());
+	simulation.start(vehicle, &telemetry, &stateExport);
+	atexit(StopSimulation);
 	glutMainLoop();
 }
 
 // Function to react to user-presed keyboard
-// keys by changing the camera perspective.
+// keys by changing the camera perspective. These keys only change what
+// the render thread draws, so they take effect at once.
 void KeyboardPress(unsigned char pressedKey, int mouseXPosition, int mouseYPosition)
 {
+	InputEvent event = { ASCII_KEY, pressedKey, InputClock() };
+	latencyProbe.applied(event);
+	glutPostRedisplay();
 	switch (pressedKey)
 	{
 	case 'D': case 'd': { cameraViewpoint = DRIVER;   break; }
 	case 'I': case 'i': { cameraViewpoint = INFIELD;  break; }
 	case 'O': case 'o': { cameraViewpoint = OUTFIELD;MULT = -MULT; break; }
-	}
-}
-
-// Function to react to user-pressed non-ASCII keyboard keys by
-// accelerating/decelerating the vehicle or by changing lanes.
-void NonASCIIKeyboardPress(int pressedKey, int mouseXPosition, int mouseYPosition)
-{
-	switch (pressedKey)
-	{
-		// Up arrow: Accelerate viewer if possible.
-	case GLUT_KEY_UP: {
-		time_increment_hour *= USER_ANGLE_ACCELERATION_FACTOR;
-		if (time_increment_hour > MAX_USER_ANGLE_INCREMENT)
-			time_increment_hour = MAX_USER_ANGLE_INCREMENT;
+	case 'C': case 'c': { cameraViewpoint = CHASE;    break; }
+	case 'S': case 's': { splitScreen = !splitScreen; break; }
+	case 'P': case 'p': { latencyProbe.report(cout); ReportThreads(); break; }
+	case 'A': case 'a': { ReportAllocations(); break; }
+	case 'R': case 'r': { renderer->report(cout); break; }
+
+	// T starts tracing, or writes what has been recorded so far.
+	case 'T': case 't': {
+		if (TraceEnabled())
+			WriteTrace();
+		else
+			TraceSetEnabled(true);
 		break;
 	}
-					  // Down arrow: Decelerate viewer if possible.
-	case GLUT_KEY_DOWN: {
-		time_increment_hour /= USER_ANGLE_ACCELERATION_FACTOR;
-		if (time_increment_hour < MIN_USER_ANGLE_INCREMENT)
-			time_increment_hour = MIN_USER_ANGLE_INCREMENT;
+
+	// Edit a spline track: E toggles editing, [ and ] pick a control
+	// point, H/L and J/K nudge it along x and z.
+	case 'E': case 'e': { editingTrack = !editingTrack && activeTrack->track->controlPointCount() > 0; break; }
+	case '[': case ']': {
+		int count = activeTrack->track->controlPointCount();
+		if (editingTrack && count > 0)
+			selectedControlPoint = (selectedControlPoint + (pressedKey == ']' ? 1 : count - 1)) % count;
 		break;
 	}
-						// Left arrow: Switch user to left lane.
-	case GLUT_KEY_LEFT: {
-		movingLeft = true;
-		movingRight = false;
-		sideOfRoad = TRANSITION;
+	case 'H': case 'h': { NudgeControlPoint(-TRACK_EDIT_STEP, 0.0f); break; }
+	case 'L': case 'l': { NudgeControlPoint(TRACK_EDIT_STEP, 0.0f);  break; }
+	case 'J': case 'j': { NudgeControlPoint(0.0f, -TRACK_EDIT_STEP); break; }
+	case 'K': case 'k': { NudgeControlPoint(0.0f, TRACK_EDIT_STEP);  break; }
+
+	// Change the track tessellation at runtime.
+	case '+': case '=': {
+		if (trackSamples < MAX_TRACK_SAMPLES)
+		{
+			trackSamples *= 2;
+			RegenerateTrack();
+		}
 		break;
 	}
-						// Right arrow: Switch user to right lane.
-	case GLUT_KEY_RIGHT: {
-		movingLeft = false;
-		movingRight = true;
-		sideOfRoad = TRANSITION;
+	case '-': case '_': {
+		if (trackSamples > MIN_TRACK_SAMPLES)
+		{
+			trackSamples /= 2;
+			RegenerateTrack();
+		}
 		break;
 	}
 	}
 }
 
-// Function to update the vehicle position around the track,
-// and, if appropriate, the lane position of the vehicle.
-void TimerFunction(int value)
+// Function to react to user-pressed non-ASCII keyboard keys by
+// accelerating/decelerating the vehicle or by changing lanes. The command
+// is queued, timestamped, and the simulation thread applies it in the
+// sub-step where it happened.
+void NonASCIIKeyboardPress(int pressedKey, int mouseXPosition, int mouseYPosition)
 {
-	time_hour += time_increment_hour;
-	if (movingRight)
-	{
-		laneOffset += LANE_CHANGE_INCREMENT;
-		if (laneOffset >= RIGHT_LANE_OFFSET)
-		{
-			laneOffset = RIGHT_LANE_OFFSET;
-			movingRight = false;
-			sideOfRoad = RHS;
-		}
-	}
-	else if (movingLeft)
+	switch (pressedKey)
 	{
-		laneOffset -= LANE_CHANGE_INCREMENT;
-		if (laneOffset <= LEFT_LANE_OFFSET)
-		{
-			laneOffset = LEFT_LANE_OFFSET;
-			movingLeft = false;
-			sideOfRoad = LHS;
-		}
+		// Up/down arrows: accelerate/decelerate within the limits.
+	case GLUT_KEY_UP:    { simulation.command(ACCELERATE); break; }
+	case GLUT_KEY_DOWN:  { simulation.command(DECELERATE); break; }
+		// Left/right arrows: switch to that lane.
+	case GLUT_KEY_LEFT:  { simulation.command(MOVE_LEFT);  break; }
+	case GLUT_KEY_RIGHT: { simulation.command(MOVE_RIGHT); break; }
 	}
-	glutPostRedisplay();
-	glutTimerFunc(100, TimerFunction, 1);
+}
+
+void ReportLatency()
+{
+	if (latencyProbe.count() > 0)
+		latencyProbe.report(cout);
+}
+
+// Loop timing of both threads.
+void ReportThreads()
+{
+	simulation.timing().report("Simulation", cout);
+	cout << "  dropped sub-steps: " << simulation.droppedSubsteps() << endl;
+	renderTiming.report("Render", cout);
+}
+
+// Redraw when the simulation has published a snapshot the render thread
+// has not drawn; otherwise wait a little rather than spin.
+void IdleFunction()
+{
+	if (simulation.fresh())
+		glutPostRedisplay();
+	else
+		std::this_thread::sleep_for(std::chrono::milliseconds(RENDER_IDLE_MS));
 }
 
 // Initialize the user's position to be along
 // the circular track, looking slightly ahead.
 void InitializeScene()
 {
-	InitializeTrees();
-	time_hour = INITIAL_USER_ANGLE;
-	time_increment_hour = INITIAL_USER_ANGLE_INCREMENT;
+	TRACE_FUNCTION();
+	ResetVehicle(vehicle);
 	lookAtAngleDelta = INITIAL_LOOK_AT_ANGLE_DELTA;
-	distanceTraveled = INITIAL_DISTANCE_TRAVELED;
-	laneOffset = INITIAL_LANE_OFFSET;
-	sideOfRoad = INITIAL_SIDE_OF_ROAD;
 	cameraViewpoint = INITIAL_CAMERA_VIEWPOINT;
 }
 
-// Set up the conical trees to be randomly positioned in the non-track
-// portions of the scene, and so they're not excessively short or tall.
-void InitializeTrees()
+// Start the terrain workers, leaving a core for the render thread.
+void InitializeTerrain()
 {
-	GLfloat angle, centerDistance;
-	int i;
-
-	for (i = 0; i < NUMBER_TREES; i++)
-	{
-		treeBaseRadius[i] = GenerateRandomNumber(MINIMUM_TREE_BASE_RADIUS, MAXIMUM_TREE_BASE_RADIUS);
-		angle = i * 4 * PI / NUMBER_TREES;
-
-		// First half of trees are inside circular track; second half are outside.
-		// In neither case is the tree allowed to overlap the circular road itself.
-		if (i <= NUMBER_TREES / 2)
-			centerDistance = GenerateRandomNumber(MINIMUM_TREE_CENTER_DISTANCE,
-				ROAD_RADIUS - 0.5f * ROAD_WIDTH - 2 * treeBaseRadius[i]);
-		else
-			centerDistance = GenerateRandomNumber(ROAD_RADIUS + 0.5f * ROAD_WIDTH + 2 * treeBaseRadius[i],
-				MAXIMUM_TREE_CENTER_DISTANCE);
-
-		treePosition[i][0] = centerDistance * cos(angle);
-		treePosition[i][1] = GROUND_BOTTOM;
-		treePosition[i][2] = centerDistance * sin(angle);
-
-		treeHeight[i] = GenerateRandomNumber(MINIMUM_TREE_HEIGHT_TO_RADIUS_RATIO * treeBaseRadius[i],
-			MAXIMUM_TREE_HEIGHT_TO_RADIUS_RATIO * treeBaseRadius[i]);
-		if (treeHeight[i] > MAX_TREE_HEIGHT)
-			treeHeight[i] = MAX_TREE_HEIGHT;
-
-		// Redo tree i if it overlaps any of the previous trees.
-		if (TreeCollision(i))
-			i--;
-	}
+	TRACE_FUNCTION();
+	int threads = (int)std::thread::hardware_concurrency() - 1;
+	if (threads < 1)
+		threads = 1;
+	if (threads > 4)
+		threads = 4;
+	terrain.start(terrainSeed, threads);
+	cout << "Terrain seed: " << terrainSeed << " (" << threads << " workers)" << endl;
 }
 
-// Determine whether the new tree (at index) overlaps any of the previous trees.
-bool TreeCollision(int index)
+// Set up the properties of a viewing camera.
+Camera MakeCamera(VIEW viewpoint, const GLfloat vehiclePosition[3], const GLfloat driverLookAtPosition[3],
+	const GLfloat chasePosition[3])
 {
-	int i;
-	for (i = 0; i < index; i++)
-		if (pow(treePosition[i][0] - treePosition[index][0], 2) + pow(treePosition[i][2] - treePosition[index][2], 2)
-			<= pow(treeBaseRadius[i] + treeBaseRadius[index], 2))
-			return true;
-	return false;
+	Camera camera = { { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f },
+		VIEWING_ANGLE, ASPECT_RATIO, NEAR_PLANE, FAR_PLANE };
+	switch (viewpoint)
+	{
+	case DRIVER: {
+		for (int i = 0; i < 3; i++)
+		{
+			camera.eye[i] = vehiclePosition[i];
+			camera.center[i] = driverLookAtPosition[i];
+			camera.up[i] = VEHICLE_UP_VECTOR[i];
+		}
+		break;
+	}
+	case INFIELD: {
+		for (int i = 0; i < 3; i++)
+		{
+			camera.eye[i] = INFIELD_CAMERA_POSITION[i];
+			camera.center[i] = vehiclePosition[i];
+			camera.up[i] = INFIELD_CAMERA_UP_VECTOR[i];
+		}
+		break;
+	}
+	case OUTFIELD: {
+		for (int i = 0; i < 3; i++)
+		{
+			camera.eye[i] = OUTFIELD_CAMERA_POSITION[i];
+			camera.center[i] = TRACK_CENTER[i];
+			camera.up[i] = OUTFIELD_CAMERA_UP_VECTOR[i];
+		}
+		camera.eye[1] *= MULT;
+		break;
+	}
+	case CHASE: {
+		for (int i = 0; i < 3; i++)
+		{
+			camera.eye[i] = chasePosition[i];
+			camera.center[i] = vehiclePosition[i];
+			camera.up[i] = VEHICLE_UP_VECTOR[i];
+		}
+		break;
+	}
+	}
+	return camera;
 }
 
 // Principal display routine: sets up material, lighting, and camera 
 // properties, clears the frame buffer, and renders all objects.
 void Display()
 {
-	GLfloat vehiclePosition[] = { (laneOffset + ROAD_RADIUS) * sin(time_hour),
-		DRIVER_LEVEL, (laneOffset + ROAD_RADIUS) * cos(time_hour) };
-	GLfloat driverLookAtPosition[] = { (laneOffset + ROAD_RADIUS) * sin(time_hour + lookAtAngleDelta),
-		DRIVER_LOOK_LEVEL, (laneOffset + ROAD_RADIUS) * cos(time_hour + lookAtAngleDelta) };
-
-	// Set up the properties of the light source.
-	glLightfv(GL_LIGHT0, GL_DIFFUSE, LIGHT_INTENSITY);
-	glLightfv(GL_LIGHT0, GL_POSITION, LIGHT_POSITION);
+	TRACE_FUNCTION();
+	ALLOC_SCOPE(ALLOC_RENDER);
+	renderTiming.begin();
+	frameTimer.begin();
+	GLfloat vehiclePosition[3], driverLookAtPosition[3], chasePosition[3], forward[3];
+	GLint area[4];
+
+	// Draw the latest complete snapshot, and time the commands it shows.
+	simulation.acquire();
+	const SimulationSnapshot& snapshot = simulation.latest();
+	vehicle = snapshot.vehicle;
+	InputEvent event;
+	while (simulation.takeApplied(snapshot.time, event))
+		latencyProbe.applied(event);
+
+	SwapInPendingTrack();
+	ApplyTrackEdits();
+	simulation.setTrackLength(activeTrack->arcLength.totalLength());
+	if (visibility.editsSettled())
+		visibility.requestUpdate(MakeVisibilityInput());
+	if (visibility.update())
+		visibility.current()->report(cout);
+	activeTrack->lanePoint(LapDistance(vehicle.lapAngle), vehicle.laneOffset, DRIVER_LEVEL, vehiclePosition, forward);
+	activeTrack->lanePoint(LapDistance(vehicle.lapAngle + lookAtAngleDelta), vehicle.laneOffset, DRIVER_LOOK_LEVEL,
+		driverLookAtPosition, forward);
+	activeTrack->lanePoint(LapDistance(vehicle.lapAngle) - CHASE_DISTANCE, vehicle.laneOffset, CHASE_LEVEL, chasePosition, forward);
 
 	// Limit the animation to the portion of the window above the "control panel".
 	if (ASPECT_RATIO > currWindowSize[0] / currWindowSize[1])
 	{
-		glViewport(0, int(0.5f * (currWindowSize[1] - currViewportSize[1]) + currViewportSize[1] * PANEL_TO_WINDOW_HEIGHT_RATIO),
-			currViewportSize[0], currViewportSize[1]);
-		glScissor(0, int(0.5f * (currWindowSize[1] - currViewportSize[1]) + currViewportSize[1] * PANEL_TO_WINDOW_HEIGHT_RATIO),
-			currViewportSize[0], currViewportSize[1]);
+		area[0] = 0;
+		area[1] = int(0.5f * (currWindowSize[1] - currViewportSize[1]) + currViewportSize[1] * PANEL_TO_WINDOW_HEIGHT_RATIO);
 	}
 	else
 	{
-		glViewport(int(0.5f * (currWindowSize[0] - currViewportSize[0])), int(currViewportSize[1] * PANEL_TO_WINDOW_HEIGHT_RATIO),
-			currViewportSize[0], currViewportSize[1]);
-		glScissor(int(0.5f * (currWindowSize[0] - currViewportSize[0])), int(currViewportSize[1] * PANEL_TO_WINDOW_HEIGHT_RATIO),
-			currViewportSize[0], currViewportSize[1]);
+		area[0] = int(0.5f * (currWindowSize[0] - currViewportSize[0]));
+		area[1] = int(currViewportSize[1] * PANEL_TO_WINDOW_HEIGHT_RATIO);
+	}
+	area[2] = currViewportSize[0];
+	area[3] = currViewportSize[1];
+
+	// One view fills the area; split screen shows all four, driver and
+	// chase on top. Each sub-view keeps the aspect ratio of the whole.
+	viewSet.clear();
+	unsigned driverViews = 0;
+	const Camera selected = MakeCamera(cameraViewpoint, vehiclePosition, driverLookAtPosition, chasePosition);
+	if (splitScreen)
+	{
+		const VIEW layout[4] = { INFIELD, OUTFIELD, DRIVER, CHASE };
+		GLsizei w = area[2] / 2, h = area[3] / 2;
+		for (int i = 0; i < 4; i++)
+		{
+			int v = viewSet.add(MakeCamera(layout[i], vehiclePosition, driverLookAtPosition, chasePosition),
+				area[0] + (i % 2) * w, area[1] + (i / 2) * h, w, h);
+			if (v >= 0 && layout[i] == DRIVER)
+				driverViews |= 1u << v;
+		}
+	}
+	else
+	{
+		int v = viewSet.add(selected, area[0], area[1], area[2], area[3]);
+		if (v >= 0 && cameraViewpoint == DRIVER)
+			driverViews |= 1u << v;
 	}
-	glEnable(GL_SCISSOR_TEST);
-
-	// Set up the properties of the viewing camera.
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-	gluPerspective(VIEWING_ANGLE, ASPECT_RATIO, NEAR_PLANE, FAR_PLANE);
-
-	glDisable(GL_SCISSOR_TEST);
-
-	// Position the camera and draw the 3D scene.
-	glMatrixMode(GL_MODELVIEW);
-	glLoadIdentity();
-	glPushMatrix();
 
-	switch (cameraViewpoint)
+	// Export the selected camera, even when split screen shows all four.
+	if (stateExport.active())
 	{
-	case DRIVER: {
-		gluLookAt(vehiclePosition[0], vehiclePosition[1], vehiclePosition[2],
-			driverLookAtPosition[0], driverLookAtPosition[1], driverLookAtPosition[2],
-			VEHICLE_UP_VECTOR[0], VEHICLE_UP_VECTOR[1], VEHICLE_UP_VECTOR[2]);
-		break;
+		SharedCameraState exported;
+		exported.frame = renderedFrames;
+		exported.viewpoint = (int32_t)cameraViewpoint;
+		exported.splitScreen = splitScreen ? 1 : 0;
+		for (int i = 0; i < 3; i++)
+		{
+			exported.eye[i] = selected.eye[i];
+			exported.center[i] = selected.center[i];
+		}
+		exported.padding[0] = exported.padding[1] = 0;
+		stateExport.publishCamera(exported);
 	}
-	case INFIELD: {
-		gluLookAt(INFIELD_CAMERA_POSITION[0], INFIELD_CAMERA_POSITION[1], INFIELD_CAMERA_POSITION[2],
-			vehiclePosition[0], vehiclePosition[1], vehiclePosition[2],
-			INFIELD_CAMERA_UP_VECTOR[0], INFIELD_CAMERA_UP_VECTOR[1], INFIELD_CAMERA_UP_VECTOR[2]);
-		break;
+	renderedFrames++;
+
+	// Build the scene once and cull it for every view in one pass.
+	// Stream terrain around every camera and what it looks at, and take in
+	// a few finished chunks.
+	terrainFoci.clear();
+	for (int v = 0; v < (int)viewSet.views.size(); v++)
+	{
+		const Camera& camera = viewSet.views[v].camera;
+		terrainFoci.insert(terrainFoci.end(), camera.eye, camera.eye + 3);
+		terrainFoci.insert(terrainFoci.end(), camera.center, camera.center + 3);
 	}
-	case OUTFIELD: {
-		gluLookAt(OUTFIELD_CAMERA_POSITION[0], MULT*OUTFIELD_CAMERA_POSITION[1], OUTFIELD_CAMERA_POSITION[2],
-			TRACK_CENTER[0], TRACK_CENTER[1], TRACK_CENTER[2],
-			OUTFIELD_CAMERA_UP_VECTOR[0], OUTFIELD_CAMERA_UP_VECTOR[1], OUTFIELD_CAMERA_UP_VECTOR[2]);
-		break;
+	terrain.update(terrainFoci);
+	terrain.uploadFinished(renderer, scene, *activeTrack);
+
+	// The driver's view on its own draws only the scenery potentially
+	// visible from the vehicle's section of track.
+	const PotentiallyVisibleSets* pvs = (!splitScreen && cameraViewpoint == DRIVER) ? visibility.current() : NULL;
+	const int section = pvs != NULL ? pvs->section(LapDistance(vehicle.lapAngle)) : 0;
+	if (pvs != NULL && !pvs->sectionValid(section))
+		pvs = NULL;
+	scene.clear();
+	if (pvs != NULL)
+	{
+		terrain.queueGround(scene, [pvs, section](int cx, int cz) { return pvs->groundVisible(section, cx, cz); });
+		QueueTrack(pvs, section);
+		terrain.queueTrees(scene, [pvs, section](int cx, int cz) { return pvs->treesVisible(section, cx, cz); });
 	}
+	else
+	{
+		terrain.queueGround(scene);
+		QueueTrack(NULL, 0);
+		terrain.queueTrees(scene);
 	}
+	QueueVehicle(ALL_VIEWS & ~driverViews);
+	viewSet.cull(scene);
 
-	// Draw the track and its surroundings.
+	// Draw the track and its surroundings into each view, offscreen at a
+	// reduced resolution when the quality level asks for it.
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	//DrawGround();
-	DrawTrack();
-	//DrawTrees();
-	if (cameraViewpoint != DRIVER)
-		DrawVehicle();
-
-	glPopMatrix();
+	const GLfloat renderScale = governor.settings().renderScale;
+	const bool offscreen = renderScale < 1.0f
+		&& sceneTarget.resize(GLsizei(area[2] * renderScale), GLsizei(area[3] * renderScale));
+	if (offscreen)
+	{
+		sceneTarget.bind();
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	}
+	for (int v = 0; v < (int)viewSet.views.size(); v++)
+	{
+		TRACE_SCOPE("draw view");
+		const View& view = viewSet.views[v];
+		if (offscreen)
+		{
+			GLint x0 = GLint((view.viewport[0] - area[0]) * renderScale);
+			GLint y0 = GLint((view.viewport[1] - area[1]) * renderScale);
+			GLint x1 = GLint((view.viewport[0] + view.viewport[2] - area[0]) * renderScale);
+			GLint y1 = GLint((view.viewport[1] + view.viewport[3] - area[1]) * renderScale);
+			glViewport(x0, y0, x1 - x0, y1 - y0);
+		}
+		else
+			glViewport(view.viewport[0], view.viewport[1], view.viewport[2], view.viewport[3]);
+		renderer->beginFrame(view.camera);
+		viewSet.draw(renderer, scene, v);
+		renderer->endFrame();
+	}
+	if (offscreen)
+		sceneTarget.resolve(area[0], area[1], area[2], area[3]);
+	// Every stream upload for this frame has been issued.
+	renderer->finishFrame();
 
 	// Expand the viewport so the display panel can be drawn.
-	glDisable(GL_LIGHTING);
 	glViewport(0, 0, currWindowSize[0], currWindowSize[1]);
 	DrawDisplayPanel();
 
 	// Exchange old and new display buffers (i.e., animate).
-	glutSwapBuffers();
-	glFlush();
-}
-// Draw the track, the guardrails, and the lap marker.
-void DrawTrack()
-{
-	int i;
-	GLfloat roadMatAmbient[4], roadMatDiffuse[4], roadMatSpecular[4], roadMatEmission[4];
-	GLfloat roadMatShininess[] = { ROAD_SHININESS };
-	GLfloat railMatAmbient[4], railMatDiffuse[4], railMatSpecular[4], railMatEmission[4];
-	GLfloat railMatShininess[] = { RAIL_SHININESS };
-	GLfloat markerMatAmbient[4], markerMatDiffuse[4], markerMatSpecular[4], markerMatEmission[4];
-	GLfloat markerMatShininess[] = { MARKER_SHININESS };
-	GLUquadricObj *qObj;
-	qObj = gluNewQuadric();
-	
-	
-	//track generation
-	/*glBegin(GL_TRIANGLE_STRIP);
-	GLfloatPoint point;
-	GLfloat dt = track->length() / NUM_VERTICIES;
-	int state = 0;
-	int QUARTER = NUM_VERTICIES / 4;
-	int HALF = NUM_VERTICIES / 2;
-	int THREE_QUARTER = 3 * QUARTER;
-	//the +1 completes the shape
-	glColor3f(1.0, 0.0, 0.0);
-	for (int i = 0; i <= HALF+1;i++) {
-		point = verticies[(i+THREE_QUARTER)%NUM_VERTICIES];
-		glVertex3f(point.x, point.y, point.z);
-	}
-	glEnd();
-	glBegin(GL_TRIANGLE_STRIP);
-	glColor3f(0.0,1.0, 0.0);
-	for (int i = 0; i <=HALF+1;i++) {
-		point = verticies[(i+QUARTER)%NUM_VERTICIES];
-		glVertex3f(point.x, point.y, point.z);
-	}
-	glEnd();
-	
-	*/
-	glBegin(GL_TRIANGLE_STRIP);
-	glColor3f(1.0, 0, 0);
-	
-	glNormal3f(0, 1, 0);
-	GLfloatPoint point;
-	for (int i = 2;i < NUM_VERTICIES;i++) {
-		point = verticies[i];
-		glVertex3f(ptC->x, ptC->y, ptC->z);
-	}
-	glEnd();
-	gluQuadricDrawStyle(qObj, GLU_FILL);
-	glColor3f(1.0, 1.0, 1.0);
-	
-	//glDisable(GL_NORMALIZE);
-	
-	
-	
-	// Set up the material properties of the objects.
-	for (i = 0; i < 4; i++)
+	frameTimer.end();
 	{
-		roadMatAmbient[i] = roadMatDiffuse[i] = roadMatSpecular[i] = roadMatEmission[i] = ROAD_COLOR[i];
-		railMatAmbient[i] = railMatDiffuse[i] = railMatSpecular[i] = railMatEmission[i] = RAIL_COLOR[i];
-		markerMatAmbient[i] = markerMatDiffuse[i] = markerMatSpecular[i] = markerMatEmission[i] = MARKER_COLOR[i];
+		TRACE_SCOPE("swap buffers");
+		glutSwapBuffers();
+		glFlush();
+		latencyProbe.presented(InputClock());
 	}
 
-	glEnable(GL_LIGHTING);
-	glEnable(GL_LIGHT0);
-
-	// Render the road.
-	glPushMatrix();
-	glTranslatef(0.0f, ROAD_BOTTOM, 0.0f);
-	glRotatef(-90.0f, 1.0f, 0.0f, 0.0f);
-	glMaterialfv(GL_FRONT, GL_AMBIENT, roadMatAmbient);
-	glMaterialfv(GL_FRONT, GL_DIFFUSE, roadMatDiffuse);
-	glMaterialfv(GL_FRONT, GL_SPECULAR, roadMatSpecular);
-	glMaterialfv(GL_FRONT, GL_EMISSION, roadMatEmission);
-	glMaterialfv(GL_FRONT, GL_SHININESS, roadMatShininess);
-	
-	
-	glPopMatrix();
-
-	// Render the guardrails.
-	for (int i = 0; i < NBR_ROAD_INTERVALS; i++)
-	{
-		glPushMatrix();
-		glRotatef(360.0f * i / NBR_ROAD_INTERVALS, 0.0f, 1.0f, 0.0f);
-		glTranslatef(ROAD_RADIUS, 0.0f, 0.0f);
-
-		glPushMatrix();
-		glMaterialfv(GL_FRONT, GL_AMBIENT, railMatAmbient);
-		glMaterialfv(GL_FRONT, GL_DIFFUSE, railMatDiffuse);
-		glMaterialfv(GL_FRONT, GL_SPECULAR, railMatSpecular);
-		glMaterialfv(GL_FRONT, GL_EMISSION, railMatEmission);
-		glMaterialfv(GL_FRONT, GL_SHININESS, railMatShininess);
-		glTranslatef(ROAD_WIDTH / 2 + ROADSIDE_MARGIN, 0.0f, 0.0f);
-		glScalef(GUARDRAIL_SCALE_FACTOR[0], GUARDRAIL_SCALE_FACTOR[1], GUARDRAIL_SCALE_FACTOR[2]);
-		glutSolidCube(1.0f);
-		glPopMatrix();
-
-		// Draw the lap marker.
-		if (i == 0)
-		{
-			glPushMatrix();
-			glMaterialfv(GL_FRONT, GL_AMBIENT, markerMatAmbient);
-			glMaterialfv(GL_FRONT, GL_DIFFUSE, markerMatDiffuse);
-			glMaterialfv(GL_FRONT, GL_SPECULAR, markerMatSpecular);
-			glMaterialfv(GL_FRONT, GL_EMISSION, markerMatEmission);
-			glMaterialfv(GL_FRONT, GL_SHININESS, markerMatShininess);
-			glTranslatef(-ROAD_WIDTH / 2 - ROADSIDE_MARGIN, 0.0f, 0.0f);
-			glScalef(LAP_MARKER_SCALE_FACTOR[0], LAP_MARKER_SCALE_FACTOR[1], LAP_MARKER_SCALE_FACTOR[2]);
-			glutSolidCube(1.0f);
-			glPopMatrix();
-		}
-		glPopMatrix();
+	// Frames finished on the GPU since the last one may change the level;
+	// the new level applies from the next frame.
+	double frameMs;
+	while (frameTimer.collect(frameMs))
+	{
+		int previous = governor.level();
+		if (!governor.frameFinished(frameMs))
+			continue;
+		cout << "Quality: " << QUALITY_LEVELS[previous].name << " -> " << governor.settings().name
+			<< " (" << governor.reason() << ")" << endl;
+		ApplyQuality();
 	}
-	
-	glDisable(GL_LIGHT0);
-	glDisable(GL_LIGHTING);
 
+	renderTiming.end();
 
+	// Everything the render thread allocated since the last frame ended,
+	// including key handling between frames, counts against this frame.
+	if (allocMonitor.frameFinished())
+		exit(allocMonitor.testPassed() ? EXIT_SUCCESS : EXIT_FAILURE);
 }
-
-// Draw the grassy area beneath the track and the trees.
-void DrawGround()
+// Queue the track, the guardrails (only the runs in the section's
+// potentially visible set, if given), and the lap marker.
+void QueueTrack(const PotentiallyVisibleSets* pvs, int section)
 {
-	int i;
-	GLfloat groundMatAmbient[4], groundMatDiffuse[4], groundMatSpecular[4];
-	GLfloat groundMatEmission[] = { 0.0f, 0.0f, 0.0f, 0.0f };
-	GLfloat groundMatShininess[] = { GRASS_SHININESS };
-	GLUquadricObj *qObj;
-	qObj = gluNewQuadric();
-	gluQuadricDrawStyle(qObj, GLU_FILL);
-
-	for (i = 0; i < 4; i++)
-		groundMatAmbient[i] = groundMatDiffuse[i] = groundMatSpecular[i] = GRASS_COLOR[i];
-
-	glEnable(GL_LIGHTING);
-	glEnable(GL_LIGHT0);
-
-	glPushMatrix();
-	glTranslatef(0.0f, GROUND_BOTTOM, 0.0f);
-	glRotatef(-90.0f, 1.0f, 0.0f, 0.0f);
-	glMaterialfv(GL_FRONT, GL_AMBIENT, groundMatAmbient);
-	glMaterialfv(GL_FRONT, GL_DIFFUSE, groundMatDiffuse);
-	glMaterialfv(GL_FRONT, GL_SPECULAR, groundMatSpecular);
-	glMaterialfv(GL_FRONT, GL_EMISSION, groundMatEmission);
-	glMaterialfv(GL_FRONT, GL_SHININESS, groundMatShininess);
-	gluDisk(qObj, 0.0f, GROUND_RADIUS, 16, 16);
-	glPopMatrix();
-	
-	glDisable(GL_LIGHT0);
-	glDisable(GL_LIGHTING);
-}
+	TRACE_FUNCTION();
+	GLfloat model[16];
 
-// Draw the trees that are inside and outside of the circular track.
-void DrawTrees()
-{
-	int i;
-	GLfloat treeMatAmbient[4], treeMatDiffuse[4], treeMatSpecular[4];
-	GLfloat treeMatEmission[] = { 0.0f, 0.0f, 0.0f, 0.0f };
-	GLfloat treeMatShininess[] = { TREE_SHININESS };
-	GLUquadricObj *qObj;
-	qObj = gluNewQuadric();
-	gluQuadricDrawStyle(qObj, GLU_FILL);
+	// The road.
+	MatrixIdentity(model);
+	MatrixTranslate(model, 0.0f, ROAD_BOTTOM, 0.0f);
+	scene.add(TRACK_MESH, ROAD_MATERIAL, model);
 
-	for (i = 0; i < 4; i++)
-		treeMatAmbient[i] = treeMatDiffuse[i] = treeMatSpecular[i] = TREE_COLOR[i];
+	// The guardrails.
+	const int posts = (int)activeTrack->railInstances.size();
+	for (int first = 0; first < posts; first += PVS_RAIL_BATCH)
+	{
+		if (pvs != NULL && !pvs->railBatchVisible(section, first / PVS_RAIL_BATCH))
+			continue;
+		for (int i = first; i < posts && i < first + PVS_RAIL_BATCH; i++)
+			scene.add(CUBE_MESH, RAIL_MATERIAL, activeTrack->railInstances[i].model);
+	}
 
-	glEnable(GL_LIGHTING);
-	glEnable(GL_LIGHT0);
+	// The lap marker.
+	scene.add(CUBE_MESH, MARKER_MATERIAL, activeTrack->lapMarkerInstance.model);
 
-	glPushMatrix();
-	glMaterialfv(GL_FRONT, GL_AMBIENT, treeMatAmbient);
-	glMaterialfv(GL_FRONT, GL_DIFFUSE, treeMatDiffuse);
-	glMaterialfv(GL_FRONT, GL_SPECULAR, treeMatSpecular);
-	glMaterialfv(GL_FRONT, GL_EMISSION, treeMatEmission);
-	glMaterialfv(GL_FRONT, GL_SHININESS, treeMatShininess);
-	for (i = 0; i < NUMBER_TREES; i++)
+	// Mark the control point being edited.
+	if (editingTrack)
 	{
-		glPushMatrix();
-		glTranslatef(treePosition[i][0], treePosition[i][1], treePosition[i][2]);
-		glRotatef(-90.0f, 1.0f, 0.0f, 0.0f);
-		gluCylinder(qObj, treeBaseRadius[i], 0.0f, treeHeight[i], 36, 6);
-		glPopMatrix();
+		const Track* track = activeTrack->track;
+		GLfloatPoint point = track->controlPoint(selectedControlPoint);
+		double_t scale = track->worldScale();
+		MatrixIdentity(model);
+		MatrixTranslate(model, GLfloat(scale*point.x), GLfloat(scale*point.y), GLfloat(scale*point.z));
+		MatrixScale(model, LAP_MARKER_SCALE_FACTOR[0], LAP_MARKER_SCALE_FACTOR[1], LAP_MARKER_SCALE_FACTOR[0]);
+		scene.add(CUBE_MESH, MARKER_MATERIAL, model);
 	}
-	glPopMatrix();
-
-	glDisable(GL_LIGHT0);
-	glDisable(GL_LIGHTING);
 }
 
-// Draw the "vehicle" as a scaled sphere with flattened spherical tires.
-void DrawVehicle()
+// Queue the "vehicle" as a scaled sphere with flattened spherical tires,
+// for the views in the mask.
+void QueueVehicle(unsigned views)
 {
+	TRACE_FUNCTION();
+	GLfloat body[16], model[16], tire[16], position[3], forward[3];
 	int i;
-	GLfloat vehicleMatAmbient[4], vehicleMatDiffuse[4], vehicleMatSpecular[4];
-	GLfloat vehicleMatEmission[] = { 0.0f, 0.0f, 0.0f, 0.0f };
-	GLfloat vehicleMatShininess[] = { VEHICLE_SHININESS };
-	GLfloat tireMatAmbient[4], tireMatDiffuse[4], tireMatSpecular[4];
-	GLfloat tireMatEmission[] = { 0.0f, 0.0f, 0.0f, 0.0f };
-	GLfloat tireMatShininess[] = { TIRE_SHININESS };
-	GLUquadricObj *qObj;
-	qObj = gluNewQuadric();
-	gluQuadricDrawStyle(qObj, GLU_FILL);
 
-	for (i = 0; i < 4; i++)
-	{
-		vehicleMatAmbient[i] = vehicleMatDiffuse[i] = vehicleMatSpecular[i] = VEHICLE_COLOR[i];
-		tireMatAmbient[i] = tireMatDiffuse[i] = tireMatSpecular[i] = TIRE_COLOR[i];
-	}
+	// The vehicle's x axis points along the track.
+	activeTrack->lanePoint(LapDistance(vehicle.lapAngle), vehicle.laneOffset, VEHICLE_ELEVATION, position, forward);
+	MatrixFromFrame(body, position, forward);
 
-	glEnable(GL_LIGHTING);
-	glEnable(GL_LIGHT0);
+	for (i = 0; i < 16; i++)
+		model[i] = body[i];
+	MatrixScale(model, VEHICLE_SCALE_FACTOR[0], VEHICLE_SCALE_FACTOR[1], VEHICLE_SCALE_FACTOR[2]);
+	scene.add(SPHERE_MESH, VEHICLE_MATERIAL, model, views);
 
-	glPushMatrix();
-	glRotatef(time_hour * DEGREES_PER_RADIAN, 0.0f, 1.0f, 0.0f);
-	glTranslatef(0.0, VEHICLE_ELEVATION, laneOffset + ROAD_RADIUS);
-	glPushMatrix();
-	glMaterialfv(GL_FRONT, GL_AMBIENT, vehicleMatAmbient);
-	glMaterialfv(GL_FRONT, GL_DIFFUSE, vehicleMatDiffuse);
-	glMaterialfv(GL_FRONT, GL_SPECULAR, vehicleMatSpecular);
-	glMaterialfv(GL_FRONT, GL_EMISSION, vehicleMatEmission);
-	glMaterialfv(GL_FRONT, GL_SHININESS, vehicleMatShininess);
-	glScalef(VEHICLE_SCALE_FACTOR[0], VEHICLE_SCALE_FACTOR[1], VEHICLE_SCALE_FACTOR[2]);
-	gluSphere(qObj, 1.0, 20, 20);
-	glPopMatrix();
 	for (i = 0; i < 4; i++)
 	{
-		glPushMatrix();
-		glMaterialfv(GL_FRONT, GL_AMBIENT, tireMatAmbient);
-		glMaterialfv(GL_FRONT, GL_DIFFUSE, tireMatDiffuse);
-		glMaterialfv(GL_FRONT, GL_SPECULAR, tireMatSpecular);
-		glMaterialfv(GL_FRONT, GL_EMISSION, tireMatEmission);
-		glMaterialfv(GL_FRONT, GL_SHININESS, tireMatShininess);
-		glTranslatef(TIRE_OFFSET[i][0], TIRE_OFFSET[i][1], TIRE_OFFSET[i][2]);
-		glScalef(TIRE_RADIUS, TIRE_RADIUS, TIRE_DEPTH);
-		gluSphere(qObj, 1.0, 20, 20);
-		glPopMatrix();
+		for (int j = 0; j < 16; j++)
+			tire[j] = body[j];
+		MatrixTranslate(tire, TIRE_OFFSET[i][0], TIRE_OFFSET[i][1], TIRE_OFFSET[i][2]);
+		MatrixScale(tire, TIRE_RADIUS, TIRE_RADIUS, TIRE_DEPTH);
+		scene.add(SPHERE_MESH, TIRE_MATERIAL, tire, views);
 	}
-	glPopMatrix();
-
-	glDisable(GL_LIGHT0);
-	glDisable(GL_LIGHTING);
 }
 
-// Draw the 2-D display panel in the bottom portion of the display
-// window, showing relevant data about the course being traversed.
-void DrawDisplayPanel()
+// Size the display panel to the window and place its readouts: distance
+// and speed in the left column, the current lane and the render thread's
+// allocations in the right.
+void LayoutDisplayPanel()
 {
-	// Update the vehicle's velocity (in MPH)
-	GLfloat currentSpeed = TRACK_LENGTH_IN_MILES * MILLISECONDS_PER_HOUR * time_increment_hour / (2 * PI * REFRESH_RATE);
-
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-	glOrtho(0.0f, (float)currWindowSize[0], 0.0f, (float)currWindowSize[1], -1.0, 1.0);
-	glMatrixMode(GL_MODELVIEW);
+	TRACE_FUNCTION();
+	ALLOC_SCOPE(ALLOC_HUD);
+	GLint width = currWindowSize[0];
+	GLint height = GLint(currWindowSize[1] * PANEL_TO_WINDOW_HEIGHT_RATIO);
+	GLint middle = width / 2;
+	GLint rowSplit = 3 * currWindowSize[1] / 32;
 
 	// Customize the font size within the display panel, according to
 	// the current window size, using a large font whenever it would
@@ -622,41 +1072,64 @@ void DrawDisplayPanel()
 		TextFont = MediumTextFont;
 	else
 		TextFont = LargeTextFont;
+	hud.resize(width, height, TextFont, CONTROL_PANEL_COLOR);
+
+	// Vertical line to separate the displayed output into columns.
+	HudLine separator = { { middle, height }, { middle, 0 },
+		{ LINE_COLOR[0], LINE_COLOR[1], LINE_COLOR[2] } };
+	hud.lines.push_back(separator);
+
+	// Each readout owns a cell that stays clear of the separator and of
+	// the other readouts, so it can be repainted on its own.
+	hud.widgets.resize(NUM_HUD_WIDGETS);
+	const GLint layout[NUM_HUD_WIDGETS][6] = {
+		//anchor x, anchor y, cell x, cell y, cell width, cell height
+		{ width / 4, currWindowSize[1] / 8, 0, rowSplit, middle - 1, height - rowSplit },
+		{ width / 4, currWindowSize[1] / 16, 0, 0, middle - 1, rowSplit },
+		{ 3 * width / 4, currWindowSize[1] / 8, middle + 1, rowSplit, width - middle - 1, height - rowSplit },
+		{ 3 * width / 4, currWindowSize[1] / 16, middle + 1, 0, width - middle - 1, rowSplit }
+	};
+	for (int i = 0; i < NUM_HUD_WIDGETS; i++)
+	{
+		HudWidget& widget = hud.widgets[i];
+		const GLfloat* color = (i == LANE_WIDGET || i == ALLOC_WIDGET) ? RIGHT_LETTER_COLOR : LEFT_LETTER_COLOR;
+		widget.anchor[0] = layout[i][0];
+		widget.anchor[1] = layout[i][1];
+		for (int j = 0; j < 4; j++)
+			widget.cell[j] = layout[i][2 + j];
+		for (int j = 0; j < 3; j++)
+			widget.color[j] = color[j];
+	}
+}
 
-	// Draw vertical line to separate the displayed output into columns.
-	glColor3f(LINE_COLOR[0], LINE_COLOR[1], LINE_COLOR[2]);
-	glBegin(GL_LINES);
-
-	glVertex2i(int(0.5 * currWindowSize[0]), int(currWindowSize[1] * PANEL_TO_WINDOW_HEIGHT_RATIO));
-	glVertex2i(int(0.5 * currWindowSize[0]), 0);
-	glEnd();
-
-	// Update the distance traveled.
-	distanceTraveled += TRACK_LENGTH_IN_MILES * (time_increment_hour / (2 * PI));
+// Draw the 2-D display panel in the bottom portion of the display
+// window, showing relevant data about the course being traversed.
+// Readouts are reformatted only when their displayed digits change.
+void DrawDisplayPanel()
+{
+	TRACE_FUNCTION();
+	ALLOC_SCOPE(ALLOC_HUD);
+	static const char* LANE_TEXT[] = { "Current Lane:   Left", "Current Lane:  Right", "Current Lane: Moving" };
 
-	glPushMatrix();
+	if (!hud.matches(currWindowSize[0], GLint(currWindowSize[1] * PANEL_TO_WINDOW_HEIGHT_RATIO)))
+		LayoutDisplayPanel();
 
 	// Output current travel readouts, starting with the
-	// distance traveled and the vehicle's current speed.
-	glColor3f(LEFT_LETTER_COLOR[0], LEFT_LETTER_COLOR[1], LEFT_LETTER_COLOR[2]);
-	glRasterPos2i(currWindowSize[0] / 4, currWindowSize[1] / 8);
-	FontPrintf(TextFont, 0, "Distance = %.2f miles", distanceTraveled);
-	glRasterPos2i(currWindowSize[0] / 4, currWindowSize[1] / 16);
-	FontPrintf(TextFont, 0, "Speed = %.2f MPH", currentSpeed);
+	// distance traveled and the vehicle's current speed (in MPH).
+	hud.widgets[DISTANCE_WIDGET].setValue("Distance = %.2f miles", vehicle.distanceTraveled, 2);
+	hud.widgets[SPEED_WIDGET].setValue("Speed = %.2f MPH", VehicleSpeed(vehicle), 2);
 
 	// Output current position readouts, starting with the vehicle's current lane.
-	glColor3f(RIGHT_LETTER_COLOR[0], RIGHT_LETTER_COLOR[1], RIGHT_LETTER_COLOR[2]);
-	char laneString[7];
-	switch (sideOfRoad)
+	switch (vehicle.sideOfRoad)
 	{
-	case LHS: { strcpy_s(laneString, "Left");   break; }
-	case RHS: { strcpy_s(laneString, "Right");  break; }
-	case TRANSITION: { strcpy_s(laneString, "Moving"); break; }
+	case LHS: { hud.widgets[LANE_WIDGET].setText(LANE_TEXT[0]); break; }
+	case RHS: { hud.widgets[LANE_WIDGET].setText(LANE_TEXT[1]); break; }
+	case TRANSITION: { hud.widgets[LANE_WIDGET].setText(LANE_TEXT[2]); break; }
 	}
-	glRasterPos2i(3 * currWindowSize[0] / 4, currWindowSize[1] / 8);
-	FontPrintf(TextFont, 0, "Current Lane: %6s", laneString);
+	// Allocations the render thread made during the previous frame.
+	hud.widgets[ALLOC_WIDGET].setValue("Allocs/Frame = %.0f", double(allocMonitor.lastFrameCalls()), 0);
 
-	glPopMatrix();
+	hud.draw();
 }
 
 // Window-reshaping callback, adjusting the viewport to be as large
@@ -687,20 +1160,6 @@ void ResizeWindow(GLsizei w,
 	glLoadIdentity();
 }
 
-// Generate a random floating-point value between the two parameterized values.
-float GenerateRandomNumber(float lowerBound, float upperBound)
-{
-	static bool firstTime = true;
-	time_t randomNumberSeed;
-	if (firstTime)
-	{
-		time(&randomNumberSeed);
-		srand((unsigned int)randomNumberSeed);
-		firstTime = false;
-	}
-	return (lowerBound + ((upperBound - lowerBound) * (float(rand()) / RAND_MAX)));
-}
-
 //functions for the track
 
 double xHist[HISTORY_BUFFER_SIZE][2];
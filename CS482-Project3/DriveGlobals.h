@@ -4,7 +4,7 @@
 
 #ifndef DRIVE_GLOBALS_H
 
-enum VIEW { DRIVER, INFIELD, OUTFIELD }; // Perspective of viewer        //
+enum VIEW { DRIVER, INFIELD, OUTFIELD, CHASE }; // Perspective of viewer //
 enum SOR { LHS, RHS, TRANSITION };      // Side-of-road enumerated type //
 
 										/********************/
@@ -24,6 +24,12 @@ const GLfloat VIEWING_ANGLE = 45.0f;
 const GLfloat NEAR_PLANE = 0.01f;
 const GLfloat FAR_PLANE = 300.0f;
 const int REFRESH_RATE = 100;
+// Each REFRESH_RATE tick is simulated in this many sub-steps, so input is
+// applied within a sub-step of when it happened.
+const int SIMULATION_SUBSTEPS = 10;
+const int SUBSTEP_MS = REFRESH_RATE / SIMULATION_SUBSTEPS;
+// After a stall the simulation catches up at most this many sub-steps.
+const int MAX_CATCHUP_SUBSTEPS = 2 * SIMULATION_SUBSTEPS;
 const GLfloat MILLISECONDS_PER_HOUR = 3600000.0f;
 
 /* Road-related constants */
@@ -33,6 +39,7 @@ const GLfloat ROADSIDE_MARGIN = 0.2f;
 const GLfloat INNER_ROAD_RADIUS = ROAD_RADIUS - 0.5f * ROAD_WIDTH;
 const GLfloat OUTER_ROAD_RADIUS = ROAD_RADIUS + 0.5f * ROAD_WIDTH;
 const GLfloat ROAD_BOTTOM = 0.00f;
+const GLfloat TRACK_THICKNESS = 0.1f;
 const GLfloat GUARDRAIL_SCALE_FACTOR[] = { 0.2f, 1.0f, 0.2f };
 const GLfloat LAP_MARKER_SCALE_FACTOR[] = { 0.2f, 5.0f, 0.2f };
 const GLfloat TRACK_LENGTH_IN_MILES = 0.25f;
@@ -56,6 +63,10 @@ const GLfloat OUTFIELD_CAMERA_POSITION[] = { 0.0f, 15.0f, -60.0f };
 const GLfloat TRACK_CENTER[] = { 0.0f, 0.0f, 0.0f };
 const GLfloat OUTFIELD_CAMERA_UP_VECTOR[] = { 0.0f, 4.0f, 1.0f };
 
+/* Position information when chasing a vehicle (track distance behind it). */
+const GLfloat CHASE_DISTANCE = 6.0f;
+const GLfloat CHASE_LEVEL = 3.0f;
+
 /* Pi-related constants. */
 const GLfloat PI = 3.1415926535f;
 const GLfloat DEGREES_PER_RADIAN = 180 / PI;
@@ -68,13 +79,19 @@ const GLfloat GROUND_BOTTOM = -0.02f;
 /* Spacing constants for roadside guardrails. */
 const int NBR_ROAD_INTERVALS = 90;
 
+/* Constants for the terrain chunks streamed in around the cameras. */
+const GLfloat TERRAIN_CHUNK_SIZE = 32.0f;
+const int TERRAIN_CHUNK_CELLS = 16;
+const GLfloat TERRAIN_STREAM_RADIUS = 96.0f;
+const GLfloat TERRAIN_DEPTH = 1.5f;
+const GLfloat TERRAIN_FEATURE_SIZE = 40.0f;
+const int TERRAIN_UPLOADS_PER_FRAME = 2;
+
 /* Tree-based constants. */
 const GLfloat MAX_TREE_HEIGHT = 8.0f;
-const int NUMBER_TREES = 200;
+const int TREES_PER_CHUNK = 34;
 const GLfloat MINIMUM_TREE_BASE_RADIUS = 0.01f * GROUND_RADIUS;
 const GLfloat MAXIMUM_TREE_BASE_RADIUS = 0.03f * GROUND_RADIUS;
-const GLfloat MINIMUM_TREE_CENTER_DISTANCE = 0.2f * GROUND_RADIUS;
-const GLfloat MAXIMUM_TREE_CENTER_DISTANCE = 0.95f * GROUND_RADIUS;
 const GLfloat MINIMUM_TREE_HEIGHT_TO_RADIUS_RATIO = 2.0f;
 const GLfloat MAXIMUM_TREE_HEIGHT_TO_RADIUS_RATIO = 6.0f;
 
@@ -0,0 +1,116 @@
+//////////////////////////////////////////////////////
+// FixedFunctionRenderer.h - Legacy OpenGL backend  //
+// built on the matrix stack and GL_LIGHT0.         //
+//////////////////////////////////////////////////////
+
+#ifndef _H_FIXED_FUNCTION_RENDERER_
+#define _H_FIXED_FUNCTION_RENDERER_
+
+#include "Renderer.h"
+
+class FixedFunctionRenderer : public Renderer {
+	// Meshes are drawn straight from client memory with vertex arrays.
+	MeshData meshes[NUM_MESHES];
+	Material materials[NUM_MATERIALS];
+
+public:
+	const char* name() { return "fixed-function"; }
+	bool initialize();
+	void uploadMesh(MESH_ID id, const MeshData& mesh);
+	void updateMeshRange(MESH_ID id, const MeshData& mesh, int firstVertex, int vertexCount);
+	void defineMaterial(MATERIAL_ID id, const Material& material);
+	void beginFrame(const Camera& camera);
+	void setMaterial(MATERIAL_ID id);
+	void drawMesh(MESH_ID id, const GLfloat model[16]);
+	void drawInstanced(MESH_ID id, const InstanceData* instances, int count);
+	void endFrame();
+	void finishFrame() {}
+	void report(std::ostream& out);
+
+private:
+	void drawElements(MESH_ID id);
+};
+
+bool FixedFunctionRenderer::initialize() {
+	return true;
+}
+
+void FixedFunctionRenderer::uploadMesh(MESH_ID id, const MeshData& mesh) {
+	meshes[id].verticies.assign(mesh.verticies.begin(), mesh.verticies.end());
+	meshes[id].indices.assign(mesh.indices.begin(), mesh.indices.end());
+}
+
+void FixedFunctionRenderer::updateMeshRange(MESH_ID id, const MeshData& mesh, int firstVertex, int vertexCount) {
+	for (int i = firstVertex; i < firstVertex + vertexCount; i++)
+		meshes[id].verticies[i] = mesh.verticies[i];
+}
+
+void FixedFunctionRenderer::defineMaterial(MATERIAL_ID id, const Material& material) {
+	materials[id] = material;
+}
+
+void FixedFunctionRenderer::beginFrame(const Camera& camera) {
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	gluPerspective(camera.fovy, camera.aspect, camera.zNear, camera.zFar);
+
+	// The light is specified in eye coordinates, before the view is applied.
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+	glLightfv(GL_LIGHT0, GL_DIFFUSE, LIGHT_INTENSITY);
+	glLightfv(GL_LIGHT0, GL_POSITION, LIGHT_POSITION);
+	gluLookAt(camera.eye[0], camera.eye[1], camera.eye[2],
+		camera.center[0], camera.center[1], camera.center[2],
+		camera.up[0], camera.up[1], camera.up[2]);
+
+	glEnable(GL_LIGHTING);
+	glEnable(GL_LIGHT0);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+}
+
+void FixedFunctionRenderer::setMaterial(MATERIAL_ID id) {
+	const Material& material = materials[id];
+	glMaterialfv(GL_FRONT, GL_AMBIENT, material.ambient);
+	glMaterialfv(GL_FRONT, GL_DIFFUSE, material.diffuse);
+	glMaterialfv(GL_FRONT, GL_SPECULAR, material.specular);
+	glMaterialfv(GL_FRONT, GL_EMISSION, material.emission);
+	glMaterialfv(GL_FRONT, GL_SHININESS, &material.shininess);
+}
+
+void FixedFunctionRenderer::drawElements(MESH_ID id) {
+	const MeshData& mesh = meshes[id];
+	if (mesh.indices.empty())
+		return;
+	glVertexPointer(3, GL_FLOAT, sizeof(MeshVertex), mesh.verticies[0].position);
+	glNormalPointer(GL_FLOAT, sizeof(MeshVertex), mesh.verticies[0].normal);
+	glDrawElements(GL_TRIANGLES, (GLsizei)mesh.indices.size(), GL_UNSIGNED_INT, &mesh.indices[0]);
+}
+
+void FixedFunctionRenderer::drawMesh(MESH_ID id, const GLfloat model[16]) {
+	glPushMatrix();
+	glMultMatrixf(model);
+	drawElements(id);
+	glPopMatrix();
+}
+
+void FixedFunctionRenderer::drawInstanced(MESH_ID id, const InstanceData* instances, int count) {
+	for (int i = 0; i < count; i++)
+		drawMesh(id, instances[i].model);
+}
+
+void FixedFunctionRenderer::endFrame() {
+	// The display panel expects an identity modelview.
+	glLoadIdentity();
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glDisable(GL_LIGHT0);
+	glDisable(GL_LIGHTING);
+}
+
+// Nothing is streamed; draws read client memory directly.
+void FixedFunctionRenderer::report(std::ostream& out) {
+	out << "Renderer: " << name() << " (no GPU buffers)" << std::endl;
+}
+
+#endif
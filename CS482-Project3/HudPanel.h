@@ -0,0 +1,238 @@
+//////////////////////////////////////////////////////
+// HudPanel.h - Retained display panel: widgets     //
+// keep their text, and the panel is composited     //
+// from a texture that is patched only where a      //
+// displayed value changed.                         //
+//////////////////////////////////////////////////////
+
+#ifndef _H_HUD_PANEL_
+#define _H_HUD_PANEL_
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "Font.h"
+#include "Trace.h"
+
+const int HUD_TEXT_LENGTH = 64;
+
+// One line of panel text, centered on anchor and owning the cell
+// rectangle (window pixels) that is cleared when it changes.
+class HudWidget {
+public:
+	GLint anchor[2];
+	GLint cell[4];
+	GLfloat color[3];
+	bool dirty;
+
+	HudWidget();
+	void setValue(const char* format, double value, int decimals);
+	void setText(const char* text);
+	const char* text() const;
+
+private:
+	char shown[HUD_TEXT_LENGTH];
+	long long quantized;
+	bool hasValue;
+};
+
+HudWidget::HudWidget() : dirty(true), quantized(0), hasValue(false) {
+	shown[0] = '\0';
+	anchor[0] = anchor[1] = 0;
+	cell[0] = cell[1] = cell[2] = cell[3] = 0;
+	color[0] = color[1] = color[2] = 1.0f;
+}
+
+// Reformat only when the value changes at the precision it is shown with.
+void HudWidget::setValue(const char* format, double value, int decimals) {
+	long long q = (long long)floor(value * pow(10.0, decimals) + 0.5);
+	if (hasValue && q == quantized)
+		return;
+	quantized = q;
+	hasValue = true;
+	snprintf(shown, sizeof(shown), format, value);
+	dirty = true;
+}
+
+void HudWidget::setText(const char* text) {
+	if (strcmp(shown, text) == 0)
+		return;
+	strncpy(shown, text, sizeof(shown) - 1);
+	shown[sizeof(shown) - 1] = '\0';
+	hasValue = false;
+	dirty = true;
+}
+
+const char* HudWidget::text() const {
+	return shown;
+}
+
+// A vertical or horizontal rule drawn under the widgets.
+struct HudLine {
+	GLint from[2];
+	GLint to[2];
+	GLfloat color[3];
+};
+
+// The panel is the strip [0, width) x [0, height) at the bottom of the
+// window. After a resize everything is drawn once and copied into a
+// texture; later frames draw one textured quad, then clear, redraw and
+// copy back only the cells of widgets whose text changed.
+class HudPanel {
+public:
+	std::vector<HudWidget> widgets;
+	std::vector<HudLine> lines;
+	//widgets redrawn by the last draw(), for profiling
+	int widgetsRedrawn;
+
+	HudPanel();
+	~HudPanel();
+	bool matches(GLint panelWidth, GLint panelHeight) const;
+	void resize(GLint panelWidth, GLint panelHeight, GLFONT* panelFont, const GLfloat background[4]);
+	void draw();
+
+private:
+	GLuint texture;
+	GLint width, height;
+	GLint textureSize[2];
+	GLFONT* font;
+	GLfloat backgroundColor[4];
+	bool redrawAll;
+
+	void drawWidget(const HudWidget& widget);
+	void copyToTexture(GLint x, GLint y, GLint w, GLint h);
+	void composite();
+};
+
+HudPanel::HudPanel() : widgetsRedrawn(0), texture(0), width(0), height(0), font(NULL), redrawAll(true) {
+	textureSize[0] = textureSize[1] = 0;
+}
+
+HudPanel::~HudPanel() {
+	// The context is normally gone by now; nothing to release.
+}
+
+bool HudPanel::matches(GLint panelWidth, GLint panelHeight) const {
+	return texture != 0 && width == panelWidth && height == panelHeight;
+}
+
+// New size or font: the caller lays the widgets out again after this.
+void HudPanel::resize(GLint panelWidth, GLint panelHeight, GLFONT* panelFont, const GLfloat background[4]) {
+	width = panelWidth;
+	height = panelHeight;
+	font = panelFont;
+	for (int i = 0; i < 4; i++)
+		backgroundColor[i] = background[i];
+
+	// Power-of-two storage works on every GL version; only a corner is used.
+	GLint size[2] = { 1, 1 };
+	while (size[0] < width)
+		size[0] *= 2;
+	while (size[1] < height)
+		size[1] *= 2;
+	if (texture == 0)
+		glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	if (size[0] != textureSize[0] || size[1] != textureSize[1])
+	{
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, size[0], size[1], 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		textureSize[0] = size[0];
+		textureSize[1] = size[1];
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	lines.clear();
+	redrawAll = true;
+}
+
+void HudPanel::draw() {
+	TRACE_FUNCTION();
+	glPushAttrib(GL_ENABLE_BIT | GL_SCISSOR_BIT | GL_COLOR_BUFFER_BIT | GL_TEXTURE_BIT | GL_CURRENT_BIT | GL_VIEWPORT_BIT);
+	glViewport(0, 0, width, height);
+	glDisable(GL_LIGHTING);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_ALPHA_TEST);
+	glDisable(GL_CULL_FACE);
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	glOrtho(0.0f, (float)width, 0.0f, (float)height, -1.0, 1.0);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+	glClearColor(backgroundColor[0], backgroundColor[1], backgroundColor[2], backgroundColor[3]);
+	glEnable(GL_SCISSOR_TEST);
+	widgetsRedrawn = 0;
+
+	if (redrawAll)
+	{
+		glScissor(0, 0, width, height);
+		glClear(GL_COLOR_BUFFER_BIT);
+		glBegin(GL_LINES);
+		for (size_t i = 0; i < lines.size(); i++)
+		{
+			glColor3fv(lines[i].color);
+			glVertex2i(lines[i].from[0], lines[i].from[1]);
+			glVertex2i(lines[i].to[0], lines[i].to[1]);
+		}
+		glEnd();
+		for (size_t i = 0; i < widgets.size(); i++)
+		{
+			drawWidget(widgets[i]);
+			widgets[i].dirty = false;
+			widgetsRedrawn++;
+		}
+		copyToTexture(0, 0, width, height);
+		redrawAll = false;
+	}
+	else
+	{
+		composite();
+		for (size_t i = 0; i < widgets.size(); i++)
+		{
+			HudWidget& widget = widgets[i];
+			if (!widget.dirty)
+				continue;
+			glScissor(widget.cell[0], widget.cell[1], widget.cell[2], widget.cell[3]);
+			glClear(GL_COLOR_BUFFER_BIT);
+			drawWidget(widget);
+			copyToTexture(widget.cell[0], widget.cell[1], widget.cell[2], widget.cell[3]);
+			widget.dirty = false;
+			widgetsRedrawn++;
+		}
+	}
+	glPopAttrib();
+}
+
+void HudPanel::drawWidget(const HudWidget& widget) {
+	glColor3fv(widget.color);
+	glRasterPos2i(widget.anchor[0], widget.anchor[1]);
+	FontPrintf(font, 0, "%s", widget.text());
+}
+
+// The panel sits at the window origin, so window and texel coordinates agree.
+void HudPanel::copyToTexture(GLint x, GLint y, GLint w, GLint h) {
+	if (w <= 0 || h <= 0)
+		return;
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glCopyTexSubImage2D(GL_TEXTURE_2D, 0, x, y, x, y, w, h);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void HudPanel::composite() {
+	GLfloat s = GLfloat(width) / textureSize[0], t = GLfloat(height) / textureSize[1];
+	glScissor(0, 0, width, height);
+	glEnable(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+	glBegin(GL_QUADS);
+	glTexCoord2f(0.0f, 0.0f); glVertex2i(0, 0);
+	glTexCoord2f(s, 0.0f);    glVertex2i(width, 0);
+	glTexCoord2f(s, t);       glVertex2i(width, height);
+	glTexCoord2f(0.0f, t);    glVertex2i(0, height);
+	glEnd();
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glDisable(GL_TEXTURE_2D);
+}
+
+#endif
@@ -0,0 +1,175 @@
+//////////////////////////////////////////////////////
+// InputQueue.h - Timestamped keyboard events for   //
+// the simulation, and a histogram of the time from //
+// each event to the first frame that shows it.     //
+//////////////////////////////////////////////////////
+
+#ifndef _H_INPUT_QUEUE_
+#define _H_INPUT_QUEUE_
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "SpscRing.h"
+
+const size_t INPUT_QUEUE_CAPACITY = 256;
+// Histogram buckets are 1 ms wide; slower events land in the last one.
+const int LATENCY_BUCKETS = 250;
+
+// Nanoseconds on the steady clock shared by input and presentation.
+inline int64_t InputClock() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// VEHICLE_INPUT events carry a VEHICLE_COMMAND in key.
+enum INPUT_KIND { ASCII_KEY, SPECIAL_KEY, VEHICLE_INPUT };
+
+struct InputEvent {
+	INPUT_KIND kind;
+	int key;
+	int64_t timestamp;
+};
+
+// GLUT callbacks push; the simulation drains the events that happened
+// before the end of the step it is about to run.
+class InputQueue {
+public:
+	InputQueue();
+	bool push(INPUT_KIND kind, int key);
+	bool push(const InputEvent& event);
+	bool popBefore(int64_t time, InputEvent& event);
+	unsigned long long dropped() const;
+
+private:
+	SpscRing<InputEvent> ring;
+	InputEvent next;
+	bool holding;
+	unsigned long long droppedEvents;
+};
+
+InputQueue::InputQueue() : ring(INPUT_QUEUE_CAPACITY), holding(false), droppedEvents(0) {
+}
+
+// Producer only. A full queue drops the event.
+bool InputQueue::push(INPUT_KIND kind, int key) {
+	InputEvent event = { kind, key, InputClock() };
+	return push(event);
+}
+
+// Producer only. Forwards an event with its original timestamp.
+bool InputQueue::push(const InputEvent& event) {
+	if (ring.push(event))
+		return true;
+	droppedEvents++;
+	return false;
+}
+
+// Consumer only. Events come out in arrival order; one that is not yet due
+// is held back for a later step.
+bool InputQueue::popBefore(int64_t time, InputEvent& event) {
+	if (!holding && ring.pop(&next, 1) == 0)
+		return false;
+	holding = true;
+	if (next.timestamp >= time)
+		return false;
+	event = next;
+	holding = false;
+	return true;
+}
+
+unsigned long long InputQueue::dropped() const {
+	return droppedEvents;
+}
+
+// Events applied by the simulation wait in pending until the next buffer
+// swap, which is the first frame that can show their effect.
+class LatencyProbe {
+public:
+	LatencyProbe();
+	void applied(const InputEvent& event);
+	void presented(int64_t swapTime);
+	unsigned long long count() const;
+	double percentile(double p) const;
+	void report(std::ostream& out) const;
+
+private:
+	std::vector<int64_t> pending;
+	unsigned long long buckets[LATENCY_BUCKETS];
+	unsigned long long samples;
+	int64_t total;
+	int64_t longest;
+};
+
+LatencyProbe::LatencyProbe() : samples(0), total(0), longest(0) {
+	for (int i = 0; i < LATENCY_BUCKETS; i++)
+		buckets[i] = 0;
+}
+
+void LatencyProbe::applied(const InputEvent& event) {
+	pending.push_back(event.timestamp);
+}
+
+void LatencyProbe::presented(int64_t swapTime) {
+	for (size_t i = 0; i < pending.size(); i++)
+	{
+		int64_t latency = swapTime - pending[i];
+		int bucket = (int)(latency / 1000000);
+		buckets[bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1]++;
+		samples++;
+		total += latency;
+		longest = latency > longest ? latency : longest;
+	}
+	pending.clear();
+}
+
+unsigned long long LatencyProbe::count() const {
+	return samples;
+}
+
+// Upper edge (ms) of the bucket holding the p-th fraction of the samples.
+double LatencyProbe::percentile(double p) const {
+	unsigned long long rank = (unsigned long long)(p * samples);
+	unsigned long long seen = 0;
+	for (int i = 0; i < LATENCY_BUCKETS; i++)
+	{
+		seen += buckets[i];
+		if (seen > rank)
+			return i + 1.0;
+	}
+	return LATENCY_BUCKETS;
+}
+
+// Summary line, then a bar per 10 ms band that has samples.
+void LatencyProbe::report(std::ostream& out) const {
+	if (samples == 0)
+	{
+		out << "Input latency: no events yet" << std::endl;
+		return;
+	}
+	std::ios::fmtflags flags = out.flags();
+	std::streamsize precision = out.precision();
+	out << "Input latency (event to swap), " << samples << " events: mean "
+		<< std::fixed << std::setprecision(1) << total / 1.0e6 / samples << " ms, p50 <= " << percentile(0.5)
+		<< " ms, p95 <= " << percentile(0.95) << " ms, p99 <= " << percentile(0.99) << " ms, max "
+		<< longest / 1.0e6 << " ms" << std::endl;
+	const int BAND = 10;
+	for (int band = 0; band < LATENCY_BUCKETS; band += BAND)
+	{
+		unsigned long long n = 0;
+		for (int i = band; i < band + BAND && i < LATENCY_BUCKETS; i++)
+			n += buckets[i];
+		if (n == 0)
+			continue;
+		out << std::setw(4) << band << "-" << std::setw(3) << band + BAND
+			<< (band + BAND >= LATENCY_BUCKETS ? "+ms " : " ms ") << std::setw(6) << n << " "
+			<< std::string((size_t)(1 + 49 * n / samples), '#') << std::endl;
+	}
+	out.flags(flags);
+	out.precision(precision);
+}
+
+#endif
@@ -0,0 +1,124 @@
+//////////////////////////////////////////////////////
+// Matrix.h - Column-major 4x4 matrix helpers that  //
+// mirror the fixed-function matrix stack calls.    //
+//////////////////////////////////////////////////////
+
+#ifndef _H_MATRIX_
+#define _H_MATRIX_
+
+#include <cmath>
+
+// Load the identity into m.
+void MatrixIdentity(GLfloat m[16])
+{
+	for (int i = 0; i < 16; i++)
+		m[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+}
+
+// out = a * b (out may alias a or b).
+void MatrixMultiply(GLfloat out[16], const GLfloat a[16], const GLfloat b[16])
+{
+	GLfloat result[16];
+	for (int col = 0; col < 4; col++)
+		for (int row = 0; row < 4; row++)
+		{
+			GLfloat sum = 0.0f;
+			for (int k = 0; k < 4; k++)
+				sum += a[k * 4 + row] * b[col * 4 + k];
+			result[col * 4 + row] = sum;
+		}
+	for (int i = 0; i < 16; i++)
+		out[i] = result[i];
+}
+
+// Post-multiply m by a translation, like glTranslatef.
+void MatrixTranslate(GLfloat m[16], GLfloat x, GLfloat y, GLfloat z)
+{
+	for (int row = 0; row < 4; row++)
+		m[12 + row] += m[row] * x + m[4 + row] * y + m[8 + row] * z;
+}
+
+// Post-multiply m by a scale, like glScalef.
+void MatrixScale(GLfloat m[16], GLfloat x, GLfloat y, GLfloat z)
+{
+	for (int row = 0; row < 4; row++)
+	{
+		m[row] *= x;
+		m[4 + row] *= y;
+		m[8 + row] *= z;
+	}
+}
+
+// Post-multiply m by a rotation of angle degrees about (x, y, z), like glRotatef.
+void MatrixRotate(GLfloat m[16], GLfloat angle, GLfloat x, GLfloat y, GLfloat z)
+{
+	GLfloat len = sqrt(x * x + y * y + z * z);
+	if (len == 0.0f)
+		return;
+	x /= len; y /= len; z /= len;
+	GLfloat radians = angle * 0.01745329251f;
+	GLfloat c = cos(radians), s = sin(radians), t = 1.0f - c;
+	GLfloat r[16] = {
+		t * x * x + c,     t * x * y + s * z, t * x * z - s * y, 0.0f,
+		t * x * y - s * z, t * y * y + c,     t * y * z + s * x, 0.0f,
+		t * x * z + s * y, t * y * z - s * x, t * z * z + c,     0.0f,
+		0.0f,              0.0f,              0.0f,              1.0f };
+	MatrixMultiply(m, m, r);
+}
+
+// Load a perspective projection into m, like gluPerspective.
+void MatrixPerspective(GLfloat m[16], GLfloat fovy, GLfloat aspect, GLfloat zNear, GLfloat zFar)
+{
+	GLfloat f = 1.0f / tan(0.5f * fovy * 0.01745329251f);
+	for (int i = 0; i < 16; i++)
+		m[i] = 0.0f;
+	m[0] = f / aspect;
+	m[5] = f;
+	m[10] = (zFar + zNear) / (zNear - zFar);
+	m[11] = -1.0f;
+	m[14] = 2.0f * zFar * zNear / (zNear - zFar);
+}
+
+// Load a viewing transform into m, like gluLookAt.
+void MatrixLookAt(GLfloat m[16], const GLfloat eye[3], const GLfloat center[3], const GLfloat up[3])
+{
+	GLfloat f[3] = { center[0] - eye[0], center[1] - eye[1], center[2] - eye[2] };
+	GLfloat len = sqrt(f[0] * f[0] + f[1] * f[1] + f[2] * f[2]);
+	f[0] /= len; f[1] /= len; f[2] /= len;
+
+	// s = f x up, u = s x f
+	GLfloat s[3] = { f[1] * up[2] - f[2] * up[1], f[2] * up[0] - f[0] * up[2], f[0] * up[1] - f[1] * up[0] };
+	len = sqrt(s[0] * s[0] + s[1] * s[1] + s[2] * s[2]);
+	s[0] /= len; s[1] /= len; s[2] /= len;
+	GLfloat u[3] = { s[1] * f[2] - s[2] * f[1], s[2] * f[0] - s[0] * f[2], s[0] * f[1] - s[1] * f[0] };
+
+	MatrixIdentity(m);
+	m[0] = s[0]; m[4] = s[1]; m[8] = s[2];
+	m[1] = u[0]; m[5] = u[1]; m[9] = u[2];
+	m[2] = -f[0]; m[6] = -f[1]; m[10] = -f[2];
+	MatrixTranslate(m, -eye[0], -eye[1], -eye[2]);
+}
+
+// Load a frame at origin whose x axis points along forward and whose
+// y axis stays as close to world up as possible (z = x cross y).
+void MatrixFromFrame(GLfloat m[16], const GLfloat origin[3], const GLfloat forward[3])
+{
+	GLfloat len = sqrt(forward[0] * forward[0] + forward[1] * forward[1] + forward[2] * forward[2]);
+	GLfloat x[3] = { forward[0] / len, forward[1] / len, forward[2] / len };
+	// z = x cross (0, 1, 0), then y = z cross x.
+	GLfloat z[3] = { -x[2], 0.0f, x[0] };
+	len = sqrt(z[0] * z[0] + z[2] * z[2]);
+	z[0] /= len; z[2] /= len;
+	GLfloat y[3] = { z[1] * x[2] - z[2] * x[1], z[2] * x[0] - z[0] * x[2], z[0] * x[1] - z[1] * x[0] };
+
+	MatrixIdentity(m);
+	for (int i = 0; i < 3; i++)
+	{
+		m[i] = x[i];
+		m[4 + i] = y[i];
+		m[8 + i] = z[i];
+		m[12 + i] = origin[i];
+	}
+}
+
+#endif
@@ -0,0 +1,148 @@
+//////////////////////////////////////////////////////
+// Mesh.h - Indexed triangle meshes and the unit    //
+// primitives that replace the GLU/GLUT shapes.     //
+//////////////////////////////////////////////////////
+
+#ifndef _H_MESH_
+#define _H_MESH_
+
+#include <vector>
+#include <cmath>
+
+struct MeshVertex {
+	GLfloat position[3];
+	GLfloat normal[3];
+};
+
+// Indexed triangle list.
+struct MeshData {
+	std::vector<MeshVertex> verticies;
+	std::vector<GLuint> indices;
+
+	void clear();
+	GLuint addVertex(GLfloat px, GLfloat py, GLfloat pz, GLfloat nx, GLfloat ny, GLfloat nz);
+	void addTriangle(GLuint a, GLuint b, GLuint c);
+};
+
+void MeshData::clear() {
+	//keeps the capacity so rebuilding does not reallocate
+	verticies.clear();
+	indices.clear();
+}
+
+GLuint MeshData::addVertex(GLfloat px, GLfloat py, GLfloat pz, GLfloat nx, GLfloat ny, GLfloat nz) {
+	MeshVertex v = { { px, py, pz }, { nx, ny, nz } };
+	verticies.push_back(v);
+	return (GLuint)verticies.size() - 1;
+}
+
+void MeshData::addTriangle(GLuint a, GLuint b, GLuint c) {
+	indices.push_back(a);
+	indices.push_back(b);
+	indices.push_back(c);
+}
+
+// Unit cube centered at the origin (glutSolidCube(1.0)).
+void BuildCubeMesh(MeshData& mesh)
+{
+	static const GLfloat FACE_NORMAL[6][3] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 },
+		{ 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+	mesh.clear();
+	for (int f = 0; f < 6; f++)
+	{
+		const GLfloat* n = FACE_NORMAL[f];
+		// Two axes spanning the face, ordered so (u x v) == n.
+		GLfloat u[3] = { n[1], n[2], n[0] };
+		GLfloat v[3] = { n[1] * u[2] - n[2] * u[1], n[2] * u[0] - n[0] * u[2], n[0] * u[1] - n[1] * u[0] };
+		GLuint first = (GLuint)mesh.verticies.size();
+		for (int c = 0; c < 4; c++)
+		{
+			GLfloat su = (c == 1 || c == 2) ? 0.5f : -0.5f;
+			GLfloat sv = (c >= 2) ? 0.5f : -0.5f;
+			mesh.addVertex(0.5f * n[0] + su * u[0] + sv * v[0],
+				0.5f * n[1] + su * u[1] + sv * v[1],
+				0.5f * n[2] + su * u[2] + sv * v[2], n[0], n[1], n[2]);
+		}
+		mesh.addTriangle(first, first + 1, first + 2);
+		mesh.addTriangle(first, first + 2, first + 3);
+	}
+}
+
+// Open cone with unit base radius at y = 0 and its apex at y = 1
+// (gluCylinder(base, 0, height) rotated to stand upright).
+void BuildConeMesh(MeshData& mesh, int slices, int stacks)
+{
+	mesh.clear();
+	const GLfloat normalScale = 1.0f / sqrt(2.0f);
+	for (int j = 0; j <= stacks; j++)
+	{
+		GLfloat h = GLfloat(j) / stacks;
+		for (int i = 0; i <= slices; i++)
+		{
+			GLfloat theta = 2.0f * 3.1415926535f * i / slices;
+			GLfloat c = cos(theta), s = sin(theta);
+			mesh.addVertex((1.0f - h) * c, h, (1.0f - h) * s, c * normalScale, normalScale, s * normalScale);
+		}
+	}
+	for (int j = 0; j < stacks; j++)
+		for (int i = 0; i < slices; i++)
+		{
+			GLuint a = j * (slices + 1) + i, b = a + 1;
+			GLuint c = a + (slices + 1), d = c + 1;
+			mesh.addTriangle(a, c, b);
+			mesh.addTriangle(b, c, d);
+		}
+}
+
+// Unit sphere centered at the origin (gluSphere(1.0)).
+void BuildSphereMesh(MeshData& mesh, int slices, int stacks)
+{
+	mesh.clear();
+	for (int j = 0; j <= stacks; j++)
+	{
+		GLfloat phi = 3.1415926535f * j / stacks;
+		GLfloat y = cos(phi), r = sin(phi);
+		for (int i = 0; i <= slices; i++)
+		{
+			GLfloat theta = 2.0f * 3.1415926535f * i / slices;
+			GLfloat x = r * cos(theta), z = r * sin(theta);
+			mesh.addVertex(x, y, z, x, y, z);
+		}
+	}
+	for (int j = 0; j < stacks; j++)
+		for (int i = 0; i < slices; i++)
+		{
+			GLuint a = j * (slices + 1) + i, b = a + 1;
+			GLuint c = a + (slices + 1), d = c + 1;
+			mesh.addTriangle(a, b, c);
+			mesh.addTriangle(b, d, c);
+		}
+}
+
+// Unit disk in the xz-plane facing +y (gluDisk rotated to lie flat).
+void BuildDiskMesh(MeshData& mesh, int slices, int loops)
+{
+	mesh.clear();
+	mesh.addVertex(0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f);
+	for (int j = 1; j <= loops; j++)
+	{
+		GLfloat r = GLfloat(j) / loops;
+		for (int i = 0; i <= slices; i++)
+		{
+			GLfloat theta = 2.0f * 3.1415926535f * i / slices;
+			mesh.addVertex(r * cos(theta), 0.0f, r * sin(theta), 0.0f, 1.0f, 0.0f);
+		}
+	}
+	for (int i = 0; i < slices; i++)
+		mesh.addTriangle(0, i + 2, i + 1);
+	for (int j = 1; j < loops; j++)
+		for (int i = 0; i < slices; i++)
+		{
+			GLuint a = 1 + (j - 1) * (slices + 1) + i, b = a + 1;
+			GLuint c = a + (slices + 1), d = c + 1;
+			mesh.addTriangle(a, b, c);
+			mesh.addTriangle(b, d, c);
+		}
+}
+
+#endif
@@ -0,0 +1,253 @@
+//////////////////////////////////////////////////////
+// MultiView.h - Draws one scene list from several  //
+// cameras, culling for all of them in one pass.    //
+//////////////////////////////////////////////////////
+
+#ifndef _H_MULTI_VIEW_
+#define _H_MULTI_VIEW_
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "Renderer.h"
+#include "Trace.h"
+
+// Visibility is kept as one bit per view.
+const int MAX_VIEWS = 32;
+const unsigned ALL_VIEWS = 0xFFFFFFFFu;
+
+// Clip planes (a, b, c, d) of a camera, pointing inward, normalized.
+struct Frustum {
+	GLfloat planes[6][4];
+};
+
+struct BoundingSphere {
+	GLfloat center[3];
+	GLfloat radius;
+};
+
+// One mesh instance to draw, with its world-space bounds. views masks the
+// cameras allowed to see it (the driver's view leaves out the vehicle).
+struct SceneItem {
+	MESH_ID mesh;
+	MATERIAL_ID material;
+	InstanceData instance;
+	BoundingSphere bounds;
+	unsigned views;
+};
+
+// Everything drawn this frame, built once and shared by every view.
+// Items that share a mesh and material should be added together so each
+// view can draw them as one instanced batch.
+class SceneList {
+public:
+	std::vector<SceneItem> items;
+	//object-space bounds of each uploaded mesh, and the boxes they come from
+	BoundingSphere meshBounds[NUM_MESHES];
+	GLfloat meshLower[NUM_MESHES][3];
+	GLfloat meshUpper[NUM_MESHES][3];
+
+	SceneList();
+	void setMeshBounds(MESH_ID id, const MeshData& mesh);
+	void growMeshBounds(MESH_ID id, const MeshData& mesh, int firstVertex, int vertexCount);
+	void clear();
+	void add(MESH_ID mesh, MATERIAL_ID material, const GLfloat model[16], unsigned views = ALL_VIEWS);
+};
+
+// A camera and the window rectangle it draws into.
+struct View {
+	Camera camera;
+	GLint viewport[4];
+};
+
+class ViewSet {
+public:
+	std::vector<View> views;
+	//per scene item, the views that see it
+	std::vector<unsigned> visibility;
+	//per view, how many items survived culling
+	int visibleCount[MAX_VIEWS];
+
+	void clear();
+	int add(const Camera& camera, GLint x, GLint y, GLsizei width, GLsizei height);
+	void cull(const SceneList& scene);
+	void draw(Renderer* renderer, const SceneList& scene, int view);
+
+private:
+	std::vector<Frustum> frustums;
+	std::vector<InstanceData> batch;
+};
+
+// Gribb-Hartmann extraction from projection * view (column-major).
+void FrustumFromCamera(const Camera& camera, Frustum& frustum)
+{
+	GLfloat projection[16], view[16], m[16];
+	MatrixPerspective(projection, camera.fovy, camera.aspect, camera.zNear, camera.zFar);
+	MatrixLookAt(view, camera.eye, camera.center, camera.up);
+	MatrixMultiply(m, projection, view);
+	for (int p = 0; p < 6; p++)
+	{
+		int row = p / 2;
+		GLfloat sign = (p % 2 == 0) ? 1.0f : -1.0f;
+		GLfloat* plane = frustum.planes[p];
+		for (int col = 0; col < 4; col++)
+			plane[col] = m[col * 4 + 3] + sign * m[col * 4 + row];
+		GLfloat len = sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+		for (int k = 0; k < 4; k++)
+			plane[k] /= len;
+	}
+}
+
+SceneList::SceneList() {
+	for (int i = 0; i < NUM_MESHES; i++)
+	{
+		meshBounds[i].center[0] = meshBounds[i].center[1] = meshBounds[i].center[2] = 0.0f;
+		meshBounds[i].radius = 0.0f;
+		for (int k = 0; k < 3; k++)
+			meshLower[i][k] = meshUpper[i][k] = 0.0f;
+	}
+}
+
+// Sphere around the mesh's bounding box; loose, but cheap and stable.
+void SceneList::setMeshBounds(MESH_ID id, const MeshData& mesh) {
+	if (mesh.verticies.empty())
+		return;
+	for (int k = 0; k < 3; k++)
+		meshLower[id][k] = meshUpper[id][k] = mesh.verticies[0].position[k];
+	growMeshBounds(id, mesh, 1, (int)mesh.verticies.size() - 1);
+}
+
+// Widen a mesh's box (never shrinking it) to take in verticies
+// [firstVertex, firstVertex + vertexCount) after a partial update, so the
+// cost follows the update rather than the mesh.
+void SceneList::growMeshBounds(MESH_ID id, const MeshData& mesh, int firstVertex, int vertexCount) {
+	BoundingSphere& bounds = meshBounds[id];
+	GLfloat* lower = meshLower[id];
+	GLfloat* upper = meshUpper[id];
+	for (int i = firstVertex; i < firstVertex + vertexCount; i++)
+		for (int k = 0; k < 3; k++)
+		{
+			lower[k] = std::min(lower[k], mesh.verticies[i].position[k]);
+			upper[k] = std::max(upper[k], mesh.verticies[i].position[k]);
+		}
+	GLfloat r2 = 0.0f;
+	for (int k = 0; k < 3; k++)
+	{
+		bounds.center[k] = 0.5f * (lower[k] + upper[k]);
+		r2 += 0.25f * (upper[k] - lower[k]) * (upper[k] - lower[k]);
+	}
+	bounds.radius = sqrt(r2);
+}
+
+void SceneList::clear() {
+	items.clear();
+}
+
+void SceneList::add(MESH_ID mesh, MATERIAL_ID material, const GLfloat model[16], unsigned views) {
+	SceneItem item;
+	item.mesh = mesh;
+	item.material = material;
+	item.views = views;
+	for (int i = 0; i < 16; i++)
+		item.instance.model[i] = model[i];
+
+	// Move the mesh's sphere into world space; the radius grows by the largest axis scale.
+	const BoundingSphere& local = meshBounds[mesh];
+	GLfloat scale2 = 0.0f;
+	for (int k = 0; k < 3; k++)
+	{
+		item.bounds.center[k] = model[12 + k];
+		for (int j = 0; j < 3; j++)
+			item.bounds.center[k] += model[j * 4 + k] * local.center[j];
+		GLfloat axis2 = model[k * 4] * model[k * 4] + model[k * 4 + 1] * model[k * 4 + 1] + model[k * 4 + 2] * model[k * 4 + 2];
+		scale2 = std::max(scale2, axis2);
+	}
+	item.bounds.radius = local.radius * sqrt(scale2);
+	items.push_back(item);
+}
+
+void ViewSet::clear() {
+	views.clear();
+}
+
+// Returns the view's index, which is also its bit in the visibility masks,
+// or -1 (adding nothing) once MAX_VIEWS views are set.
+int ViewSet::add(const Camera& camera, GLint x, GLint y, GLsizei width, GLsizei height) {
+	if ((int)views.size() == MAX_VIEWS)
+		return -1;
+	View view;
+	view.camera = camera;
+	view.viewport[0] = x;
+	view.viewport[1] = y;
+	view.viewport[2] = width;
+	view.viewport[3] = height;
+	views.push_back(view);
+	return (int)views.size() - 1;
+}
+
+// Test every item against every view's frustum in a single sweep over the scene.
+void ViewSet::cull(const SceneList& scene) {
+	TRACE_FUNCTION();
+	const int numViews = (int)views.size();
+	frustums.resize(numViews);
+	for (int v = 0; v < numViews; v++)
+	{
+		FrustumFromCamera(views[v].camera, frustums[v]);
+		visibleCount[v] = 0;
+	}
+
+	visibility.resize(scene.items.size());
+	for (size_t i = 0; i < scene.items.size(); i++)
+	{
+		const SceneItem& item = scene.items[i];
+		const GLfloat* c = item.bounds.center;
+		unsigned mask = 0;
+		for (int v = 0; v < numViews; v++)
+		{
+			if (!(item.views & (1u << v)))
+				continue;
+			bool inside = true;
+			for (int p = 0; p < 6 && inside; p++)
+			{
+				const GLfloat* plane = frustums[v].planes[p];
+				inside = plane[0] * c[0] + plane[1] * c[1] + plane[2] * c[2] + plane[3] >= -item.bounds.radius;
+			}
+			if (inside)
+			{
+				mask |= 1u << v;
+				visibleCount[v]++;
+			}
+		}
+		visibility[i] = mask;
+	}
+}
+
+// Draw the items one view sees, merging runs with the same mesh and
+// material into instanced draws. The caller sets the viewport and brackets
+// this with beginFrame/endFrame.
+void ViewSet::draw(Renderer* renderer, const SceneList& scene, int view) {
+	const unsigned bit = 1u << view;
+	const size_t count = scene.items.size();
+	MATERIAL_ID material = NUM_MATERIALS;
+	for (size_t i = 0; i < count;)
+	{
+		const SceneItem& first = scene.items[i];
+		batch.clear();
+		size_t end = i;
+		for (; end < count && scene.items[end].mesh == first.mesh && scene.items[end].material == first.material; end++)
+			if (visibility[end] & bit)
+				batch.push_back(scene.items[end].instance);
+		if (!batch.empty())
+		{
+			if (material != first.material)
+			{
+				renderer->setMaterial(first.material);
+				material = first.material;
+			}
+			renderer->drawInstanced(first.mesh, &batch[0], (int)batch.size());
+		}
+		i = end;
+	}
+}
+
+#endif
@@ -0,0 +1,247 @@
+//////////////////////////////////////////////////////
+// PackedVertex.h - 12-byte GPU vertex: positions   //
+// quantized to 16 bits within the mesh's bounding  //
+// box, normals packed 10:10:10:2.                  //
+//////////////////////////////////////////////////////
+
+#ifndef _H_PACKED_VERTEX_
+#define _H_PACKED_VERTEX_
+
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "Mesh.h"
+
+// Largest quantized coordinate; a position decodes as
+// decodeOffset + decodeScale * q with q in [-POSITION_QUANTA, POSITION_QUANTA].
+const int POSITION_QUANTA = 32767;
+// Largest signed 10-bit normal component.
+const int NORMAL_QUANTA = 511;
+
+// Position is read as three non-normalized GL_SHORTs (the fourth is
+// padding) and the normal as one non-normalized GL_INT_2_10_10_10_REV,
+// so decoding is exact on any GL 3.3 implementation.
+struct PackedVertex {
+	GLshort position[4];
+	GLuint normal;
+};
+
+// The box a mesh's positions are quantized in.
+struct QuantizationBox {
+	GLfloat decodeScale[3];
+	GLfloat decodeOffset[3];
+
+	void fit(const MeshData& mesh);
+	bool pack(const MeshVertex& source, PackedVertex& packed) const;
+	void decodePosition(const PackedVertex& vertex, GLfloat position[3]) const;
+};
+
+GLuint PackNormal(const GLfloat normal[3]) {
+	GLuint bits = 0;
+	for (int k = 0; k < 3; k++)
+	{
+		GLfloat n = normal[k] < -1.0f ? -1.0f : (normal[k] > 1.0f ? 1.0f : normal[k]);
+		GLint q = (GLint)floor(n * NORMAL_QUANTA + 0.5f);
+		bits |= ((GLuint)q & 0x3FF) << (10 * k);
+	}
+	return bits;
+}
+
+void UnpackNormal(GLuint bits, GLfloat normal[3]) {
+	for (int k = 0; k < 3; k++)
+	{
+		GLint q = (GLint)((bits >> (10 * k)) & 0x3FF);
+		if (q >= 512)
+			q -= 1024;
+		normal[k] = GLfloat(q) / NORMAL_QUANTA;
+	}
+}
+
+// Center the box on the mesh's bounds.
+void QuantizationBox::fit(const MeshData& mesh) {
+	GLfloat lo[3] = { 0, 0, 0 }, hi[3] = { 0, 0, 0 };
+	for (size_t i = 0; i < mesh.verticies.size(); i++)
+		for (int k = 0; k < 3; k++)
+		{
+			GLfloat p = mesh.verticies[i].position[k];
+			if (i == 0 || p < lo[k])
+				lo[k] = p;
+			if (i == 0 || p > hi[k])
+				hi[k] = p;
+		}
+	for (int k = 0; k < 3; k++)
+	{
+		GLfloat half = 0.5f * (hi[k] - lo[k]);
+		decodeOffset[k] = 0.5f * (lo[k] + hi[k]);
+		//a little slack so float rounding at the faces never clamps
+		decodeScale[k] = (half > 0.0f ? half * 1.0001f : 1.0f) / POSITION_QUANTA;
+	}
+}
+
+// Returns false if the vertex lies outside the box.
+bool QuantizationBox::pack(const MeshVertex& source, PackedVertex& packed) const {
+	for (int k = 0; k < 3; k++)
+	{
+		GLfloat q = floor((source.position[k] - decodeOffset[k]) / decodeScale[k] + 0.5f);
+		if (q < -POSITION_QUANTA || q > POSITION_QUANTA)
+			return false;
+		packed.position[k] = (GLshort)q;
+	}
+	packed.position[3] = 0;
+	packed.normal = PackNormal(source.normal);
+	return true;
+}
+
+void QuantizationBox::decodePosition(const PackedVertex& vertex, GLfloat position[3]) const {
+	for (int k = 0; k < 3; k++)
+		position[k] = decodeOffset[k] + decodeScale[k] * vertex.position[k];
+}
+
+// Pack verticies [firstVertex, firstVertex + vertexCount) of the mesh into
+// out. Returns false if any lies outside the box, which then has to be
+// refitted and the whole mesh packed again.
+bool PackVerticies(const MeshData& mesh, int firstVertex, int vertexCount, const QuantizationBox& box,
+	std::vector<PackedVertex>& out)
+{
+	out.resize(vertexCount);
+	for (int i = 0; i < vertexCount; i++)
+		if (!box.pack(mesh.verticies[firstVertex + i], out[i]))
+			return false;
+	return true;
+}
+
+// Worst decoded normal error: each component rounds by at most half of
+// 1/NORMAL_QUANTA, which turns a unit normal by just under 0.1 degrees.
+const double NORMAL_TOLERANCE_DEGREES = 0.1;
+
+// On in debug builds: every packed run is decoded again, and one outside
+// tolerance is reported. "-pack-check" measures the same offline.
+#ifdef _DEBUG
+bool packedPrecisionCheck = true;
+#else
+bool packedPrecisionCheck = false;
+#endif
+
+// Unit normals drawn at random for "-pack-check", beyond those in meshes.
+const int PACK_CHECK_RANDOM_NORMALS = 1000000;
+
+// Worst decode errors over a packed run. Positions may be off by half a
+// quantum per axis, normals by NORMAL_TOLERANCE_DEGREES.
+struct PackedPrecision {
+	double positionError;
+	double positionTolerance;
+	double normalAngle;
+
+	bool withinTolerance() const;
+};
+
+bool PackedPrecision::withinTolerance() const {
+	return positionError <= positionTolerance && normalAngle <= NORMAL_TOLERANCE_DEGREES;
+}
+
+// Degrees between a normal and its unpacked copy (0 for a zero normal).
+double PackedNormalAngle(const GLfloat normal[3], GLuint bits) {
+	GLfloat n[3];
+	UnpackNormal(bits, n);
+	double dot = 0, length = 0, sourceLength = 0;
+	for (int k = 0; k < 3; k++)
+	{
+		dot += n[k] * normal[k];
+		length += n[k] * n[k];
+		sourceLength += normal[k] * normal[k];
+	}
+	if (length <= 0 || sourceLength <= 0)
+		return 0;
+	double c = dot / sqrt(length * sourceLength);
+	return acos(c > 1.0 ? 1.0 : c) * 180.0 / 3.14159265358979;
+}
+
+PackedPrecision MeasurePackedPrecision(const MeshData& mesh, int firstVertex, const QuantizationBox& box,
+	const std::vector<PackedVertex>& packed)
+{
+	PackedPrecision precision = { 0, 0, 0 };
+	double maxQuantum = 0, magnitude = 0;
+	for (size_t i = 0; i < packed.size(); i++)
+	{
+		const MeshVertex& source = mesh.verticies[firstVertex + i];
+		GLfloat p[3];
+		box.decodePosition(packed[i], p);
+		for (int k = 0; k < 3; k++)
+		{
+			double error = fabs(p[k] - source.position[k]);
+			precision.positionError = error > precision.positionError ? error : precision.positionError;
+			magnitude = fabs(p[k]) > magnitude ? fabs(p[k]) : magnitude;
+		}
+		double angle = PackedNormalAngle(source.normal, packed[i].normal);
+		precision.normalAngle = angle > precision.normalAngle ? angle : precision.normalAngle;
+	}
+	for (int k = 0; k < 3; k++)
+		maxQuantum = box.decodeScale[k] > maxQuantum ? box.decodeScale[k] : maxQuantum;
+	//float rounding of the decode adds a few ulps of the coordinate itself
+	precision.positionTolerance = 0.5 * maxQuantum + 4 * FLT_EPSILON * magnitude;
+	return precision;
+}
+
+// Upload path: report a packed run outside tolerance and carry on.
+void CheckPackedPrecision(const MeshData& mesh, int firstVertex, const QuantizationBox& box,
+	const std::vector<PackedVertex>& packed)
+{
+	if (!packedPrecisionCheck)
+		return;
+	PackedPrecision precision = MeasurePackedPrecision(mesh, firstVertex, box, packed);
+	if (!precision.withinTolerance())
+		std::cerr << "Packed mesh exceeds tolerance: position error " << precision.positionError << " (tolerance "
+			<< precision.positionTolerance << "), normal error " << precision.normalAngle << " degrees" << std::endl;
+}
+
+struct NamedMesh {
+	std::string name;
+	const MeshData* mesh;
+};
+
+// "-pack-check": pack each mesh as an upload would, and then random unit
+// normals, and report the worst errors. Returns false if any is outside
+// tolerance.
+bool RunPackCheck(const std::vector<NamedMesh>& meshes, std::ostream& out)
+{
+	bool passed = true;
+	QuantizationBox box;
+	std::vector<PackedVertex> packed;
+	for (size_t m = 0; m < meshes.size(); m++)
+	{
+		const MeshData& mesh = *meshes[m].mesh;
+		box.fit(mesh);
+		PackVerticies(mesh, 0, (int)mesh.verticies.size(), box, packed);
+		PackedPrecision precision = MeasurePackedPrecision(mesh, 0, box, packed);
+		out << meshes[m].name << ": " << mesh.verticies.size() << " verticies, position error "
+			<< precision.positionError << " (tolerance " << precision.positionTolerance << "), normal error "
+			<< precision.normalAngle << " degrees" << (precision.withinTolerance() ? "" : "  FAILED") << std::endl;
+		passed = passed && precision.withinTolerance();
+	}
+
+	std::mt19937 random(1);
+	std::normal_distribution<float> gaussian;
+	double worstAngle = 0;
+	for (int i = 0; i < PACK_CHECK_RANDOM_NORMALS; i++)
+	{
+		GLfloat n[3] = { gaussian(random), gaussian(random), gaussian(random) };
+		GLfloat length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (length == 0.0f)
+			continue;
+		for (int k = 0; k < 3; k++)
+			n[k] /= length;
+		double angle = PackedNormalAngle(n, PackNormal(n));
+		worstAngle = angle > worstAngle ? angle : worstAngle;
+	}
+	bool normalsPassed = worstAngle <= NORMAL_TOLERANCE_DEGREES;
+	out << PACK_CHECK_RANDOM_NORMALS << " random unit normals: normal error " << worstAngle << " degrees"
+		<< (normalsPassed ? "" : "  FAILED") << std::endl;
+	passed = passed && normalsPassed;
+	out << "Pack check " << (passed ? "passed" : "failed") << std::endl;
+	return passed;
+}
+
+#endif
@@ -0,0 +1,226 @@
+//////////////////////////////////////////////////////
+// QualityGovernor.h - Measures what each frame     //
+// costs and steps scene detail down or up to keep  //
+// it within a frame-time budget.                   //
+//////////////////////////////////////////////////////
+
+#ifndef _H_QUALITY_GOVERNOR_
+#define _H_QUALITY_GOVERNOR_
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+// One rung of the quality ladder.
+struct QualitySettings {
+	const char* name;
+	//track samples are the requested count shifted right by this
+	int trackSampleShift;
+	//tessellation of the tree cones and vehicle spheres
+	int coneSlices;
+	int sphereSlices;
+	//terrain and trees are streamed this far around the cameras
+	GLfloat sceneryDistance;
+	//fraction of the window resolution the 3D views are drawn at
+	GLfloat renderScale;
+};
+
+// Highest quality first; level 0 is the scene as it always looked.
+const QualitySettings QUALITY_LEVELS[] = {
+	{ "full",    0, 36, 20, 96.0f, 1.0f },
+	{ "high",    0, 24, 16, 80.0f, 1.0f },
+	{ "medium",  1, 16, 12, 64.0f, 0.85f },
+	{ "low",     1, 12, 10, 48.0f, 0.7f },
+	{ "minimum", 2,  8,  8, 32.0f, 0.5f },
+};
+const int NUM_QUALITY_LEVELS = sizeof(QUALITY_LEVELS) / sizeof(QUALITY_LEVELS[0]);
+
+// Frames averaged per decision.
+const int QUALITY_WINDOW_FRAMES = 30;
+// Step down when a window averages above budget * DOWNGRADE; step up only
+// after UPGRADE_WINDOWS consecutive windows below budget * UPGRADE, so the
+// level does not oscillate around the budget.
+const double QUALITY_DOWNGRADE_RATIO = 1.05;
+const double QUALITY_UPGRADE_RATIO = 0.7;
+const int QUALITY_UPGRADE_WINDOWS = 4;
+// Windows to wait after any change before judging its effect.
+const int QUALITY_COOLDOWN_WINDOWS = 2;
+
+// Timer queries in flight; results are read a few frames late so reading
+// them never waits on the GPU.
+const int FRAME_TIMER_QUERIES = 4;
+
+// CPU time of a frame's work, and GPU time when timer queries are
+// available (GL 3.3); a frame costs the larger of the two.
+class FrameTimer {
+public:
+	FrameTimer();
+	void begin();
+	void end();
+	bool collect(double& frameMs);
+
+private:
+	GLuint queries[FRAME_TIMER_QUERIES];
+	double cpuMs[FRAME_TIMER_QUERIES];
+	int issued;
+	int collected;
+	bool initialized;
+	bool useQueries;
+	std::chrono::steady_clock::time_point started;
+};
+
+FrameTimer::FrameTimer() : issued(0), collected(0), initialized(false), useQueries(false) {
+	for (int i = 0; i < FRAME_TIMER_QUERIES; i++)
+	{
+		queries[i] = 0;
+		cpuMs[i] = 0;
+	}
+}
+
+void FrameTimer::begin() {
+	if (!initialized)
+	{
+		initialized = true;
+		useQueries = GLEW_VERSION_3_3 != 0;
+		if (useQueries)
+			glGenQueries(FRAME_TIMER_QUERIES, queries);
+	}
+	// With every query still in flight, skip timing this frame on the GPU.
+	started = std::chrono::steady_clock::now();
+	if (useQueries && issued - collected < FRAME_TIMER_QUERIES)
+		glBeginQuery(GL_TIME_ELAPSED, queries[issued % FRAME_TIMER_QUERIES]);
+}
+
+void FrameTimer::end() {
+	double cpu = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+	if (!useQueries)
+	{
+		cpuMs[0] = cpu;
+		issued++;
+		return;
+	}
+	if (issued - collected < FRAME_TIMER_QUERIES)
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+		cpuMs[issued % FRAME_TIMER_QUERIES] = cpu;
+		issued++;
+	}
+}
+
+// The cost of the oldest frame whose measurements are complete, if any.
+bool FrameTimer::collect(double& frameMs) {
+	if (collected == issued)
+		return false;
+	if (!useQueries)
+	{
+		frameMs = cpuMs[0];
+		collected = issued;
+		return true;
+	}
+	GLuint query = queries[collected % FRAME_TIMER_QUERIES];
+	GLint available = 0;
+	glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+		return false;
+	GLuint64 gpuNs = 0;
+	glGetQueryObjectui64v(query, GL_QUERY_RESULT, &gpuNs);
+	double gpu = gpuNs / 1.0e6;
+	double cpu = cpuMs[collected % FRAME_TIMER_QUERIES];
+	frameMs = gpu > cpu ? gpu : cpu;
+	collected++;
+	return true;
+}
+
+// Averages frame costs over windows and moves one level at a time.
+class QualityGovernor {
+public:
+	QualityGovernor();
+	void setBudget(double milliseconds);
+	double budget() const;
+	bool frameFinished(double frameMs);
+	int level() const;
+	const QualitySettings& settings() const;
+	const std::string& reason() const;
+
+private:
+	double budgetMs;
+	double windowTotal;
+	int windowFrames;
+	int currentLevel;
+	int calmWindows;
+	int cooldown;
+	std::string lastReason;
+};
+
+QualityGovernor::QualityGovernor()
+	: budgetMs(0), windowTotal(0), windowFrames(0), currentLevel(0), calmWindows(0), cooldown(0) {
+}
+
+// A budget of 0 turns the governor off and restores full quality.
+void QualityGovernor::setBudget(double milliseconds) {
+	budgetMs = milliseconds;
+	if (budgetMs <= 0)
+		currentLevel = 0;
+}
+
+double QualityGovernor::budget() const {
+	return budgetMs;
+}
+
+// Returns true when the level changed; reason() then says why.
+bool QualityGovernor::frameFinished(double frameMs) {
+	if (budgetMs <= 0)
+		return false;
+	windowTotal += frameMs;
+	if (++windowFrames < QUALITY_WINDOW_FRAMES)
+		return false;
+	double mean = windowTotal / windowFrames;
+	windowTotal = 0;
+	windowFrames = 0;
+	if (cooldown > 0)
+	{
+		cooldown--;
+		return false;
+	}
+
+	char text[128];
+	if (mean > budgetMs * QUALITY_DOWNGRADE_RATIO)
+	{
+		calmWindows = 0;
+		if (currentLevel == NUM_QUALITY_LEVELS - 1)
+			return false;
+		currentLevel++;
+		snprintf(text, sizeof(text), "mean frame %.1f ms over the %.1f ms budget", mean, budgetMs);
+	}
+	else if (mean < budgetMs * QUALITY_UPGRADE_RATIO && currentLevel > 0)
+	{
+		if (++calmWindows < QUALITY_UPGRADE_WINDOWS)
+			return false;
+		calmWindows = 0;
+		currentLevel--;
+		snprintf(text, sizeof(text), "mean frame %.1f ms under %.0f%% of the %.1f ms budget for %d windows",
+			mean, QUALITY_UPGRADE_RATIO * 100, budgetMs, QUALITY_UPGRADE_WINDOWS);
+	}
+	else
+	{
+		calmWindows = 0;
+		return false;
+	}
+	cooldown = QUALITY_COOLDOWN_WINDOWS;
+	lastReason = text;
+	return true;
+}
+
+int QualityGovernor::level() const {
+	return currentLevel;
+}
+
+const QualitySettings& QualityGovernor::settings() const {
+	return QUALITY_LEVELS[currentLevel];
+}
+
+const std::string& QualityGovernor::reason() const {
+	return lastReason;
+}
+
+#endif
@@ -0,0 +1,86 @@
+//////////////////////////////////////////////////////
+// RenderTarget.h - Offscreen color/depth target    //
+// for drawing the 3D views at a reduced resolution //
+// and upscaling them into the window.              //
+//////////////////////////////////////////////////////
+
+#ifndef _H_RENDER_TARGET_
+#define _H_RENDER_TARGET_
+
+class RenderTarget {
+public:
+	RenderTarget();
+	~RenderTarget();
+	bool supported() const;
+	bool resize(GLsizei targetWidth, GLsizei targetHeight);
+	void bind();
+	void resolve(GLint x, GLint y, GLsizei w, GLsizei h);
+	GLsizei width() const { return size[0]; }
+	GLsizei height() const { return size[1]; }
+
+private:
+	GLuint framebuffer;
+	GLuint color;
+	GLuint depth;
+	GLsizei size[2];
+
+	RenderTarget(const RenderTarget&);
+	RenderTarget& operator=(const RenderTarget&);
+};
+
+RenderTarget::RenderTarget() : framebuffer(0), color(0), depth(0) {
+	size[0] = size[1] = 0;
+}
+
+RenderTarget::~RenderTarget() {
+	// The context is normally gone by now; nothing to release.
+}
+
+// Framebuffer objects are core in GL 3.0 and an extension before that.
+bool RenderTarget::supported() const {
+	return GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object;
+}
+
+// (Re)allocate the attachments when the size changes. Returns false if the
+// target cannot be used, in which case the caller draws to the window.
+bool RenderTarget::resize(GLsizei targetWidth, GLsizei targetHeight) {
+	if (!supported() || targetWidth <= 0 || targetHeight <= 0)
+		return false;
+	if (framebuffer != 0 && size[0] == targetWidth && size[1] == targetHeight)
+		return true;
+	if (framebuffer == 0)
+	{
+		glGenFramebuffers(1, &framebuffer);
+		glGenRenderbuffers(1, &color);
+		glGenRenderbuffers(1, &depth);
+	}
+	glBindRenderbuffer(GL_RENDERBUFFER, color);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, targetWidth, targetHeight);
+	glBindRenderbuffer(GL_RENDERBUFFER, depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, targetWidth, targetHeight);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	size[0] = complete ? targetWidth : 0;
+	size[1] = complete ? targetHeight : 0;
+	return complete;
+}
+
+void RenderTarget::bind() {
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+// Stretch the whole target over a rectangle of the window's back buffer
+// and make the window the draw target again.
+void RenderTarget::resolve(GLint x, GLint y, GLsizei w, GLsizei h) {
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glBlitFramebuffer(0, 0, size[0], size[1], x, y, x + w, y + h, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+#endif
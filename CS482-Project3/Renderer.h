@@ -0,0 +1,82 @@
+//////////////////////////////////////////////////////
+// Renderer.h - Rendering backend interface shared  //
+// by the fixed-function and shader renderers.      //
+//////////////////////////////////////////////////////
+
+#ifndef _H_RENDERER_
+#define _H_RENDERER_
+
+#include <iostream>
+#include "Mesh.h"
+#include "Matrix.h"
+
+// Terrain chunks each own one slot, TERRAIN_MESH + slot.
+const int TERRAIN_MESH_SLOTS = 64;
+enum MESH_ID { CUBE_MESH, CONE_MESH, SPHERE_MESH, TRACK_MESH, TERRAIN_MESH,
+	NUM_MESHES = TERRAIN_MESH + TERRAIN_MESH_SLOTS };
+enum MATERIAL_ID { ROAD_MATERIAL, RAIL_MATERIAL, MARKER_MATERIAL, GRASS_MATERIAL,
+	TREE_MATERIAL, VEHICLE_MATERIAL, TIRE_MATERIAL, NUM_MATERIALS };
+
+// Same terms as glMaterialfv(GL_FRONT, ...).
+struct Material {
+	GLfloat ambient[4];
+	GLfloat diffuse[4];
+	GLfloat specular[4];
+	GLfloat emission[4];
+	GLfloat shininess;
+};
+
+// Everything gluPerspective and gluLookAt need for one view.
+struct Camera {
+	GLfloat eye[3];
+	GLfloat center[3];
+	GLfloat up[3];
+	GLfloat fovy;
+	GLfloat aspect;
+	GLfloat zNear;
+	GLfloat zFar;
+};
+
+// Per-instance data; the model matrix is column-major like glMultMatrixf.
+struct InstanceData {
+	GLfloat model[16];
+};
+
+class Renderer {
+public:
+	virtual ~Renderer() {}
+	virtual const char* name() = 0;
+	// Returns false if the backend cannot run on the current context.
+	virtual bool initialize() = 0;
+	virtual void uploadMesh(MESH_ID id, const MeshData& mesh) = 0;
+	// Re-uploads verticies [firstVertex, firstVertex + vertexCount) of a mesh
+	// previously passed to uploadMesh; the index list must be unchanged.
+	virtual void updateMeshRange(MESH_ID id, const MeshData& mesh, int firstVertex, int vertexCount) = 0;
+	virtual void defineMaterial(MATERIAL_ID id, const Material& material) = 0;
+	// Sets the projection, view and light for the draws that follow.
+	virtual void beginFrame(const Camera& camera) = 0;
+	virtual void setMaterial(MATERIAL_ID id) = 0;
+	virtual void drawMesh(MESH_ID id, const GLfloat model[16]) = 0;
+	virtual void drawInstanced(MESH_ID id, const InstanceData* instances, int count) = 0;
+	// Leaves the context ready for the fixed-function display panel.
+	virtual void endFrame() = 0;
+	// Called once per displayed frame, after every view has been drawn.
+	virtual void finishFrame() = 0;
+	virtual void report(std::ostream& out) = 0;
+};
+
+// Material whose ambient, diffuse and specular terms all share one color,
+// which is how every object in the scene has always been lit.
+Material MakeMaterial(const GLfloat color[4], GLfloat shininess, bool emissive)
+{
+	Material material;
+	for (int i = 0; i < 4; i++)
+	{
+		material.ambient[i] = material.diffuse[i] = material.specular[i] = color[i];
+		material.emission[i] = emissive ? color[i] : 0.0f;
+	}
+	material.shininess = shininess;
+	return material;
+}
+
+#endif
@@ -0,0 +1,362 @@
+//////////////////////////////////////////////////////
+// SceneCache.h - Track mesh and tables saved to a  //
+// checksummed binary file and memory-mapped back   //
+// on later launches with the same inputs.          //
+//////////////////////////////////////////////////////
+
+#ifndef _H_SCENE_CACHE_
+#define _H_SCENE_CACHE_
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include "TrackAssets.h"
+#include "Trace.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Bump SCENE_CACHE_VERSION whenever the layout or anything that produces
+// the cached data (tessellation, vertex-cache ordering, the built-in
+// track's curve) changes, so stale caches are rebuilt.
+const char SCENE_CACHE_MAGIC[8] = { 'C', 'D', 'S', 'C', 'E', 'N', 'E', '1' };
+const uint32_t SCENE_CACHE_VERSION = 1;
+
+// File layout (native byte order; the key covers the layout):
+//   SceneCacheHeader
+//   payload: SceneCacheTrackInfo, then arrays, each padded to 8 bytes:
+//     corners[4 * samples]      GLfloatPoint   (Track vertex arena)
+//     verticies[vertexCount]    MeshVertex
+//     indices[indexCount]       GLuint
+//     points[samples], directions[samples]   GLfloatPoint
+//     localDistance[samples]    double
+//     segmentStart[segments + 1] int
+//     segmentLength[segments]   double
+struct SceneCacheHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSize;
+	uint64_t key;
+	uint64_t payloadSize;
+	uint64_t checksum;
+};
+
+struct SceneCacheTrackInfo {
+	int32_t samples;
+	int32_t segments;
+	int32_t vertexCount;
+	int32_t indexCount;
+	double width;
+	double thickness;
+	double acmrBefore;
+	double acmrAfter;
+};
+
+// FNV-1a style mixing, a 64-bit word at a time so a multi-megabyte
+// payload verifies in well under a millisecond.
+uint64_t SceneCacheMix(uint64_t hash, uint64_t word) {
+	hash ^= word;
+	hash *= 1099511628211ULL;
+	return hash ^ (hash >> 29);
+}
+
+uint64_t SceneCacheChecksum(const char* data, size_t size) {
+	uint64_t hash = 14695981039346656037ULL;
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8)
+	{
+		uint64_t word;
+		memcpy(&word, data + i, 8);
+		hash = SceneCacheMix(hash, word);
+	}
+	uint64_t tail = 0;
+	memcpy(&tail, data + i, size - i);
+	return SceneCacheMix(hash, tail ^ size);
+}
+
+// Everything the cached data depends on. definitionHash is the hash of
+// the track definition text (0 for the built-in track).
+uint64_t SceneCacheKey(unsigned long long definitionHash, int samples, double width, double thickness) {
+	uint64_t key = 14695981039346656037ULL;
+	uint64_t bits;
+	key = SceneCacheMix(key, SCENE_CACHE_VERSION);
+	key = SceneCacheMix(key, definitionHash);
+	key = SceneCacheMix(key, (uint64_t)samples);
+	memcpy(&bits, &width, 8);
+	key = SceneCacheMix(key, bits);
+	memcpy(&bits, &thickness, 8);
+	key = SceneCacheMix(key, bits);
+	key = SceneCacheMix(key, (sizeof(GLfloatPoint) << 16) | (sizeof(MeshVertex) << 8) | sizeof(GLuint));
+	key = SceneCacheMix(key, SAMPLES_PER_SEGMENT);
+	return key;
+}
+
+// Read-only view of a whole file; empty if it cannot be mapped.
+class MappedFile {
+public:
+	MappedFile();
+	~MappedFile();
+	bool open(const std::string& path);
+	void close();
+	const char* data() const;
+	size_t size() const;
+
+private:
+	const char* bytes;
+	size_t length;
+#if defined(_WIN32)
+	HANDLE file;
+	HANDLE mapping;
+#endif
+
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+};
+
+#if defined(_WIN32)
+
+MappedFile::MappedFile() : bytes(NULL), length(0), file(INVALID_HANDLE_VALUE), mapping(NULL) {
+}
+
+bool MappedFile::open(const std::string& path) {
+	close();
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping != NULL)
+		bytes = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (bytes == NULL)
+	{
+		close();
+		return false;
+	}
+	length = (size_t)fileSize.QuadPart;
+	return true;
+}
+
+void MappedFile::close() {
+	if (bytes != NULL)
+		UnmapViewOfFile(bytes);
+	if (mapping != NULL)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+	bytes = NULL;
+	length = 0;
+	mapping = NULL;
+	file = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+MappedFile::MappedFile() : bytes(NULL), length(0) {
+}
+
+bool MappedFile::open(const std::string& path) {
+	close();
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat info;
+	if (fstat(fd, &info) == 0 && info.st_size > 0)
+	{
+		void* view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (view != MAP_FAILED)
+		{
+			bytes = (const char*)view;
+			length = (size_t)info.st_size;
+		}
+	}
+	::close(fd);
+	return bytes != NULL;
+}
+
+void MappedFile::close() {
+	if (bytes != NULL)
+		munmap((void*)bytes, length);
+	bytes = NULL;
+	length = 0;
+}
+
+#endif
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+const char* MappedFile::data() const {
+	return bytes;
+}
+
+size_t MappedFile::size() const {
+	return length;
+}
+
+// Appends arrays to the payload, keeping each one 8-byte aligned.
+class SceneCacheWriter {
+public:
+	std::vector<char> payload;
+
+	template <typename T>
+	void put(const T* items, size_t count) {
+		size_t offset = payload.size();
+		size_t bytes = count * sizeof(T);
+		payload.resize(offset + ((bytes + 7) & ~size_t(7)), 0);
+		if (bytes > 0)
+			memcpy(&payload[offset], items, bytes);
+	}
+};
+
+// Walks a mapped payload; every take() is bounds-checked.
+class SceneCacheReader {
+public:
+	SceneCacheReader(const char* payload, size_t size) : cursor(payload), end(payload + size) {}
+
+	template <typename T>
+	bool take(const T*& items, size_t count) {
+		size_t bytes = count * sizeof(T);
+		size_t padded = (bytes + 7) & ~size_t(7);
+		if (padded > size_t(end - cursor))
+			return false;
+		items = (const T*)cursor;
+		cursor += padded;
+		return true;
+	}
+
+	template <typename T>
+	bool take(std::vector<T>& items, size_t count) {
+		const T* source;
+		if (!take(source, count))
+			return false;
+		items.assign(source, source + count);
+		return true;
+	}
+
+private:
+	const char* cursor;
+	const char* end;
+};
+
+// Write the track's mesh and tables to path, replacing any older cache only
+// once the new one is complete.
+bool SaveSceneCache(const std::string& path, uint64_t key, const TrackAssets& assets) {
+	TRACE_FUNCTION();
+	const ArcLengthTable& table = assets.arcLength;
+	const MeshData& mesh = assets.mesh.mesh;
+	VertexView corners = assets.track->verticies();
+	SceneCacheTrackInfo info;
+	memset(&info, 0, sizeof(info));
+	info.samples = assets.samples;
+	info.segments = table.segmentCount();
+	info.vertexCount = (int32_t)mesh.verticies.size();
+	info.indexCount = (int32_t)mesh.indices.size();
+	info.width = assets.width;
+	info.thickness = assets.thickness;
+	info.acmrBefore = assets.mesh.acmrBefore;
+	info.acmrAfter = assets.mesh.acmrAfter;
+	if (info.samples <= 0 || info.vertexCount == 0 || corners.count != TRACK_CORNERS * info.samples)
+		return false;
+
+	SceneCacheWriter writer;
+	writer.put(&info, 1);
+	writer.put(corners.data, corners.count);
+	writer.put(&mesh.verticies[0], mesh.verticies.size());
+	writer.put(&mesh.indices[0], mesh.indices.size());
+	writer.put(&table.points[0], table.points.size());
+	writer.put(&table.directions[0], table.directions.size());
+	writer.put(&table.localDistance[0], table.localDistance.size());
+	writer.put(&table.segmentStart[0], table.segmentStart.size());
+	writer.put(&table.segmentLength[0], table.segmentLength.size());
+
+	SceneCacheHeader header;
+	memcpy(header.magic, SCENE_CACHE_MAGIC, sizeof(header.magic));
+	header.version = SCENE_CACHE_VERSION;
+	header.headerSize = sizeof(SceneCacheHeader);
+	header.key = key;
+	header.payloadSize = writer.payload.size();
+	header.checksum = SceneCacheChecksum(&writer.payload[0], writer.payload.size());
+
+	const std::string temporary = path + ".tmp";
+	{
+		std::ofstream out(temporary.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		out.write((const char*)&header, sizeof(header));
+		out.write(&writer.payload[0], writer.payload.size());
+		if (!out)
+			return false;
+	}
+	// Replace the old cache in one step, so a crash or a concurrent load
+	// sees either the old file or the new one, never neither.
+#if defined(_WIN32)
+	bool replaced = MoveFileExA(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	bool replaced = rename(temporary.c_str(), path.c_str()) == 0;
+#endif
+	if (!replaced)
+		remove(temporary.c_str());
+	return replaced;
+}
+
+// Fill assets (whose track must already be constructed) from the cache at
+// path. Returns false, leaving assets to be rebuilt, if the file is
+// missing, was made from other inputs, or is damaged.
+bool LoadSceneCache(const std::string& path, uint64_t key, TrackAssets& assets) {
+	TRACE_FUNCTION();
+	MappedFile file;
+	if (!file.open(path) || file.size() < sizeof(SceneCacheHeader))
+		return false;
+	SceneCacheHeader header;
+	memcpy(&header, file.data(), sizeof(header));
+	if (memcmp(header.magic, SCENE_CACHE_MAGIC, sizeof(header.magic)) != 0 || header.version != SCENE_CACHE_VERSION
+		|| header.headerSize != sizeof(SceneCacheHeader) || header.key != key
+		|| header.payloadSize != file.size() - sizeof(SceneCacheHeader))
+		return false;
+	const char* payload = file.data() + sizeof(SceneCacheHeader);
+	if (SceneCacheChecksum(payload, (size_t)header.payloadSize) != header.checksum)
+		return false;
+
+	SceneCacheReader reader(payload, (size_t)header.payloadSize);
+	const SceneCacheTrackInfo* info;
+	if (!reader.take(info, 1) || info->samples <= 0 || info->segments <= 0 || info->vertexCount <= 0)
+		return false;
+	const GLfloatPoint* corners;
+	ArcLengthTable& table = assets.arcLength;
+	MeshData& mesh = assets.mesh.mesh;
+	if (!reader.take(corners, TRACK_CORNERS * info->samples)
+		|| !reader.take(mesh.verticies, info->vertexCount)
+		|| !reader.take(mesh.indices, info->indexCount)
+		|| !reader.take(table.points, info->samples)
+		|| !reader.take(table.directions, info->samples)
+		|| !reader.take(table.localDistance, info->samples)
+		|| !reader.take(table.segmentStart, info->segments + 1)
+		|| !reader.take(table.segmentLength, info->segments))
+		return false;
+
+	assets.samples = info->samples;
+	assets.width = info->width;
+	assets.thickness = info->thickness;
+	assets.track->adoptVerticies(corners, info->samples, info->width, info->thickness);
+	assets.mesh.numSamples = info->samples;
+	assets.mesh.acmrBefore = info->acmrBefore;
+	assets.mesh.acmrAfter = info->acmrAfter;
+	table.rebuildLengthTree();
+	assets.buildDerived();
+	return true;
+}
+
+#endif
@@ -0,0 +1,339 @@
+//////////////////////////////////////////////////////
+// ShaderRenderer.h - OpenGL 3.3 core-profile       //
+// backend with uniform and instance buffers.       //
+//////////////////////////////////////////////////////
+
+#ifndef _H_SHADER_RENDERER_
+#define _H_SHADER_RENDERER_
+
+#include <iostream>
+#include <vector>
+#include "Renderer.h"
+#include "PackedVertex.h"
+#include "StreamBuffer.h"
+
+// Uniform block bindings shared by both shader stages.
+const GLuint FRAME_BLOCK_BINDING = 0;
+const GLuint MATERIAL_BLOCK_BINDING = 1;
+
+// Instance attributes occupy locations 2-5 (one per matrix column).
+const GLuint INSTANCE_ATTRIBUTE_LOCATION = 2;
+
+// Per-frame region sizes of the streams; a frame that needs more grows them.
+const GLsizeiptr FRAME_STREAM_REGION = 16 * 1024;
+const GLsizeiptr INSTANCE_STREAM_REGION = 1024 * 1024;
+const GLint INSTANCE_STREAM_ALIGNMENT = 16;
+
+// Reproduces the fixed-function lighting equation for one directional
+// light given in eye coordinates, with the default 0.2 global ambient.
+// Verticies arrive packed (see PackedVertex.h); decodeScale/decodeOffset
+// map the quantized position back into the mesh's bounding box.
+const char* const SCENE_VERTEX_SHADER =
+"#version 330 core\n"
+"layout(std140) uniform FrameBlock {\n"
+"	mat4 projection;\n"
+"	mat4 view;\n"
+"	vec4 lightPosition;\n"
+"	vec4 lightIntensity;\n"
+"};\n"
+"uniform vec3 decodeScale;\n"
+"uniform vec3 decodeOffset;\n"
+"layout(location = 0) in vec3 position;\n"
+"layout(location = 1) in vec4 normal;\n"
+"layout(location = 2) in mat4 model;\n"
+"out vec3 eyePosition;\n"
+"out vec3 eyeNormal;\n"
+"void main() {\n"
+"	mat4 modelView = view * model;\n"
+"	vec4 p = modelView * vec4(decodeOffset + decodeScale * position, 1.0);\n"
+"	eyePosition = p.xyz;\n"
+"	eyeNormal = transpose(inverse(mat3(modelView))) * (normal.xyz / 511.0);\n"
+"	gl_Position = projection * p;\n"
+"}\n";
+
+const char* const SCENE_FRAGMENT_SHADER =
+"#version 330 core\n"
+"layout(std140) uniform FrameBlock {\n"
+"	mat4 projection;\n"
+"	mat4 view;\n"
+"	vec4 lightPosition;\n"
+"	vec4 lightIntensity;\n"
+"};\n"
+"layout(std140) uniform MaterialBlock {\n"
+"	vec4 ambient;\n"
+"	vec4 diffuse;\n"
+"	vec4 specular;\n"
+"	vec4 emission;\n"
+"	float shininess;\n"
+"};\n"
+"in vec3 eyePosition;\n"
+"in vec3 eyeNormal;\n"
+"out vec4 fragColor;\n"
+"void main() {\n"
+"	vec3 n = normalize(eyeNormal);\n"
+"	vec3 l = normalize(lightPosition.w == 0.0 ? lightPosition.xyz : lightPosition.xyz - eyePosition);\n"
+"	float nDotL = max(dot(n, l), 0.0);\n"
+"	vec3 color = emission.rgb + 0.2 * ambient.rgb + nDotL * diffuse.rgb * lightIntensity.rgb;\n"
+"	if (nDotL > 0.0) {\n"
+"		vec3 h = normalize(l + vec3(0.0, 0.0, 1.0));\n"
+"		color += pow(max(dot(n, h), 0.0001), shininess) * specular.rgb;\n"
+"	}\n"
+"	fragColor = vec4(color, diffuse.a);\n"
+"}\n";
+
+// std140 image of FrameBlock.
+struct FrameUniforms {
+	GLfloat projection[16];
+	GLfloat view[16];
+	GLfloat lightPosition[4];
+	GLfloat lightIntensity[4];
+};
+
+// std140 image of MaterialBlock (Material already matches it).
+struct MaterialUniforms {
+	Material material;
+	GLfloat padding[3];
+};
+
+class ShaderRenderer : public Renderer {
+	GLuint program;
+	//frame uniforms (one block per view) and instance transforms
+	StreamBuffer frameStream;
+	StreamBuffer instanceStream;
+	GLint uniformAlignment;
+	GLuint materialBuffer;
+	GLint materialStride;
+	GLuint vertexArrays[NUM_MESHES];
+	GLuint vertexBuffers[NUM_MESHES];
+	GLuint indexBuffers[NUM_MESHES];
+	GLsizei indexCounts[NUM_MESHES];
+	QuantizationBox boxes[NUM_MESHES];
+	//staging for packing before an upload
+	std::vector<PackedVertex> packed;
+	GLint decodeScaleLocation;
+	GLint decodeOffsetLocation;
+
+public:
+	ShaderRenderer();
+	~ShaderRenderer();
+	const char* name() { return "shader (GL 3.3 core)"; }
+	bool initialize();
+	void uploadMesh(MESH_ID id, const MeshData& mesh);
+	void updateMeshRange(MESH_ID id, const MeshData& mesh, int firstVertex, int vertexCount);
+	void defineMaterial(MATERIAL_ID id, const Material& material);
+	void beginFrame(const Camera& camera);
+	void setMaterial(MATERIAL_ID id);
+	void drawMesh(MESH_ID id, const GLfloat model[16]);
+	void drawInstanced(MESH_ID id, const InstanceData* instances, int count);
+	void endFrame();
+	void finishFrame();
+	void report(std::ostream& out);
+
+private:
+	GLuint compileShader(GLenum type, const char* source);
+};
+
+ShaderRenderer::ShaderRenderer()
+	: program(0), uniformAlignment(1), materialBuffer(0), materialStride(0),
+	decodeScaleLocation(-1), decodeOffsetLocation(-1) {
+	for (int i = 0; i < NUM_MESHES; i++)
+	{
+		vertexArrays[i] = vertexBuffers[i] = indexBuffers[i] = 0;
+		indexCounts[i] = 0;
+	}
+}
+
+ShaderRenderer::~ShaderRenderer() {
+	if (program == 0)
+		return;
+	glDeleteVertexArrays(NUM_MESHES, vertexArrays);
+	glDeleteBuffers(NUM_MESHES, vertexBuffers);
+	glDeleteBuffers(NUM_MESHES, indexBuffers);
+	glDeleteBuffers(1, &materialBuffer);
+	glDeleteProgram(program);
+}
+
+GLuint ShaderRenderer::compileShader(GLenum type, const char* source) {
+	GLuint shader = glCreateShader(type);
+	glShaderSource(shader, 1, &source, NULL);
+	glCompileShader(shader);
+	GLint status;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+	if (!status)
+	{
+		char log[1024];
+		glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+		std::cerr << "Shader compile failed: " << log << std::endl;
+		glDeleteShader(shader);
+		return 0;
+	}
+	return shader;
+}
+
+bool ShaderRenderer::initialize() {
+	if (!GLEW_VERSION_3_3)
+		return false;
+
+	GLuint vertexShader = compileShader(GL_VERTEX_SHADER, SCENE_VERTEX_SHADER);
+	GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, SCENE_FRAGMENT_SHADER);
+	if (vertexShader == 0 || fragmentShader == 0)
+		return false;
+	program = glCreateProgram();
+	glAttachShader(program, vertexShader);
+	glAttachShader(program, fragmentShader);
+	glLinkProgram(program);
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+	GLint status;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (!status)
+	{
+		char log[1024];
+		glGetProgramInfoLog(program, sizeof(log), NULL, log);
+		std::cerr << "Shader link failed: " << log << std::endl;
+		glDeleteProgram(program);
+		program = 0;
+		return false;
+	}
+	glUniformBlockBinding(program, glGetUniformBlockIndex(program, "FrameBlock"), FRAME_BLOCK_BINDING);
+	glUniformBlockBinding(program, glGetUniformBlockIndex(program, "MaterialBlock"), MATERIAL_BLOCK_BINDING);
+	decodeScaleLocation = glGetUniformLocation(program, "decodeScale");
+	decodeOffsetLocation = glGetUniformLocation(program, "decodeOffset");
+
+	// All materials live in one buffer; each draw binds its own range.
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+	materialStride = (GLint)sizeof(MaterialUniforms);
+	materialStride = (materialStride + uniformAlignment - 1) / uniformAlignment * uniformAlignment;
+	glGenBuffers(1, &materialBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, materialBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, materialStride * NUM_MATERIALS, NULL, GL_STATIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	// Everything rewritten each frame streams through ring buffers.
+	frameStream.initialize("frame uniforms", FRAME_STREAM_REGION);
+	instanceStream.initialize("instances", INSTANCE_STREAM_REGION);
+
+	glGenVertexArrays(NUM_MESHES, vertexArrays);
+	glGenBuffers(NUM_MESHES, vertexBuffers);
+	glGenBuffers(NUM_MESHES, indexBuffers);
+	return true;
+}
+
+// The GPU copy is packed to half the size of MeshVertex, quantized in a
+// box fitted to the mesh; partial updates reuse the box.
+void ShaderRenderer::uploadMesh(MESH_ID id, const MeshData& mesh) {
+	boxes[id].fit(mesh);
+	PackVerticies(mesh, 0, (int)mesh.verticies.size(), boxes[id], packed);
+	CheckPackedPrecision(mesh, 0, boxes[id], packed);
+	glBindVertexArray(vertexArrays[id]);
+
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffers[id]);
+	glBufferData(GL_ARRAY_BUFFER, packed.size() * sizeof(PackedVertex),
+		packed.empty() ? NULL : &packed[0], GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_SHORT, GL_FALSE, sizeof(PackedVertex), (const void*)0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_FALSE, sizeof(PackedVertex),
+		(const void*)(4 * sizeof(GLshort)));
+
+	// The instance attributes are pointed into the stream at each draw.
+	for (GLuint column = 0; column < 4; column++)
+	{
+		GLuint location = INSTANCE_ATTRIBUTE_LOCATION + column;
+		glEnableVertexAttribArray(location);
+		glVertexAttribDivisor(location, 1);
+	}
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffers[id]);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(GLuint),
+		mesh.indices.empty() ? NULL : &mesh.indices[0], GL_STATIC_DRAW);
+	indexCounts[id] = (GLsizei)mesh.indices.size();
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void ShaderRenderer::updateMeshRange(MESH_ID id, const MeshData& mesh, int firstVertex, int vertexCount) {
+	if (vertexCount <= 0)
+		return;
+	// An edit that leaves the quantization box needs a new box for the whole mesh.
+	if (!PackVerticies(mesh, firstVertex, vertexCount, boxes[id], packed))
+	{
+		uploadMesh(id, mesh);
+		return;
+	}
+	CheckPackedPrecision(mesh, firstVertex, boxes[id], packed);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffers[id]);
+	glBufferSubData(GL_ARRAY_BUFFER, firstVertex * sizeof(PackedVertex), vertexCount * sizeof(PackedVertex),
+		&packed[0]);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void ShaderRenderer::defineMaterial(MATERIAL_ID id, const Material& material) {
+	MaterialUniforms uniforms;
+	uniforms.material = material;
+	glBindBuffer(GL_UNIFORM_BUFFER, materialBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, id * materialStride, sizeof(uniforms), &uniforms);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void ShaderRenderer::beginFrame(const Camera& camera) {
+	FrameUniforms uniforms;
+	MatrixPerspective(uniforms.projection, camera.fovy, camera.aspect, camera.zNear, camera.zFar);
+	MatrixLookAt(uniforms.view, camera.eye, camera.center, camera.up);
+	for (int i = 0; i < 4; i++)
+	{
+		uniforms.lightPosition[i] = LIGHT_POSITION[i];
+		uniforms.lightIntensity[i] = LIGHT_INTENSITY[i];
+	}
+	GLintptr offset = frameStream.upload(&uniforms, sizeof(uniforms), uniformAlignment);
+	glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, frameStream.buffer(), offset, sizeof(uniforms));
+
+	glUseProgram(program);
+}
+
+void ShaderRenderer::setMaterial(MATERIAL_ID id) {
+	glBindBufferRange(GL_UNIFORM_BUFFER, MATERIAL_BLOCK_BINDING, materialBuffer,
+		id * materialStride, sizeof(MaterialUniforms));
+}
+
+void ShaderRenderer::drawMesh(MESH_ID id, const GLfloat model[16]) {
+	drawInstanced(id, (const InstanceData*)model, 1);
+}
+
+void ShaderRenderer::drawInstanced(MESH_ID id, const InstanceData* instances, int count) {
+	if (count <= 0 || indexCounts[id] == 0)
+		return;
+
+	GLintptr offset = instanceStream.upload(instances, count * sizeof(InstanceData), INSTANCE_STREAM_ALIGNMENT);
+
+	glUniform3fv(decodeScaleLocation, 1, boxes[id].decodeScale);
+	glUniform3fv(decodeOffsetLocation, 1, boxes[id].decodeOffset);
+	glBindVertexArray(vertexArrays[id]);
+	glBindBuffer(GL_ARRAY_BUFFER, instanceStream.buffer());
+	for (GLuint column = 0; column < 4; column++)
+		glVertexAttribPointer(INSTANCE_ATTRIBUTE_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+			(const void*)(offset + column * 4 * sizeof(GLfloat)));
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glDrawElementsInstanced(GL_TRIANGLES, indexCounts[id], GL_UNSIGNED_INT, (const void*)0, count);
+	glBindVertexArray(0);
+}
+
+void ShaderRenderer::endFrame() {
+	glUseProgram(0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, MATERIAL_BLOCK_BINDING, 0);
+}
+
+void ShaderRenderer::finishFrame() {
+	frameStream.finishFrame();
+	instanceStream.finishFrame();
+}
+
+void ShaderRenderer::report(std::ostream& out) {
+	out << "Renderer: " << name() << std::endl;
+	frameStream.report(out);
+	instanceStream.report(out);
+}
+
+#endif
@@ -0,0 +1,466 @@
+//////////////////////////////////////////////////////
+// SharedState.h - Live vehicle and camera state in //
+// a named shared-memory segment, seqlocked so any  //
+// number of local readers can poll it.             //
+//////////////////////////////////////////////////////
+
+#ifndef _H_SHARED_STATE_
+#define _H_SHARED_STATE_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Bump SHARED_STATE_VERSION whenever the layout below changes.
+const char SHARED_STATE_MAGIC[8] = { 'C', 'D', 'S', 'T', 'A', 'T', 'E', '1' };
+const uint32_t SHARED_STATE_VERSION = 1;
+// A reader gives up after this many attempts that overlap a write (only
+// possible if the writer died mid-write).
+const int SHARED_STATE_READ_ATTEMPTS = 100000;
+// How often the reference reader prints, and how long the benchmark runs.
+const int SHARED_STATE_READER_MS = 100;
+const int SHARED_STATE_BENCH_MS = 2000;
+
+// Segment layout (native byte order, 256 bytes; offsets are fixed):
+//     0  magic[8], uint32 version, uint32 size
+//    64  uint32 vehicleSequence, padding, SharedVehicleState (48 bytes)
+//   128  uint32 cameraSequence, padding, SharedCameraState (48 bytes)
+// Each block has one writer: the simulation thread for the vehicle, the
+// render thread for the camera. A sequence is odd while its block is being
+// written; a reader copies the block between two reads of the sequence and
+// keeps the copy if both are the same even value.
+struct SharedVehicleState {
+	uint64_t tick;
+	//end of the last sub-step included, steady clock nanoseconds
+	int64_t time;
+	//odometer (miles) and distance along the current lap (world units)
+	double distanceTraveled;
+	double lapDistance;
+	float speed;
+	float laneOffset;
+	int32_t sideOfRoad;
+	uint32_t padding;
+};
+
+struct SharedCameraState {
+	uint64_t frame;
+	int32_t viewpoint;
+	int32_t splitScreen;
+	float eye[3];
+	float center[3];
+	uint32_t padding[2];
+};
+
+struct SharedStateHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t size;
+};
+
+struct SharedStateLayout {
+	SharedStateHeader header;
+	alignas(64) std::atomic<uint32_t> vehicleSequence;
+	alignas(8) SharedVehicleState vehicle;
+	alignas(64) std::atomic<uint32_t> cameraSequence;
+	alignas(8) SharedCameraState camera;
+};
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "shared sequences must be lock-free to work across processes");
+static_assert(sizeof(SharedVehicleState) == 48 && sizeof(SharedCameraState) == 48, "shared block size changed");
+static_assert(offsetof(SharedStateLayout, vehicleSequence) == 64 && offsetof(SharedStateLayout, vehicle) == 72,
+	"shared vehicle block moved");
+static_assert(offsetof(SharedStateLayout, cameraSequence) == 128 && offsetof(SharedStateLayout, camera) == 136,
+	"shared camera block moved");
+static_assert(sizeof(SharedStateLayout) == 192, "shared layout size changed");
+const size_t SHARED_STATE_SIZE = 256;
+
+// Writer side of a seqlock over a block of plain data.
+template <typename T>
+void SeqlockWrite(std::atomic<uint32_t>& sequence, T& block, const T& value)
+{
+	uint32_t s = sequence.load(std::memory_order_relaxed);
+	sequence.store(s + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(&block, &value, sizeof(T));
+	sequence.store(s + 2, std::memory_order_release);
+}
+
+// Reader side. Counts the attempts that overlapped a write in retries;
+// returns false if every attempt did.
+template <typename T>
+bool SeqlockRead(const std::atomic<uint32_t>& sequence, const T& block, T& value, unsigned long long& retries)
+{
+	for (int attempt = 0; attempt < SHARED_STATE_READ_ATTEMPTS; attempt++)
+	{
+		uint32_t before = sequence.load(std::memory_order_acquire);
+		if ((before & 1) == 0)
+		{
+			memcpy(&value, &block, sizeof(T));
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (sequence.load(std::memory_order_relaxed) == before)
+				return true;
+		}
+		retries++;
+	}
+	return false;
+}
+
+// A named segment of SHARED_STATE_SIZE bytes, created by the writer and
+// opened read-only by readers. POSIX names start with a slash, which is
+// added if missing; on Windows the name lives in the session namespace.
+class SharedMemory {
+public:
+	SharedMemory();
+	~SharedMemory();
+	bool create(const std::string& name, std::string& error);
+	bool open(const std::string& name, std::string& error);
+	void close();
+	void* data() const;
+
+private:
+	void* view;
+	bool owner;
+	std::string path;
+#if defined(_WIN32)
+	HANDLE mapping;
+#endif
+
+	SharedMemory(const SharedMemory&);
+	SharedMemory& operator=(const SharedMemory&);
+};
+
+#if defined(_WIN32)
+
+SharedMemory::SharedMemory() : view(NULL), owner(false), mapping(NULL) {
+}
+
+bool SharedMemory::create(const std::string& name, std::string& error) {
+	close();
+	path = "Local\\" + name;
+	mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, (DWORD)SHARED_STATE_SIZE, path.c_str());
+	if (mapping != NULL)
+		view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, SHARED_STATE_SIZE);
+	if (view == NULL)
+	{
+		error = "cannot create shared memory " + name;
+		close();
+		return false;
+	}
+	owner = true;
+	return true;
+}
+
+bool SharedMemory::open(const std::string& name, std::string& error) {
+	close();
+	path = "Local\\" + name;
+	mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, path.c_str());
+	if (mapping != NULL)
+		view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, SHARED_STATE_SIZE);
+	if (view == NULL)
+	{
+		error = "cannot open shared memory " + name;
+		close();
+		return false;
+	}
+	return true;
+}
+
+// The segment goes away with its last handle.
+void SharedMemory::close() {
+	if (view != NULL)
+		UnmapViewOfFile(view);
+	if (mapping != NULL)
+		CloseHandle(mapping);
+	view = NULL;
+	mapping = NULL;
+	owner = false;
+}
+
+#else
+
+SharedMemory::SharedMemory() : view(NULL), owner(false) {
+}
+
+bool SharedMemory::create(const std::string& name, std::string& error) {
+	close();
+	path = (!name.empty() && name[0] == '/') ? name : "/" + name;
+	int fd = shm_open(path.c_str(), O_CREAT | O_RDWR, 0644);
+	if (fd >= 0 && ftruncate(fd, (off_t)SHARED_STATE_SIZE) == 0)
+	{
+		void* mapped = mmap(NULL, SHARED_STATE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (mapped != MAP_FAILED)
+			view = mapped;
+	}
+	if (fd >= 0)
+		::close(fd);
+	if (view == NULL)
+	{
+		error = "cannot create shared memory " + path;
+		return false;
+	}
+	owner = true;
+	return true;
+}
+
+bool SharedMemory::open(const std::string& name, std::string& error) {
+	close();
+	path = (!name.empty() && name[0] == '/') ? name : "/" + name;
+	int fd = shm_open(path.c_str(), O_RDONLY, 0);
+	if (fd >= 0)
+	{
+		void* mapped = mmap(NULL, SHARED_STATE_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+		if (mapped != MAP_FAILED)
+			view = mapped;
+		::close(fd);
+	}
+	if (view == NULL)
+	{
+		error = "cannot open shared memory " + path;
+		return false;
+	}
+	return true;
+}
+
+// The creator removes the name; mappings already open stay valid.
+void SharedMemory::close() {
+	if (view != NULL)
+		munmap(view, SHARED_STATE_SIZE);
+	if (owner)
+		shm_unlink(path.c_str());
+	view = NULL;
+	owner = false;
+}
+
+#endif
+
+SharedMemory::~SharedMemory() {
+	close();
+}
+
+void* SharedMemory::data() const {
+	return view;
+}
+
+// The application's side: creates the segment, stamps the header and
+// publishes each block from its own thread. Publishing never waits.
+class SharedStateExport {
+public:
+	SharedStateExport();
+	bool start(const std::string& name, std::string& error);
+	void stop();
+	bool active() const;
+	void publishVehicle(const SharedVehicleState& vehicle);
+	void publishCamera(const SharedCameraState& camera);
+
+private:
+	SharedMemory memory;
+	SharedStateLayout* layout;
+};
+
+SharedStateExport::SharedStateExport() : layout(NULL) {
+}
+
+bool SharedStateExport::start(const std::string& name, std::string& error) {
+	if (!memory.create(name, error))
+		return false;
+	memset(memory.data(), 0, SHARED_STATE_SIZE);
+	layout = new (memory.data()) SharedStateLayout();
+	layout->vehicleSequence.store(0, std::memory_order_relaxed);
+	layout->cameraSequence.store(0, std::memory_order_relaxed);
+	memcpy(layout->header.magic, SHARED_STATE_MAGIC, sizeof(SHARED_STATE_MAGIC));
+	layout->header.version = SHARED_STATE_VERSION;
+	layout->header.size = (uint32_t)SHARED_STATE_SIZE;
+	std::atomic_thread_fence(std::memory_order_release);
+	return true;
+}
+
+void SharedStateExport::stop() {
+	layout = NULL;
+	memory.close();
+}
+
+bool SharedStateExport::active() const {
+	return layout != NULL;
+}
+
+// Simulation thread only.
+void SharedStateExport::publishVehicle(const SharedVehicleState& vehicle) {
+	SeqlockWrite(layout->vehicleSequence, layout->vehicle, vehicle);
+}
+
+// Render thread only.
+void SharedStateExport::publishCamera(const SharedCameraState& camera) {
+	SeqlockWrite(layout->cameraSequence, layout->camera, camera);
+}
+
+// A dashboard's side: maps the segment read-only and checks the header.
+// Reads are two loads and a copy; they never make a system call.
+class SharedStateReader {
+public:
+	SharedStateReader();
+	bool open(const std::string& name, std::string& error);
+	bool readVehicle(SharedVehicleState& vehicle);
+	bool readCamera(SharedCameraState& camera);
+	unsigned long long retries() const;
+
+private:
+	SharedMemory memory;
+	const SharedStateLayout* layout;
+	unsigned long long retryCount;
+};
+
+SharedStateReader::SharedStateReader() : layout(NULL), retryCount(0) {
+}
+
+bool SharedStateReader::open(const std::string& name, std::string& error) {
+	if (!memory.open(name, error))
+		return false;
+	layout = (const SharedStateLayout*)memory.data();
+	if (memcmp(layout->header.magic, SHARED_STATE_MAGIC, sizeof(SHARED_STATE_MAGIC)) != 0
+		|| layout->header.version != SHARED_STATE_VERSION || layout->header.size != SHARED_STATE_SIZE)
+	{
+		error = name + " is not a version " + std::to_string(SHARED_STATE_VERSION) + " state segment";
+		layout = NULL;
+		memory.close();
+		return false;
+	}
+	return true;
+}
+
+bool SharedStateReader::readVehicle(SharedVehicleState& vehicle) {
+	return SeqlockRead(layout->vehicleSequence, layout->vehicle, vehicle, retryCount);
+}
+
+bool SharedStateReader::readCamera(SharedCameraState& camera) {
+	return SeqlockRead(layout->cameraSequence, layout->camera, camera, retryCount);
+}
+
+unsigned long long SharedStateReader::retries() const {
+	return retryCount;
+}
+
+// Reference reader: print the live state every SHARED_STATE_READER_MS
+// until the process is interrupted. Returns only if the segment cannot be
+// opened.
+bool RunSharedStateReader(const std::string& name, std::string& error)
+{
+	static const char* VIEW_NAMES[] = { "driver", "infield", "outfield", "chase" };
+	SharedStateReader reader;
+	if (!reader.open(name, error))
+		return false;
+	std::cout << std::fixed << std::setprecision(2);
+	for (;;)
+	{
+		SharedVehicleState vehicle;
+		SharedCameraState camera;
+		if (reader.readVehicle(vehicle) && reader.readCamera(camera))
+			std::cout << "tick " << vehicle.tick << "  speed " << vehicle.speed << " MPH  distance "
+				<< vehicle.distanceTraveled << " miles  lap " << vehicle.lapDistance << "  lane " << vehicle.laneOffset
+				<< "  view " << (camera.viewpoint >= 0 && camera.viewpoint < 4 ? VIEW_NAMES[camera.viewpoint] : "?")
+				<< (camera.splitScreen ? " (split)" : "") << "  eye (" << camera.eye[0] << ", " << camera.eye[1]
+				<< ", " << camera.eye[2] << ")  retries " << reader.retries() << std::endl;
+		else
+			std::cout << "writer stopped mid-write" << std::endl;
+		std::this_thread::sleep_for(std::chrono::milliseconds(SHARED_STATE_READER_MS));
+	}
+}
+
+// Benchmark: one writer publishing vehicle blocks back to back, and the
+// given number of reader threads polling as fast as they can, each in its
+// own mapping of a private segment. Every field of a block the writer
+// publishes derives from one counter, so a torn read would show.
+bool RunSharedStateBenchmark(int readers, std::ostream& out, std::string& error)
+{
+	const std::string name = "circledrive-bench-" + std::to_string(
+		(unsigned long long)std::chrono::steady_clock::now().time_since_epoch().count());
+	SharedStateExport writer;
+	if (!writer.start(name, error))
+		return false;
+	if (readers < 1)
+		readers = 1;
+
+	std::atomic<bool> running(true);
+	std::vector<unsigned long long> reads(readers, 0), retries(readers, 0), torn(readers, 0);
+	std::vector<std::thread> threads;
+	for (int r = 0; r < readers; r++)
+		threads.push_back(std::thread([&, r]() {
+			SharedStateReader reader;
+			std::string readerError;
+			if (!reader.open(name, readerError))
+				return;
+			SharedVehicleState vehicle;
+			while (running.load(std::memory_order_relaxed))
+			{
+				if (!reader.readVehicle(vehicle))
+					continue;
+				reads[r]++;
+				if (vehicle.time != (int64_t)vehicle.tick * 3 || vehicle.lapDistance != (double)vehicle.tick)
+					torn[r]++;
+			}
+			retries[r] = reader.retries();
+		}));
+
+	SharedVehicleState vehicle;
+	memset(&vehicle, 0, sizeof(vehicle));
+	unsigned long long writes = 0;
+	int64_t slowest = 0;
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now(), now = begin;
+	while (now - begin < std::chrono::milliseconds(SHARED_STATE_BENCH_MS))
+	{
+		vehicle.tick = ++writes;
+		vehicle.time = (int64_t)writes * 3;
+		vehicle.lapDistance = (double)writes;
+		writer.publishVehicle(vehicle);
+		if ((writes & 1023) == 0)
+		{
+			// Time a single publish now and then, under full read load.
+			std::chrono::steady_clock::time_point before = std::chrono::steady_clock::now();
+			writer.publishVehicle(vehicle);
+			now = std::chrono::steady_clock::now();
+			int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now - before).count();
+			slowest = ns > slowest ? ns : slowest;
+		}
+	}
+	double seconds = std::chrono::duration<double>(now - begin).count();
+	running = false;
+	for (size_t t = 0; t < threads.size(); t++)
+		threads[t].join();
+	writer.stop();
+
+	unsigned long long totalReads = 0, totalRetries = 0, totalTorn = 0;
+	for (int r = 0; r < readers; r++)
+	{
+		totalReads += reads[r];
+		totalRetries += retries[r];
+		totalTorn += torn[r];
+	}
+	std::ios::fmtflags flags = out.flags();
+	out << std::fixed << std::setprecision(1) << "Shared state benchmark, " << readers << " reader(s), "
+		<< seconds << " s:" << std::endl
+		<< "  writer: " << writes / seconds / 1.0e6 << " M publishes/s (" << 1.0e9 * seconds / writes
+		<< " ns each, slowest sampled " << slowest << " ns)" << std::endl
+		<< "  readers: " << totalReads / seconds / 1.0e6 << " M reads/s total, " << totalReads / seconds / readers / 1.0e6
+		<< " M/s each, " << (totalReads + totalRetries > 0 ? 100.0 * totalRetries / (totalReads + totalRetries) : 0.0)
+		<< "% retried, " << totalTorn << " torn" << std::endl;
+	out.flags(flags);
+	return totalTorn == 0;
+}
+
+#endif
@@ -0,0 +1,108 @@
+//////////////////////////////////////////////////////
+// Simulation.h - Vehicle state and the sub-step    //
+// that advances it, shared by the windowed app and //
+// the headless batch simulator.                    //
+//////////////////////////////////////////////////////
+
+#ifndef _H_SIMULATION_
+#define _H_SIMULATION_
+
+#include "TrackAssets.h"
+
+// Everything the simulation advances about one vehicle. Progress is a lap
+// angle (2 PI per lap, i.e. a normalized distance), so a vehicle keeps
+// its place in the lap when the track is rebuilt or replaced.
+struct VehicleState {
+	GLfloat lapAngle;
+	//lap angle covered per REFRESH_RATE tick
+	GLfloat angleIncrement;
+	//odometer, in miles
+	GLfloat distanceTraveled;
+	GLfloat laneOffset;
+	SOR sideOfRoad;
+	bool movingLeft;
+	bool movingRight;
+};
+
+// What the driver can ask of the vehicle (the arrow keys).
+enum VEHICLE_COMMAND { ACCELERATE, DECELERATE, MOVE_LEFT, MOVE_RIGHT };
+
+// Put the vehicle at the start line at its initial speed and lane.
+void ResetVehicle(VehicleState& vehicle) {
+	vehicle.lapAngle = INITIAL_USER_ANGLE;
+	vehicle.angleIncrement = INITIAL_USER_ANGLE_INCREMENT;
+	vehicle.distanceTraveled = INITIAL_DISTANCE_TRAVELED;
+	vehicle.laneOffset = INITIAL_LANE_OFFSET;
+	vehicle.sideOfRoad = INITIAL_SIDE_OF_ROAD;
+	vehicle.movingLeft = false;
+	vehicle.movingRight = false;
+}
+
+void CommandVehicle(VehicleState& vehicle, VEHICLE_COMMAND command) {
+	switch (command)
+	{
+	case ACCELERATE: {
+		vehicle.angleIncrement *= USER_ANGLE_ACCELERATION_FACTOR;
+		if (vehicle.angleIncrement > MAX_USER_ANGLE_INCREMENT)
+			vehicle.angleIncrement = MAX_USER_ANGLE_INCREMENT;
+		break;
+	}
+	case DECELERATE: {
+		vehicle.angleIncrement /= USER_ANGLE_ACCELERATION_FACTOR;
+		if (vehicle.angleIncrement < MIN_USER_ANGLE_INCREMENT)
+			vehicle.angleIncrement = MIN_USER_ANGLE_INCREMENT;
+		break;
+	}
+	case MOVE_LEFT: {
+		vehicle.movingLeft = true;
+		vehicle.movingRight = false;
+		vehicle.sideOfRoad = TRANSITION;
+		break;
+	}
+	case MOVE_RIGHT: {
+		vehicle.movingLeft = false;
+		vehicle.movingRight = true;
+		vehicle.sideOfRoad = TRANSITION;
+		break;
+	}
+	}
+}
+
+// Advance the vehicle around the track by one sub-step and, if it is
+// changing lanes, across the road.
+void StepVehicle(VehicleState& vehicle) {
+	vehicle.lapAngle += vehicle.angleIncrement / SIMULATION_SUBSTEPS;
+	vehicle.distanceTraveled += TRACK_LENGTH_IN_MILES * (vehicle.angleIncrement / (2 * PI)) / SIMULATION_SUBSTEPS;
+	if (vehicle.movingRight)
+	{
+		vehicle.laneOffset += LANE_CHANGE_INCREMENT / SIMULATION_SUBSTEPS;
+		if (vehicle.laneOffset >= RIGHT_LANE_OFFSET)
+		{
+			vehicle.laneOffset = RIGHT_LANE_OFFSET;
+			vehicle.movingRight = false;
+			vehicle.sideOfRoad = RHS;
+		}
+	}
+	else if (vehicle.movingLeft)
+	{
+		vehicle.laneOffset -= LANE_CHANGE_INCREMENT / SIMULATION_SUBSTEPS;
+		if (vehicle.laneOffset <= LEFT_LANE_OFFSET)
+		{
+			vehicle.laneOffset = LEFT_LANE_OFFSET;
+			vehicle.movingLeft = false;
+			vehicle.sideOfRoad = LHS;
+		}
+	}
+}
+
+// The vehicle's velocity (in MPH).
+GLfloat VehicleSpeed(const VehicleState& vehicle) {
+	return TRACK_LENGTH_IN_MILES * MILLISECONDS_PER_HOUR * vehicle.angleIncrement / (2 * PI * REFRESH_RATE);
+}
+
+// Distance along a track corresponding to a lap angle.
+GLfloat LapDistance(const TrackAssets& assets, GLfloat lapAngle) {
+	return GLfloat(assets.arcLength.totalLength() * lapAngle / (2 * PI));
+}
+
+#endif
@@ -0,0 +1,309 @@
+//////////////////////////////////////////////////////
+// SimulationThread.h - Fixed-rate vehicle updates  //
+// on their own thread, published to the renderer   //
+// as versioned snapshots.                          //
+//////////////////////////////////////////////////////
+
+#ifndef _H_SIMULATION_THREAD_
+#define _H_SIMULATION_THREAD_
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include "Simulation.h"
+#include "InputQueue.h"
+#include "TripleBuffer.h"
+#include "Telemetry.h"
+#include "SharedState.h"
+#include "Trace.h"
+#include "AllocTracker.h"
+
+// Busy time and rate of one thread's loop. Written only by that thread,
+// readable from any other.
+class ThreadTiming {
+public:
+	ThreadTiming();
+	void begin();
+	void end();
+	void report(const char* name, std::ostream& out) const;
+
+private:
+	int64_t started;	//owner only
+	std::atomic<unsigned long long> iterations;
+	std::atomic<int64_t> firstStart;
+	std::atomic<int64_t> lastStart;
+	std::atomic<int64_t> busy;
+	std::atomic<int64_t> longest;
+};
+
+ThreadTiming::ThreadTiming() : started(0), iterations(0), firstStart(0), lastStart(0), busy(0), longest(0) {
+}
+
+void ThreadTiming::begin() {
+	started = InputClock();
+	if (iterations.load(std::memory_order_relaxed) == 0)
+		firstStart.store(started, std::memory_order_relaxed);
+	lastStart.store(started, std::memory_order_relaxed);
+}
+
+void ThreadTiming::end() {
+	int64_t elapsed = InputClock() - started;
+	busy.store(busy.load(std::memory_order_relaxed) + elapsed, std::memory_order_relaxed);
+	if (elapsed > longest.load(std::memory_order_relaxed))
+		longest.store(elapsed, std::memory_order_relaxed);
+	iterations.store(iterations.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+// Loop rate, mean and longest busy time per iteration, and the share of
+// wall time spent busy.
+void ThreadTiming::report(const char* name, std::ostream& out) const {
+	unsigned long long n = iterations.load(std::memory_order_acquire);
+	if (n == 0)
+	{
+		out << name << " thread: not started" << std::endl;
+		return;
+	}
+	double span = (lastStart.load(std::memory_order_relaxed) - firstStart.load(std::memory_order_relaxed)) / 1.0e6;
+	double busyMs = busy.load(std::memory_order_relaxed) / 1.0e6;
+	std::ios::fmtflags flags = out.flags();
+	std::streamsize precision = out.precision();
+	out << name << " thread: " << n << " iterations, " << std::fixed << std::setprecision(1)
+		<< (span > 0.0 ? 1000.0 * (n - 1) / span : 0.0) << " Hz, busy mean " << std::setprecision(3)
+		<< busyMs / n << " ms, max " << longest.load(std::memory_order_relaxed) / 1.0e6 << " ms ("
+		<< std::setprecision(1) << (span > 0.0 ? 100.0 * busyMs / span : 0.0) << "%)" << std::endl;
+	out.flags(flags);
+	out.precision(precision);
+}
+
+// What the renderer draws: the vehicle after every sub-step up to time.
+struct SimulationSnapshot {
+	unsigned long long version;
+	//end of the last sub-step included (InputClock nanoseconds)
+	int64_t time;
+	unsigned long long tick;
+	VehicleState vehicle;
+};
+
+// Runs SIMULATION_SUBSTEPS sub-steps per REFRESH_RATE tick on a thread of
+// its own, independent of the frame rate. Vehicle commands come in through
+// one lock-free queue and go back out, once applied, through another so the
+// renderer can time them to the frame that shows them. After each batch of
+// due sub-steps the state is published through a triple buffer; the
+// renderer takes the latest one whenever it starts a frame, and an
+// exporter, if given, gets a copy for processes outside this one.
+class SimulationThread {
+public:
+	SimulationThread();
+	~SimulationThread();
+	void start(const VehicleState& initial, TelemetryWriter* telemetry, SharedStateExport* exporter);
+	void stop();
+	bool command(VEHICLE_COMMAND command);
+	void setTrackLength(double length);
+	bool fresh() const;
+	bool acquire();
+	const SimulationSnapshot& latest() const;
+	bool takeApplied(int64_t before, InputEvent& event);
+	const ThreadTiming& timing() const;
+	unsigned long long droppedSubsteps() const;
+
+private:
+	void run();
+	void step();
+	void recordTelemetry();
+	void exportState(int64_t time);
+	double lapDistance() const;
+	std::thread worker;
+	std::atomic<bool> running;
+	//simulation thread only
+	VehicleState vehicle;
+	unsigned long long tick;
+	int substep;
+	unsigned long long version;
+	TelemetryWriter* telemetry;
+	SharedStateExport* exporter;
+	//input thread -> simulation thread, and simulation thread -> renderer
+	InputQueue commands;
+	InputQueue applied;
+	TripleBuffer<SimulationSnapshot> snapshots;
+	std::atomic<double> trackLength;
+	std::atomic<unsigned long long> dropped;
+	ThreadTiming loopTiming;
+
+	SimulationThread(const SimulationThread&);
+	SimulationThread& operator=(const SimulationThread&);
+};
+
+SimulationThread::SimulationThread()
+	: running(false), tick(0), substep(0), version(0), telemetry(NULL), exporter(NULL), trackLength(0.0), dropped(0) {
+	ResetVehicle(vehicle);
+}
+
+SimulationThread::~SimulationThread() {
+	stop();
+}
+
+// Publish the initial state, so the renderer has a snapshot before the
+// first sub-step, and start stepping.
+void SimulationThread::start(const VehicleState& initial, TelemetryWriter* telemetryWriter, SharedStateExport* stateExporter) {
+	vehicle = initial;
+	telemetry = telemetryWriter;
+	exporter = stateExporter;
+	SimulationSnapshot& snapshot = snapshots.back();
+	snapshot.version = ++version;
+	snapshot.time = InputClock();
+	snapshot.tick = tick;
+	snapshot.vehicle = vehicle;
+	snapshots.publish();
+	exportState(snapshot.time);
+	running.store(true, std::memory_order_release);
+	worker = std::thread(&SimulationThread::run, this);
+}
+
+void SimulationThread::stop() {
+	running.store(false, std::memory_order_release);
+	if (worker.joinable())
+		worker.join();
+}
+
+// Input thread only. A full queue drops the command.
+bool SimulationThread::command(VEHICLE_COMMAND command) {
+	return commands.push(VEHICLE_INPUT, command);
+}
+
+// Any thread. Telemetry distances are measured along a lap of this length.
+void SimulationThread::setTrackLength(double length) {
+	trackLength.store(length, std::memory_order_relaxed);
+}
+
+// Renderer only, like the rest of the snapshot side.
+bool SimulationThread::fresh() const {
+	return snapshots.fresh();
+}
+
+bool SimulationThread::acquire() {
+	return snapshots.acquire();
+}
+
+const SimulationSnapshot& SimulationThread::latest() const {
+	return snapshots.front();
+}
+
+// Commands applied in sub-steps ending by the given snapshot time, i.e.
+// those whose effect it shows.
+bool SimulationThread::takeApplied(int64_t before, InputEvent& event) {
+	return applied.popBefore(before, event);
+}
+
+const ThreadTiming& SimulationThread::timing() const {
+	return loopTiming;
+}
+
+// Sub-steps skipped after stalls too long to catch up on.
+unsigned long long SimulationThread::droppedSubsteps() const {
+	return dropped.load(std::memory_order_relaxed);
+}
+
+// Sleep until the next sub-step is due, run every sub-step that has come
+// due (applying commands at the start of each), then publish.
+void SimulationThread::run() {
+	TraceThreadName("simulation");
+	ALLOC_SCOPE(ALLOC_SIMULATION);
+	const int64_t SUBSTEP_NS = int64_t(SUBSTEP_MS) * 1000000;
+	int64_t nextSubstepTime = InputClock();
+	while (running.load(std::memory_order_acquire))
+	{
+		int64_t now = InputClock();
+		if (nextSubstepTime > now)
+		{
+			std::this_thread::sleep_until(std::chrono::steady_clock::time_point(
+				std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(nextSubstepTime))));
+			continue;
+		}
+
+		TRACE_SCOPE("simulate");
+		loopTiming.begin();
+		int steps = 0;
+		while (nextSubstepTime <= now && steps < MAX_CATCHUP_SUBSTEPS)
+		{
+			nextSubstepTime += SUBSTEP_NS;
+			InputEvent event;
+			while (commands.popBefore(nextSubstepTime, event))
+			{
+				CommandVehicle(vehicle, (VEHICLE_COMMAND)event.key);
+				applied.push(event);
+			}
+			step();
+			steps++;
+		}
+
+		SimulationSnapshot& snapshot = snapshots.back();
+		snapshot.version = ++version;
+		snapshot.time = nextSubstepTime;
+		snapshot.tick = tick;
+		snapshot.vehicle = vehicle;
+		snapshots.publish();
+		exportState(nextSubstepTime);
+
+		// After a long stall (e.g. the machine sleeping) drop the missed time.
+		if (nextSubstepTime <= now)
+		{
+			dropped.fetch_add((now - nextSubstepTime) / SUBSTEP_NS + 1, std::memory_order_relaxed);
+			nextSubstepTime = now + SUBSTEP_NS;
+		}
+		loopTiming.end();
+	}
+}
+
+void SimulationThread::step() {
+	StepVehicle(vehicle);
+	// Telemetry keeps one record per whole tick.
+	if (++substep == SIMULATION_SUBSTEPS)
+	{
+		substep = 0;
+		recordTelemetry();
+		tick++;
+	}
+}
+
+// Push this tick's vehicle state to the telemetry stream, if recording.
+void SimulationThread::recordTelemetry() {
+	if (telemetry == NULL || !telemetry->active())
+		return;
+	TelemetryRecord record;
+	record.tick = tick;
+	record.vehicle = 0;
+	record.distance = GLfloat(lapDistance());
+	record.speed = VehicleSpeed(vehicle);
+	record.laneOffset = vehicle.laneOffset;
+	record.sideOfRoad = (uint8_t)vehicle.sideOfRoad;
+	telemetry->record(record);
+}
+
+// Publish the vehicle as of the given time to the shared segment, if exporting.
+void SimulationThread::exportState(int64_t time) {
+	if (exporter == NULL || !exporter->active())
+		return;
+	SharedVehicleState state;
+	state.tick = tick;
+	state.time = time;
+	state.distanceTraveled = vehicle.distanceTraveled;
+	state.lapDistance = lapDistance();
+	state.speed = VehicleSpeed(vehicle);
+	state.laneOffset = vehicle.laneOffset;
+	state.sideOfRoad = (int32_t)vehicle.sideOfRoad;
+	state.padding = 0;
+	exporter->publishVehicle(state);
+}
+
+// Distance along the current lap, in [0, track length).
+double SimulationThread::lapDistance() const {
+	double length = trackLength.load(std::memory_order_relaxed);
+	double distance = length > 0.0 ? fmod(length * vehicle.lapAngle / (2 * PI), length) : 0.0;
+	return distance < 0.0 ? distance + length : distance;
+}
+
+#endif
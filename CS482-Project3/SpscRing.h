@@ -0,0 +1,88 @@
+//////////////////////////////////////////////////////
+// SpscRing.h - Bounded lock-free queue for exactly //
+// one producer thread and one consumer thread.     //
+//////////////////////////////////////////////////////
+
+#ifndef _H_SPSC_RING_
+#define _H_SPSC_RING_
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Keeps the producer's and consumer's indices on separate cache lines.
+const size_t CACHE_LINE_SIZE = 64;
+
+// Capacity is rounded up to a power of two. Each side caches the other's
+// index and only re-reads the shared atomic when the cached value says the
+// ring is full (producer) or empty (consumer), so in steady state a push or
+// pop touches no cache line the other thread is writing.
+template <typename T>
+class SpscRing {
+public:
+	explicit SpscRing(size_t minimumCapacity);
+	bool push(const T& item);
+	size_t pop(T* out, size_t maximum);
+	size_t capacity() const;
+
+private:
+	std::vector<T> slots;
+	size_t mask;
+	alignas(CACHE_LINE_SIZE) std::atomic<size_t> head;	//next slot to write; written by the producer
+	size_t cachedTail;
+	alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail;	//next slot to read; written by the consumer
+	size_t cachedHead;
+
+	SpscRing(const SpscRing&);
+	SpscRing& operator=(const SpscRing&);
+};
+
+template <typename T>
+SpscRing<T>::SpscRing(size_t minimumCapacity) : head(0), cachedTail(0), tail(0), cachedHead(0) {
+	size_t size = 1;
+	while (size < minimumCapacity)
+		size *= 2;
+	slots.resize(size);
+	mask = size - 1;
+}
+
+// Producer only. Returns false, leaving the ring unchanged, when it is full.
+template <typename T>
+bool SpscRing<T>::push(const T& item) {
+	size_t h = head.load(std::memory_order_relaxed);
+	if (h - cachedTail == slots.size())
+	{
+		cachedTail = tail.load(std::memory_order_acquire);
+		if (h - cachedTail == slots.size())
+			return false;
+	}
+	slots[h & mask] = item;
+	head.store(h + 1, std::memory_order_release);
+	return true;
+}
+
+// Consumer only. Moves up to maximum items into out; returns how many.
+template <typename T>
+size_t SpscRing<T>::pop(T* out, size_t maximum) {
+	size_t t = tail.load(std::memory_order_relaxed);
+	if (cachedHead == t)
+	{
+		cachedHead = head.load(std::memory_order_acquire);
+		if (cachedHead == t)
+			return 0;
+	}
+	size_t count = cachedHead - t;
+	if (count > maximum)
+		count = maximum;
+	for (size_t i = 0; i < count; i++)
+		out[i] = slots[(t + i) & mask];
+	tail.store(t + count, std::memory_order_release);
+	return count;
+}
+
+template <typename T>
+size_t SpscRing<T>::capacity() const {
+	return slots.size();
+}
+
+#endif
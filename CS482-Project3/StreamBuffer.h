@@ -0,0 +1,223 @@
+//////////////////////////////////////////////////////
+// StreamBuffer.h - Ring of per-frame regions in    //
+// one GPU buffer for data rewritten every frame,   //
+// with fenced reuse or orphaning on older GL.      //
+//////////////////////////////////////////////////////
+
+#ifndef _H_STREAM_BUFFER_
+#define _H_STREAM_BUFFER_
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+// Frames the CPU may run ahead of the GPU before it has to wait.
+const int STREAM_REGIONS = 3;
+// How long one wait on a fence lasts before it is retried.
+const GLuint64 STREAM_WAIT_NS = 1000000;
+
+// Totals since the buffer was created.
+struct StreamStats {
+	unsigned long long frames;
+	unsigned long long uploads;
+	unsigned long long bytes;
+	long long peakFrameBytes;
+	//frames that found their region still in use by the GPU, and the time waited
+	unsigned long long stalls;
+	double stallMs;
+	//regions outgrown (persistent) or buffers orphaned (fallback)
+	unsigned long long grows;
+	unsigned long long orphans;
+};
+
+// With GL 4.4 / ARB_buffer_storage the buffer is mapped once, persistently
+// and coherently, and split into STREAM_REGIONS regions; each frame writes
+// the next region, and a fence placed when the frame is finished guards
+// that region until the GPU is done with it. Otherwise every upload maps
+// its range unsynchronized and the buffer is orphaned when it fills, which
+// the driver resolves without waiting. Either way the buffer name can
+// change after an upload, so callers bind buffer() after every upload.
+class StreamBuffer {
+public:
+	StreamBuffer();
+	~StreamBuffer();
+	void initialize(const char* label, GLsizeiptr regionBytes);
+	bool persistent() const;
+	GLuint buffer() const;
+	GLintptr upload(const void* data, GLsizeiptr bytes, GLint alignment);
+	void finishFrame();
+	const StreamStats& statistics() const;
+	void report(std::ostream& out) const;
+
+private:
+	void create(GLsizeiptr bytesPerRegion);
+	void release();
+	const char* name;
+	GLuint object;
+	char* mapped;
+	bool usePersistent;
+	GLsizeiptr regionSize;
+	int region;
+	GLsizeiptr cursor;
+	GLsizeiptr frameBytes;
+	GLsync fences[STREAM_REGIONS];
+	StreamStats stats;
+
+	StreamBuffer(const StreamBuffer&);
+	StreamBuffer& operator=(const StreamBuffer&);
+};
+
+StreamBuffer::StreamBuffer()
+	: name(""), object(0), mapped(NULL), usePersistent(false), regionSize(0), region(0), cursor(0), frameBytes(0) {
+	for (int i = 0; i < STREAM_REGIONS; i++)
+		fences[i] = 0;
+	memset(&stats, 0, sizeof(stats));
+}
+
+StreamBuffer::~StreamBuffer() {
+	// The context is normally gone by now; nothing to release.
+}
+
+void StreamBuffer::initialize(const char* label, GLsizeiptr regionBytes) {
+	name = label;
+	usePersistent = GLEW_ARB_buffer_storage != 0;
+	create(regionBytes);
+}
+
+// (Re)create the buffer with room for STREAM_REGIONS regions. Uploads go
+// through GL_COPY_WRITE_BUFFER so no other binding is disturbed.
+void StreamBuffer::create(GLsizeiptr bytesPerRegion) {
+	release();
+	regionSize = bytesPerRegion;
+	glGenBuffers(1, &object);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, object);
+	if (usePersistent)
+	{
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_WRITE_BUFFER, STREAM_REGIONS * regionSize, NULL, flags);
+		mapped = (char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, STREAM_REGIONS * regionSize, flags);
+	}
+	else
+		glBufferData(GL_COPY_WRITE_BUFFER, STREAM_REGIONS * regionSize, NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	cursor = 0;
+}
+
+// Draws already issued keep reading the old buffer; GL frees it after them.
+void StreamBuffer::release() {
+	if (object == 0)
+		return;
+	if (mapped != NULL)
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, object);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		mapped = NULL;
+	}
+	glDeleteBuffers(1, &object);
+	object = 0;
+	for (int i = 0; i < STREAM_REGIONS; i++)
+		if (fences[i] != 0)
+		{
+			glDeleteSync(fences[i]);
+			fences[i] = 0;
+		}
+}
+
+bool StreamBuffer::persistent() const {
+	return usePersistent;
+}
+
+GLuint StreamBuffer::buffer() const {
+	return object;
+}
+
+// Copy bytes into this frame's part of the buffer and return their offset
+// in buffer(). Never waits on the GPU.
+GLintptr StreamBuffer::upload(const void* data, GLsizeiptr bytes, GLint alignment) {
+	GLsizeiptr start = (cursor + alignment - 1) / alignment * alignment;
+	stats.uploads++;
+	stats.bytes += bytes;
+	frameBytes += bytes;
+	if (usePersistent)
+	{
+		// A frame that outgrows its region moves to a new, larger buffer.
+		if (start + bytes > regionSize)
+		{
+			GLsizeiptr size = 2 * regionSize;
+			while (size < bytes)
+				size *= 2;
+			create(size);
+			stats.grows++;
+			start = 0;
+		}
+		GLintptr offset = region * regionSize + start;
+		memcpy(mapped + offset, data, bytes);
+		cursor = start + bytes;
+		return offset;
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, object);
+	if (start + bytes > STREAM_REGIONS * regionSize)
+	{
+		while (STREAM_REGIONS * regionSize < bytes)
+			regionSize *= 2;
+		glBufferData(GL_COPY_WRITE_BUFFER, STREAM_REGIONS * regionSize, NULL, GL_STREAM_DRAW);
+		stats.orphans++;
+		start = 0;
+	}
+	void* target = glMapBufferRange(GL_COPY_WRITE_BUFFER, start, bytes,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (target != NULL)
+	{
+		memcpy(target, data, bytes);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	cursor = start + bytes;
+	return start;
+}
+
+// Fence the region this frame wrote and move to the next one, waiting
+// (and counting a stall) only if the GPU is still reading it.
+void StreamBuffer::finishFrame() {
+	stats.frames++;
+	if (frameBytes > stats.peakFrameBytes)
+		stats.peakFrameBytes = frameBytes;
+	frameBytes = 0;
+	if (!usePersistent)
+		return;
+
+	fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	region = (region + 1) % STREAM_REGIONS;
+	cursor = 0;
+	GLsync fence = fences[region];
+	if (fence == 0)
+		return;
+	fences[region] = 0;
+	GLenum status = glClientWaitSync(fence, 0, 0);
+	if (status == GL_TIMEOUT_EXPIRED)
+	{
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		do
+			status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, STREAM_WAIT_NS);
+		while (status == GL_TIMEOUT_EXPIRED);
+		stats.stalls++;
+		stats.stallMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+	}
+	glDeleteSync(fence);
+}
+
+const StreamStats& StreamBuffer::statistics() const {
+	return stats;
+}
+
+void StreamBuffer::report(std::ostream& out) const {
+	out << "  " << name << (usePersistent ? " (persistent, " : " (orphaning, ") << STREAM_REGIONS << " x "
+		<< regionSize / 1024 << " KB): " << stats.uploads << " uploads, " << stats.bytes / 1024 << " KB over "
+		<< stats.frames << " frames, peak " << stats.peakFrameBytes / 1024 << " KB/frame, " << stats.stalls
+		<< " stalls (" << stats.stallMs << " ms), " << (usePersistent ? stats.grows : stats.orphans)
+		<< (usePersistent ? " grows" : " orphans") << std::endl;
+}
+
+#endif
@@ -0,0 +1,259 @@
+//////////////////////////////////////////////////////
+// Telemetry.h - Per-tick vehicle state streamed to //
+// a columnar binary file, plus a CSV converter.    //
+//////////////////////////////////////////////////////
+
+#ifndef _H_TELEMETRY_
+#define _H_TELEMETRY_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "SpscRing.h"
+#include "Trace.h"
+
+// Room for about a second of 1 kHz ticks from a thousand vehicles.
+const size_t TELEMETRY_RING_CAPACITY = 1 << 20;
+// Records per block; each column of a block is written contiguously.
+const int TELEMETRY_BLOCK_RECORDS = 16384;
+// How long the writer sleeps when the ring is empty, and the longest a
+// partial block waits before being flushed.
+const int TELEMETRY_IDLE_MS = 2;
+const int TELEMETRY_FLUSH_MS = 500;
+
+// File layout (little-endian, as written by x86):
+//   header: "CDTELEM1", uint32 version
+//   blocks: uint32 TELEMETRY_BLOCK_MAGIC, uint32 count, then the columns
+//           tick[count] (uint64), vehicle[count] (uint32),
+//           distance[count], speed[count], laneOffset[count] (float),
+//           sideOfRoad[count] (uint8)
+const char TELEMETRY_FILE_MAGIC[8] = { 'C', 'D', 'T', 'E', 'L', 'E', 'M', '1' };
+const uint32_t TELEMETRY_VERSION = 1;
+const uint32_t TELEMETRY_BLOCK_MAGIC = 0x4B4C4254;	// "TBLK"
+
+// One vehicle's state at one simulation tick.
+struct TelemetryRecord {
+	uint64_t tick;
+	uint32_t vehicle;
+	float distance;
+	float speed;
+	float laneOffset;
+	uint8_t sideOfRoad;
+};
+
+// Records are pushed from the simulation thread without locks or system
+// calls; a writer thread drains the ring into column blocks and writes each
+// block with one large sequential write. If the writer falls behind, the
+// ring fills and further records are counted as dropped rather than
+// stalling the simulation.
+class TelemetryWriter {
+public:
+	TelemetryWriter();
+	~TelemetryWriter();
+	bool start(const std::string& path);
+	void stop();
+	bool active() const;
+	void record(const TelemetryRecord& record);
+	unsigned long long written() const;
+	unsigned long long dropped() const;
+
+private:
+	//allocated by the first start, so a writer that never records holds no ring
+	SpscRing<TelemetryRecord>* ring;
+	std::ofstream file;
+	std::thread writer;
+	std::atomic<bool> running;
+	std::atomic<unsigned long long> recordsWritten;
+	std::atomic<unsigned long long> recordsDropped;
+	//writer thread's staging: the drained records and the block image
+	std::vector<TelemetryRecord> staged;
+	std::vector<char> block;
+
+	void run();
+	void writeBlock(int count);
+	TelemetryWriter(const TelemetryWriter&);
+	TelemetryWriter& operator=(const TelemetryWriter&);
+};
+
+TelemetryWriter::TelemetryWriter()
+	: ring(NULL), running(false), recordsWritten(0), recordsDropped(0) {
+}
+
+TelemetryWriter::~TelemetryWriter() {
+	stop();
+	delete ring;
+}
+
+bool TelemetryWriter::start(const std::string& path) {
+	file.open(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file)
+		return false;
+	file.write(TELEMETRY_FILE_MAGIC, sizeof(TELEMETRY_FILE_MAGIC));
+	file.write((const char*)&TELEMETRY_VERSION, sizeof(TELEMETRY_VERSION));
+	if (ring == NULL)
+	{
+		ALLOC_SCOPE(ALLOC_TELEMETRY);
+		ring = new SpscRing<TelemetryRecord>(TELEMETRY_RING_CAPACITY);
+	}
+	staged.resize(TELEMETRY_BLOCK_RECORDS);
+	running = true;
+	writer = std::thread(&TelemetryWriter::run, this);
+	return true;
+}
+
+// Drain what is left, write it and close the file.
+void TelemetryWriter::stop() {
+	if (!running)
+		return;
+	running = false;
+	writer.join();
+	file.close();
+}
+
+bool TelemetryWriter::active() const {
+	return running;
+}
+
+// Simulation thread only.
+void TelemetryWriter::record(const TelemetryRecord& record) {
+	if (!ring->push(record))
+		recordsDropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+unsigned long long TelemetryWriter::written() const {
+	return recordsWritten;
+}
+
+unsigned long long TelemetryWriter::dropped() const {
+	return recordsDropped;
+}
+
+void TelemetryWriter::run() {
+	TraceThreadName("telemetry writer");
+	ALLOC_SCOPE(ALLOC_TELEMETRY);
+	int count = 0;
+	std::chrono::steady_clock::time_point lastFlush = std::chrono::steady_clock::now();
+	for (;;)
+	{
+		bool stopping = !running;
+		count += (int)ring->pop(&staged[count], TELEMETRY_BLOCK_RECORDS - count);
+
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		bool stale = now - lastFlush > std::chrono::milliseconds(TELEMETRY_FLUSH_MS);
+		if (count == TELEMETRY_BLOCK_RECORDS || (count > 0 && (stale || stopping)))
+		{
+			writeBlock(count);
+			count = 0;
+			lastFlush = now;
+			continue;
+		}
+		// Stop once the ring was seen empty after the stop request.
+		if (stopping)
+			break;
+		if (count < TELEMETRY_BLOCK_RECORDS)
+			std::this_thread::sleep_for(std::chrono::milliseconds(TELEMETRY_IDLE_MS));
+	}
+	file.flush();
+}
+
+// Transpose the staged records into columns and write them as one block.
+void TelemetryWriter::writeBlock(int count) {
+	TRACE_FUNCTION();
+	const size_t rowBytes = sizeof(uint64_t) + sizeof(uint32_t) + 3 * sizeof(float) + sizeof(uint8_t);
+	block.resize(2 * sizeof(uint32_t) + count * rowBytes);
+	char* out = &block[0];
+	uint32_t header[2] = { TELEMETRY_BLOCK_MAGIC, (uint32_t)count };
+	memcpy(out, header, sizeof(header));
+	out += sizeof(header);
+
+	for (int i = 0; i < count; i++, out += sizeof(uint64_t))
+		memcpy(out, &staged[i].tick, sizeof(uint64_t));
+	for (int i = 0; i < count; i++, out += sizeof(uint32_t))
+		memcpy(out, &staged[i].vehicle, sizeof(uint32_t));
+	for (int i = 0; i < count; i++, out += sizeof(float))
+		memcpy(out, &staged[i].distance, sizeof(float));
+	for (int i = 0; i < count; i++, out += sizeof(float))
+		memcpy(out, &staged[i].speed, sizeof(float));
+	for (int i = 0; i < count; i++, out += sizeof(float))
+		memcpy(out, &staged[i].laneOffset, sizeof(float));
+	for (int i = 0; i < count; i++)
+		*out++ = (char)staged[i].sideOfRoad;
+
+	file.write(&block[0], block.size());
+	recordsWritten.fetch_add(count, std::memory_order_relaxed);
+}
+
+// Offline conversion of a telemetry file to CSV, one row per record.
+// Returns false, describing the problem in error, if the input is damaged.
+bool ConvertTelemetryToCsv(const std::string& inPath, const std::string& outPath, std::string& error)
+{
+	std::ifstream in(inPath.c_str(), std::ios::in | std::ios::binary);
+	if (!in)
+	{
+		error = "cannot open " + inPath;
+		return false;
+	}
+	char magic[sizeof(TELEMETRY_FILE_MAGIC)];
+	uint32_t version = 0;
+	in.read(magic, sizeof(magic));
+	in.read((char*)&version, sizeof(version));
+	if (!in || memcmp(magic, TELEMETRY_FILE_MAGIC, sizeof(magic)) != 0 || version != TELEMETRY_VERSION)
+	{
+		error = inPath + " is not a version 1 telemetry file";
+		return false;
+	}
+	std::ofstream out(outPath.c_str(), std::ios::out | std::ios::trunc);
+	if (!out)
+	{
+		error = "cannot create " + outPath;
+		return false;
+	}
+	out << "tick,vehicle,distance,speed,lane_offset,side_of_road\n";
+
+	std::vector<uint64_t> ticks;
+	std::vector<uint32_t> vehicles;
+	std::vector<float> distances, speeds, lanes;
+	std::vector<uint8_t> sides;
+	uint32_t header[2];
+	while (in.read((char*)header, sizeof(header)))
+	{
+		if (header[0] != TELEMETRY_BLOCK_MAGIC)
+		{
+			error = "bad block header in " + inPath;
+			return false;
+		}
+		const uint32_t count = header[1];
+		ticks.resize(count);
+		vehicles.resize(count);
+		distances.resize(count);
+		speeds.resize(count);
+		lanes.resize(count);
+		sides.resize(count);
+		if (count > 0)
+		{
+			in.read((char*)&ticks[0], count * sizeof(uint64_t));
+			in.read((char*)&vehicles[0], count * sizeof(uint32_t));
+			in.read((char*)&distances[0], count * sizeof(float));
+			in.read((char*)&speeds[0], count * sizeof(float));
+			in.read((char*)&lanes[0], count * sizeof(float));
+			in.read((char*)&sides[0], count * sizeof(uint8_t));
+		}
+		if (!in)
+		{
+			error = "truncated block in " + inPath;
+			return false;
+		}
+		for (uint32_t i = 0; i < count; i++)
+			out << ticks[i] << ',' << vehicles[i] << ',' << distances[i] << ',' << speeds[i] << ','
+				<< lanes[i] << ',' << int(sides[i]) << '\n';
+	}
+	return true;
+}
+
+#endif
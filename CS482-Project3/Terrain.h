@@ -0,0 +1,434 @@
+//////////////////////////////////////////////////////
+// Terrain.h - Ground and trees in square chunks,   //
+// generated from a seed on worker threads and      //
+// streamed in and out around the cameras.          //
+//////////////////////////////////////////////////////
+
+#ifndef _H_TERRAIN_
+#define _H_TERRAIN_
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <vector>
+#include "ThreadPool.h"
+#include "TrackAssets.h"
+#include "MultiView.h"
+
+// The memory budget: at most this many chunks are resident or in flight,
+// each owning one terrain mesh slot in the renderer.
+const int MAX_TERRAIN_CHUNKS = TERRAIN_MESH_SLOTS;
+
+struct TreeSite {
+	GLfloat position[3];
+	GLfloat radius;
+	GLfloat height;
+};
+
+// What a worker produces for one chunk.
+struct TerrainChunkData {
+	int cx, cz;
+	int slot;
+	int ticket;
+	MeshData ground;
+	std::vector<TreeSite> trees;
+};
+
+enum CHUNK_STATE { CHUNK_FREE, CHUNK_GENERATING, CHUNK_RESIDENT };
+
+struct TerrainChunk {
+	CHUNK_STATE state;
+	int cx, cz;
+	//identifies the request, so results for a chunk evicted meanwhile are dropped
+	int ticket;
+	std::vector<TreeSite> trees;
+	//the trees that clear the current road
+	std::vector<InstanceData> treeInstances;
+};
+
+// Mix a seed and lattice coordinates into 32 well-scrambled bits.
+unsigned HashCoordinates(unsigned seed, int x, int z)
+{
+	unsigned h = seed ^ (unsigned(x) * 0x8da6b343u) ^ (unsigned(z) * 0xd8163841u);
+	h ^= h >> 16;
+	h *= 0x7feb352du;
+	h ^= h >> 15;
+	h *= 0x846ca68bu;
+	h ^= h >> 16;
+	return h;
+}
+
+// Smoothly interpolated lattice noise in [0, 1).
+GLfloat ValueNoise(unsigned seed, GLfloat x, GLfloat z)
+{
+	int ix = (int)floor(x), iz = (int)floor(z);
+	GLfloat fx = x - ix, fz = z - iz;
+	fx = fx * fx * (3.0f - 2.0f * fx);
+	fz = fz * fz * (3.0f - 2.0f * fz);
+	const GLfloat scale = 1.0f / 4294967296.0f;
+	GLfloat n00 = HashCoordinates(seed, ix, iz) * scale;
+	GLfloat n10 = HashCoordinates(seed, ix + 1, iz) * scale;
+	GLfloat n01 = HashCoordinates(seed, ix, iz + 1) * scale;
+	GLfloat n11 = HashCoordinates(seed, ix + 1, iz + 1) * scale;
+	GLfloat a = n00 + fx * (n10 - n00);
+	GLfloat b = n01 + fx * (n11 - n01);
+	return a + fz * (b - a);
+}
+
+// Ground height at a world position. The terrain only dips below
+// GROUND_BOTTOM, so it never rises through the road wherever the road runs.
+GLfloat TerrainHeight(unsigned seed, GLfloat x, GLfloat z)
+{
+	GLfloat sum = 0.0f, amplitude = 0.5f, frequency = 1.0f / TERRAIN_FEATURE_SIZE;
+	for (int octave = 0; octave < 3; octave++)
+	{
+		sum += amplitude * ValueNoise(seed + octave, x * frequency, z * frequency);
+		amplitude *= 0.5f;
+		frequency *= 2.0f;
+	}
+	return GROUND_BOTTOM - TERRAIN_DEPTH * sum / 0.875f;
+}
+
+// Build the ground grid and candidate trees of one chunk. Depends only on
+// the seed and the chunk coordinates, so it is safe on any thread.
+void GenerateTerrainChunk(unsigned seed, TerrainChunkData& data)
+{
+	const int n = TERRAIN_CHUNK_CELLS;
+	const GLfloat step = TERRAIN_CHUNK_SIZE / n;
+	const GLfloat x0 = data.cx * TERRAIN_CHUNK_SIZE, z0 = data.cz * TERRAIN_CHUNK_SIZE;
+
+	data.ground.clear();
+	for (int j = 0; j <= n; j++)
+		for (int i = 0; i <= n; i++)
+		{
+			GLfloat x = x0 + i * step, z = z0 + j * step;
+			// Normal from central differences of the height field.
+			GLfloat dx = TerrainHeight(seed, x + step, z) - TerrainHeight(seed, x - step, z);
+			GLfloat dz = TerrainHeight(seed, x, z + step) - TerrainHeight(seed, x, z - step);
+			GLfloat normal[3] = { -dx, 2.0f * step, -dz };
+			GLfloat len = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+			data.ground.addVertex(x, TerrainHeight(seed, x, z), z, normal[0] / len, normal[1] / len, normal[2] / len);
+		}
+	for (int j = 0; j < n; j++)
+		for (int i = 0; i < n; i++)
+		{
+			GLuint v00 = j * (n + 1) + i, v10 = v00 + 1, v01 = v00 + (n + 1), v11 = v01 + 1;
+			data.ground.addTriangle(v00, v01, v10);
+			data.ground.addTriangle(v10, v01, v11);
+		}
+
+	// Trees at random spots, skipping any that would overlap one already placed.
+	unsigned state = HashCoordinates(seed ^ 0x9e3779b9u, data.cx, data.cz) | 1u;
+	data.trees.clear();
+	for (int t = 0; t < TREES_PER_CHUNK; t++)
+	{
+		GLfloat r[4];
+		for (int k = 0; k < 4; k++)
+		{
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			r[k] = state / 4294967296.0f;
+		}
+		TreeSite site;
+		site.position[0] = x0 + r[0] * TERRAIN_CHUNK_SIZE;
+		site.position[2] = z0 + r[1] * TERRAIN_CHUNK_SIZE;
+		site.position[1] = TerrainHeight(seed, site.position[0], site.position[2]);
+		site.radius = MINIMUM_TREE_BASE_RADIUS + r[2] * (MAXIMUM_TREE_BASE_RADIUS - MINIMUM_TREE_BASE_RADIUS);
+		site.height = site.radius * (MINIMUM_TREE_HEIGHT_TO_RADIUS_RATIO +
+			r[3] * (MAXIMUM_TREE_HEIGHT_TO_RADIUS_RATIO - MINIMUM_TREE_HEIGHT_TO_RADIUS_RATIO));
+		if (site.height > MAX_TREE_HEIGHT)
+			site.height = MAX_TREE_HEIGHT;
+
+		bool overlaps = false;
+		for (size_t k = 0; k < data.trees.size() && !overlaps; k++)
+		{
+			GLfloat ex = data.trees[k].position[0] - site.position[0];
+			GLfloat ez = data.trees[k].position[2] - site.position[2];
+			GLfloat reach = data.trees[k].radius + site.radius;
+			overlaps = ex * ex + ez * ez <= reach * reach;
+		}
+		if (!overlaps)
+			data.trees.push_back(site);
+	}
+}
+
+// Keeps the chunks nearest the cameras resident. Generation runs on a
+// thread pool; the render thread uploads a few finished chunks per frame
+// so streaming never stalls a frame.
+class TerrainStreamer {
+public:
+	TerrainStreamer();
+	~TerrainStreamer();
+	void start(unsigned terrainSeed, int threads);
+	void stop();
+	void setStreamRadius(GLfloat radius);
+	void update(const std::vector<GLfloat>& foci);
+	void uploadFinished(Renderer* renderer, SceneList& scene, const TrackAssets& track);
+	void trackChanged(const TrackAssets& track);
+	void trackEdited(const TrackAssets& track);
+	void queueGround(SceneList& scene) const;
+	void queueTrees(SceneList& scene) const;
+	template <typename Visible> void queueGround(SceneList& scene, const Visible& visible) const;
+	template <typename Visible> void queueTrees(SceneList& scene, const Visible& visible) const;
+
+private:
+	struct WantedChunk {
+		int cx, cz;
+		GLfloat distance;
+	};
+	unsigned seed;
+	GLfloat streamRadius;
+	ThreadPool pool;
+	TerrainChunk chunks[MAX_TERRAIN_CHUNKS];
+	int nextTicket;
+	std::mutex finishedLock;
+	std::vector<TerrainChunkData*> finished;
+	//per-frame scratch, kept so streaming does not allocate every frame
+	std::vector<TerrainChunkData*> uploading;
+	std::vector<WantedChunk> wanted;
+	std::vector<char> held;
+	std::vector<GLfloat> treePositions;
+	std::vector<TrackProjection> treeProjections;
+
+	void request(int slot, int cx, int cz);
+	void filterTrees(TerrainChunk& chunk, const TrackAssets& track);
+	TerrainStreamer(const TerrainStreamer&);
+	TerrainStreamer& operator=(const TerrainStreamer&);
+};
+
+TerrainStreamer::TerrainStreamer() : seed(0), streamRadius(TERRAIN_STREAM_RADIUS), nextTicket(0) {
+	for (int i = 0; i < MAX_TERRAIN_CHUNKS; i++)
+		chunks[i].state = CHUNK_FREE;
+}
+
+TerrainStreamer::~TerrainStreamer() {
+	stop();
+}
+
+void TerrainStreamer::start(unsigned terrainSeed, int threads) {
+	seed = terrainSeed;
+	pool.start(threads, "terrain worker");
+}
+
+void TerrainStreamer::stop() {
+	pool.stop();
+	for (size_t i = 0; i < finished.size(); i++)
+		delete finished[i];
+	finished.clear();
+}
+
+// How far around each focus chunks are kept; a smaller radius evicts the
+// outer chunks at the next update.
+void TerrainStreamer::setStreamRadius(GLfloat radius) {
+	streamRadius = radius;
+}
+
+// Choose the chunks within the stream radius of any focus (x, y, z
+// triples), nearest first and no more than the budget; evict the rest and
+// queue generation for newcomers.
+void TerrainStreamer::update(const std::vector<GLfloat>& foci) {
+	TRACE_FUNCTION();
+	ALLOC_SCOPE(ALLOC_TERRAIN);
+	const int reach = (int)ceil(streamRadius / TERRAIN_CHUNK_SIZE);
+	wanted.clear();
+	for (size_t f = 0; f + 2 < foci.size(); f += 3)
+	{
+		int fx = (int)floor(foci[f] / TERRAIN_CHUNK_SIZE), fz = (int)floor(foci[f + 2] / TERRAIN_CHUNK_SIZE);
+		for (int cz = fz - reach; cz <= fz + reach; cz++)
+			for (int cx = fx - reach; cx <= fx + reach; cx++)
+			{
+				// Distance from the focus to the nearest point of the chunk.
+				GLfloat x0 = cx * TERRAIN_CHUNK_SIZE, z0 = cz * TERRAIN_CHUNK_SIZE;
+				GLfloat dx = std::max(std::max(x0 - foci[f], foci[f] - (x0 + TERRAIN_CHUNK_SIZE)), 0.0f);
+				GLfloat dz = std::max(std::max(z0 - foci[f + 2], foci[f + 2] - (z0 + TERRAIN_CHUNK_SIZE)), 0.0f);
+				WantedChunk chunk = { cx, cz, GLfloat(sqrt(dx * dx + dz * dz)) };
+				if (chunk.distance <= streamRadius)
+					wanted.push_back(chunk);
+			}
+	}
+	// Keep each chunk once, at its smallest distance, then the nearest within budget.
+	std::sort(wanted.begin(), wanted.end(), [](const WantedChunk& a, const WantedChunk& b) {
+		return a.cx != b.cx ? a.cx < b.cx : (a.cz != b.cz ? a.cz < b.cz : a.distance < b.distance); });
+	wanted.erase(std::unique(wanted.begin(), wanted.end(), [](const WantedChunk& a, const WantedChunk& b) {
+		return a.cx == b.cx && a.cz == b.cz; }), wanted.end());
+	std::sort(wanted.begin(), wanted.end(), [](const WantedChunk& a, const WantedChunk& b) {
+		return a.distance < b.distance; });
+	if ((int)wanted.size() > MAX_TERRAIN_CHUNKS)
+		wanted.resize(MAX_TERRAIN_CHUNKS);
+
+	held.assign(wanted.size(), 0);
+	for (int slot = 0; slot < MAX_TERRAIN_CHUNKS; slot++)
+	{
+		TerrainChunk& chunk = chunks[slot];
+		if (chunk.state == CHUNK_FREE)
+			continue;
+		bool keep = false;
+		for (size_t w = 0; w < wanted.size() && !keep; w++)
+			if (wanted[w].cx == chunk.cx && wanted[w].cz == chunk.cz)
+			{
+				held[w] = 1;
+				keep = true;
+			}
+		if (!keep)
+		{
+			chunk.state = CHUNK_FREE;
+			chunk.trees.clear();
+			chunk.treeInstances.clear();
+		}
+	}
+	int slot = 0;
+	for (size_t w = 0; w < wanted.size(); w++)
+	{
+		if (held[w])
+			continue;
+		while (chunks[slot].state != CHUNK_FREE)
+			slot++;
+		request(slot, wanted[w].cx, wanted[w].cz);
+	}
+}
+
+void TerrainStreamer::request(int slot, int cx, int cz) {
+	TerrainChunk& chunk = chunks[slot];
+	chunk.state = CHUNK_GENERATING;
+	chunk.cx = cx;
+	chunk.cz = cz;
+	chunk.ticket = ++nextTicket;
+
+	const unsigned terrainSeed = seed;
+	const int ticket = chunk.ticket;
+	pool.submit([this, terrainSeed, cx, cz, slot, ticket]() {
+		TRACE_SCOPE("GenerateTerrainChunk");
+		ALLOC_SCOPE(ALLOC_TERRAIN);
+		TerrainChunkData* data = new TerrainChunkData();
+		data->cx = cx;
+		data->cz = cz;
+		data->slot = slot;
+		data->ticket = ticket;
+		GenerateTerrainChunk(terrainSeed, *data);
+		std::lock_guard<std::mutex> guard(finishedLock);
+		finished.push_back(data);
+	});
+}
+
+// Upload up to TERRAIN_UPLOADS_PER_FRAME finished chunks; results for
+// chunks evicted since they were requested are discarded.
+void TerrainStreamer::uploadFinished(Renderer* renderer, SceneList& scene, const TrackAssets& track) {
+	TRACE_FUNCTION();
+	ALLOC_SCOPE(ALLOC_TERRAIN);
+	{
+		std::lock_guard<std::mutex> guard(finishedLock);
+		uploading.swap(finished);
+	}
+	int uploads = 0;
+	for (size_t i = 0; i < uploading.size(); i++)
+	{
+		TerrainChunkData* data = uploading[i];
+		TerrainChunk& chunk = chunks[data->slot];
+		if (chunk.state != CHUNK_GENERATING || chunk.ticket != data->ticket)
+		{
+			delete data;
+			continue;
+		}
+		if (uploads == TERRAIN_UPLOADS_PER_FRAME)
+		{
+			// Hand it back for a later frame.
+			std::lock_guard<std::mutex> guard(finishedLock);
+			finished.push_back(data);
+			continue;
+		}
+		MESH_ID mesh = MESH_ID(TERRAIN_MESH + data->slot);
+		renderer->uploadMesh(mesh, data->ground);
+		scene.setMeshBounds(mesh, data->ground);
+		chunk.trees.swap(data->trees);
+		filterTrees(chunk, track);
+		chunk.state = CHUNK_RESIDENT;
+		uploads++;
+		delete data;
+	}
+	uploading.clear();
+}
+
+// Keep only the trees clear of the road and margin, using one batched
+// projection per chunk.
+void TerrainStreamer::filterTrees(TerrainChunk& chunk, const TrackAssets& track) {
+	const int count = (int)chunk.trees.size();
+	treePositions.resize(3 * count);
+	treeProjections.resize(count);
+	for (int i = 0; i < count; i++)
+		for (int k = 0; k < 3; k++)
+			treePositions[3 * i + k] = chunk.trees[i].position[k];
+	if (count > 0)
+		track.bvh.closestPoints(&treePositions[0], count, &treeProjections[0], true);
+
+	chunk.treeInstances.clear();
+	for (int i = 0; i < count; i++)
+	{
+		const TreeSite& site = chunk.trees[i];
+		if (treeProjections[i].separation <= 0.5f * track.width + ROADSIDE_MARGIN + 2 * site.radius)
+			continue;
+		InstanceData instance;
+		MatrixIdentity(instance.model);
+		MatrixTranslate(instance.model, site.position[0], site.position[1], site.position[2]);
+		MatrixScale(instance.model, site.radius, site.height, site.radius);
+		chunk.treeInstances.push_back(instance);
+	}
+}
+
+// The road moved: re-check every resident chunk's trees against it.
+void TerrainStreamer::trackChanged(const TrackAssets& track) {
+	TRACE_FUNCTION();
+	ALLOC_SCOPE(ALLOC_TERRAIN);
+	for (int slot = 0; slot < MAX_TERRAIN_CHUNKS; slot++)
+		if (chunks[slot].state == CHUNK_RESIDENT)
+			filterTrees(chunks[slot], track);
+}
+
+// Part of the road moved: re-check only the chunks close enough to the
+// redone stretch (where it was or is now) for a tree's clearance to change.
+void TerrainStreamer::trackEdited(const TrackAssets& track) {
+	TRACE_FUNCTION();
+	ALLOC_SCOPE(ALLOC_TERRAIN);
+	const GLfloat reach = GLfloat(0.5 * track.width) + ROADSIDE_MARGIN + 2 * MAXIMUM_TREE_BASE_RADIUS;
+	for (int slot = 0; slot < MAX_TERRAIN_CHUNKS; slot++)
+	{
+		TerrainChunk& chunk = chunks[slot];
+		GLfloat x0 = chunk.cx * TERRAIN_CHUNK_SIZE, z0 = chunk.cz * TERRAIN_CHUNK_SIZE;
+		if (chunk.state == CHUNK_RESIDENT
+			&& x0 <= track.editUpper[0] + reach && x0 + TERRAIN_CHUNK_SIZE >= track.editLower[0] - reach
+			&& z0 <= track.editUpper[2] + reach && z0 + TERRAIN_CHUNK_SIZE >= track.editLower[2] - reach)
+			filterTrees(chunk, track);
+	}
+}
+
+void TerrainStreamer::queueGround(SceneList& scene) const {
+	queueGround(scene, [](int, int) { return true; });
+}
+
+void TerrainStreamer::queueTrees(SceneList& scene) const {
+	queueTrees(scene, [](int, int) { return true; });
+}
+
+// Only the resident chunks for which visible(cx, cz) holds.
+template <typename Visible>
+void TerrainStreamer::queueGround(SceneList& scene, const Visible& visible) const {
+	GLfloat model[16];
+	MatrixIdentity(model);
+	for (int slot = 0; slot < MAX_TERRAIN_CHUNKS; slot++)
+		if (chunks[slot].state == CHUNK_RESIDENT && visible(chunks[slot].cx, chunks[slot].cz))
+			scene.add(MESH_ID(TERRAIN_MESH + slot), GRASS_MATERIAL, model);
+}
+
+template <typename Visible>
+void TerrainStreamer::queueTrees(SceneList& scene, const Visible& visible) const {
+	for (int slot = 0; slot < MAX_TERRAIN_CHUNKS; slot++)
+	{
+		const TerrainChunk& chunk = chunks[slot];
+		if (chunk.state != CHUNK_RESIDENT || !visible(chunk.cx, chunk.cz))
+			continue;
+		for (size_t i = 0; i < chunk.treeInstances.size(); i++)
+			scene.add(CONE_MESH, TREE_MATERIAL, chunk.treeInstances[i].model);
+	}
+}
+
+#endif
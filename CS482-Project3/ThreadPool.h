@@ -0,0 +1,97 @@
+//////////////////////////////////////////////////////
+// ThreadPool.h - Fixed set of worker threads that  //
+// run queued jobs in submission order.             //
+//////////////////////////////////////////////////////
+
+#ifndef _H_THREAD_POOL_
+#define _H_THREAD_POOL_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Trace.h"
+
+class ThreadPool {
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()> > jobs;
+	std::mutex lock;
+	std::condition_variable wake;
+	bool stopping;
+
+public:
+	ThreadPool();
+	~ThreadPool();
+	void start(int threads, const char* name = "worker");
+	void stop();
+	void submit(const std::function<void()>& job);
+	int queued();
+
+private:
+	void run(const char* name);
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator=(const ThreadPool&);
+};
+
+ThreadPool::ThreadPool() : stopping(false) {
+}
+
+ThreadPool::~ThreadPool() {
+	stop();
+}
+
+// Workers are labelled name in traces.
+void ThreadPool::start(int threads, const char* name) {
+	stopping = false;
+	for (int i = 0; i < threads; i++)
+		workers.push_back(std::thread(&ThreadPool::run, this, name));
+}
+
+// Finish the running jobs, drop the queued ones and join the workers.
+void ThreadPool::stop() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+		jobs.clear();
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+	workers.clear();
+}
+
+void ThreadPool::submit(const std::function<void()>& job) {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		jobs.push_back(job);
+	}
+	wake.notify_one();
+}
+
+// Jobs not yet picked up by a worker.
+int ThreadPool::queued() {
+	std::lock_guard<std::mutex> guard(lock);
+	return (int)jobs.size();
+}
+
+void ThreadPool::run(const char* name) {
+	TraceThreadName(name);
+	for (;;)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			while (!stopping && jobs.empty())
+				wake.wait(guard);
+			if (stopping)
+				return;
+			job = jobs.front();
+			jobs.pop_front();
+		}
+		job();
+	}
+}
+
+#endif
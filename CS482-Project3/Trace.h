@@ -0,0 +1,188 @@
+//////////////////////////////////////////////////////
+// Trace.h - Scoped timing zones recorded per       //
+// thread and written as Chrome trace-event JSON    //
+// (chrome://tracing, ui.perfetto.dev).             //
+//////////////////////////////////////////////////////
+
+#ifndef _H_TRACE_
+#define _H_TRACE_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "AllocTracker.h"
+
+// Events per chunk of a thread's buffer, and the most a thread keeps
+// (about an hour of a frame's worth of zones at 60 Hz); later events
+// are counted as dropped.
+const int TRACE_CHUNK_EVENTS = 4096;
+const int TRACE_MAX_CHUNKS = 1024;
+
+// One completed zone. Names must be string literals (or otherwise
+// outlive the trace); they are stored as pointers.
+struct TraceEvent {
+	const char* name;
+	int64_t start;		//ns since the trace epoch
+	int64_t duration;	//ns
+};
+
+struct TraceChunk {
+	TraceEvent events[TRACE_CHUNK_EVENTS];
+};
+
+// A thread's events. Only the owning thread appends; the writer reads
+// the chunks published so far without stopping it.
+struct TraceBuffer {
+	int thread;
+	std::string name;
+	TraceChunk* chunks[TRACE_MAX_CHUNKS];
+	std::atomic<int> count;
+	std::atomic<unsigned long long> dropped;
+
+	TraceBuffer() : thread(0), count(0), dropped(0) {
+		for (int i = 0; i < TRACE_MAX_CHUNKS; i++)
+			chunks[i] = NULL;
+	}
+};
+
+// Process-wide state. Buffers are never freed, so threads that have
+// finished (e.g. terrain workers after a stop) still appear in the dump.
+struct TraceState {
+	std::atomic<bool> enabled;
+	std::mutex lock;
+	std::vector<TraceBuffer*> buffers;
+	std::chrono::steady_clock::time_point epoch;
+
+	TraceState() : enabled(false), epoch(std::chrono::steady_clock::now()) {}
+};
+
+TraceState traceState;
+thread_local TraceBuffer* traceThreadBuffer = NULL;
+
+inline int64_t TraceNow() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - traceState.epoch).count();
+}
+
+inline bool TraceEnabled() {
+	return traceState.enabled.load(std::memory_order_relaxed);
+}
+
+void TraceSetEnabled(bool enabled) {
+	traceState.enabled.store(enabled, std::memory_order_relaxed);
+}
+
+// The calling thread's buffer, registered on first use.
+TraceBuffer* TraceThreadBuffer() {
+	if (traceThreadBuffer == NULL)
+	{
+		ALLOC_SCOPE(ALLOC_TRACE);
+		TraceBuffer* buffer = new TraceBuffer();
+		std::lock_guard<std::mutex> guard(traceState.lock);
+		buffer->thread = (int)traceState.buffers.size() + 1;
+		traceState.buffers.push_back(buffer);
+		traceThreadBuffer = buffer;
+	}
+	return traceThreadBuffer;
+}
+
+// Label the calling thread in the trace viewer.
+void TraceThreadName(const char* name) {
+	TraceBuffer* buffer = TraceThreadBuffer();
+	std::lock_guard<std::mutex> guard(traceState.lock);
+	buffer->name = name;
+}
+
+void TraceRecord(const char* name, int64_t start, int64_t duration) {
+	TraceBuffer* buffer = TraceThreadBuffer();
+	int n = buffer->count.load(std::memory_order_relaxed);
+	int chunk = n / TRACE_CHUNK_EVENTS;
+	if (chunk >= TRACE_MAX_CHUNKS)
+	{
+		buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	if (buffer->chunks[chunk] == NULL)
+	{
+		ALLOC_SCOPE(ALLOC_TRACE);
+		buffer->chunks[chunk] = new TraceChunk();
+	}
+	TraceEvent& event = buffer->chunks[chunk]->events[n % TRACE_CHUNK_EVENTS];
+	event.name = name;
+	event.start = start;
+	event.duration = duration;
+	buffer->count.store(n + 1, std::memory_order_release);
+}
+
+// Times the enclosing scope. When tracing is off this costs one relaxed
+// load and a branch at each end.
+class TraceScope {
+public:
+	explicit TraceScope(const char* zoneName) : name(zoneName), start(TraceEnabled() ? TraceNow() : -1) {}
+	~TraceScope() {
+		if (start >= 0)
+			TraceRecord(name, start, TraceNow() - start);
+	}
+
+private:
+	const char* name;
+	int64_t start;
+
+	TraceScope(const TraceScope&);
+	TraceScope& operator=(const TraceScope&);
+};
+
+// Defining NO_TRACING compiles every zone out.
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#ifdef NO_TRACING
+#define TRACE_SCOPE(name)
+#define TRACE_FUNCTION()
+#else
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_FUNCTION() TRACE_SCOPE(__FUNCTION__)
+#endif
+
+// Write every event recorded so far as a JSON array of complete ("X")
+// events, with a thread_name record per named thread. Recording may
+// continue on other threads while this runs; their newer events are left
+// for the next dump.
+bool TraceWrite(const std::string& path) {
+	std::ofstream out(path.c_str(), std::ios::out | std::ios::trunc);
+	if (!out)
+		return false;
+	out << "{\"traceEvents\":[\n";
+	out.setf(std::ios::fixed);
+	out.precision(3);
+	bool first = true;
+	unsigned long long dropped = 0;
+
+	std::lock_guard<std::mutex> guard(traceState.lock);
+	for (size_t b = 0; b < traceState.buffers.size(); b++)
+	{
+		const TraceBuffer* buffer = traceState.buffers[b];
+		if (!buffer->name.empty())
+		{
+			out << (first ? "" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":"
+				<< buffer->thread << ",\"args\":{\"name\":\"" << buffer->name << "\"}}";
+			first = false;
+		}
+		int count = buffer->count.load(std::memory_order_acquire);
+		for (int i = 0; i < count; i++)
+		{
+			const TraceEvent& event = buffer->chunks[i / TRACE_CHUNK_EVENTS]->events[i % TRACE_CHUNK_EVENTS];
+			out << (first ? "" : ",\n") << "{\"ph\":\"X\",\"name\":\"" << event.name << "\",\"pid\":1,\"tid\":"
+				<< buffer->thread << ",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << event.duration / 1000.0 << "}";
+			first = false;
+		}
+		dropped += buffer->dropped.load(std::memory_order_relaxed);
+	}
+	out << "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedEvents\":" << dropped << "}}\n";
+	return bool(out);
+}
+
+#endif
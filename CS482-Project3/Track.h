@@ -1,5 +1,8 @@
 #ifndef _H_TRACK_
 #include <vector>
+#include <algorithm>
+#include <cmath>
+#include "Trace.h"
 
 
 #define double_t double
@@ -10,6 +13,8 @@ double_t PI_OVER_180 = 0.01745329251;
 double_t PI_OVER_2 = 1.57079632679;
 //scale the track up in size
 double_t TRACK_MULTIPLIER  = 13;
+//corners of the track cross-section emitted per sample by generateVerticies
+const int TRACK_CORNERS = 4;
 
 typedef double_t(*TrackCoord)(double_t);
 struct GLfloatPoint {
@@ -17,57 +22,124 @@ struct GLfloatPoint {
 	double_t y;
 	double_t z;
 };
-GLfloatPoint* verticies;
+//read-only window onto verticies owned by a Track
+struct VertexView {
+	const GLfloatPoint* data;
+	int count;
+};
 
 class Track {
 	TrackCoord _x;
 	TrackCoord _y;
 	TrackCoord _z;
 	double_t start, finish;
+	//closed Catmull-Rom control points, used instead of _x/_y/_z when set
+	std::vector<GLfloatPoint> controlPoints;
+	//world units per track unit
+	double_t scale;
+	//geometry arena: only grows, so regenerating at the same or a lower
+	//sample count never touches the heap
+	std::vector<GLfloatPoint> vertexArena;
+	int vertexCount;
+	//parameters of the last generateVerticies call
+	int sampleCount;
+	double_t width, thickness;
 
 
 public:
 	Track(TrackCoord xFunc, TrackCoord yFunc, TrackCoord zFunc, double start_t, double finish_t);
+	Track(const std::vector<GLfloatPoint>& points, double_t trackScale);
 	~Track();
 	double_t tangent(double_t t, double_t dt);
 	double_t sine(double_t t, double_t dt);
 	double_t cosine(double_t t, double_t dt);
 	double_t normal(double_t t, double_t dt,bool left);
+	GLfloatPoint direction(double_t t, double_t dt);
 	GLfloatPoint get(double_t t);
+	GLfloatPoint center(double_t t);
 	double_t length();
 	void set(GLfloatPoint& data, double_t t);
-	GLfloatPoint* generateVerticies(int numSegments, double track_width, double track_thickness);
+	VertexView generateVerticies(int numSamples, double track_width, double track_thickness);
+	VertexView regenerateVerticies(int first, int count);
+	VertexView adoptVerticies(const GLfloatPoint* corners, int numSamples, double track_width, double track_thickness);
+	VertexView verticies() const;
+	double_t worldScale() const;
+	int controlPointCount() const;
+	GLfloatPoint controlPoint(int i) const;
+	void moveControlPoint(int i, const GLfloatPoint& point);
+	void influencedSamples(int i, int& first, int& count) const;
+
+private:
+	void evaluate(GLfloatPoint& data, double_t tot);
 };
 
 
 Track::Track(TrackCoord xFunc, TrackCoord yFunc, TrackCoord zFunc, double start_t, double finish_t)
-	: _x(xFunc), _y(yFunc), _z(zFunc), start(start_t), finish(finish_t) {
+	: _x(xFunc), _y(yFunc), _z(zFunc), start(start_t), finish(finish_t), scale(TRACK_MULTIPLIER), vertexCount(0),
+	sampleCount(0), width(0), thickness(0) {
+
+}
+//closed spline through the points; t runs from 0 to the number of points
+Track::Track(const std::vector<GLfloatPoint>& points, double_t trackScale)
+	: _x(NULL), _y(NULL), _z(NULL), start(0), finish((double_t)points.size()), controlPoints(points),
+	scale(trackScale), vertexCount(0), sampleCount(0), width(0), thickness(0) {
 
 }
+//evaluate the curve at an absolute parameter
+void Track::evaluate(GLfloatPoint& data, double_t tot) {
+	if (controlPoints.empty()) {
+		data.x = _x(tot);
+		data.y = _y(tot);
+		data.z = _z(tot);
+		return;
+	}
+	const int n = (int)controlPoints.size();
+	double_t base = floor(tot);
+	double_t u = tot - base;
+	int i = ((int)base % n + n) % n;
+	const GLfloatPoint& p0 = controlPoints[(i + n - 1) % n];
+	const GLfloatPoint& p1 = controlPoints[i];
+	const GLfloatPoint& p2 = controlPoints[(i + 1) % n];
+	const GLfloatPoint& p3 = controlPoints[(i + 2) % n];
+	double_t u2 = u*u, u3 = u2*u;
+	double_t w0 = -0.5*u3 + u2 - 0.5*u;
+	double_t w1 = 1.5*u3 - 2.5*u2 + 1;
+	double_t w2 = -1.5*u3 + 2*u2 + 0.5*u;
+	double_t w3 = 0.5*u3 - 0.5*u2;
+	data.x = w0*p0.x + w1*p1.x + w2*p2.x + w3*p3.x;
+	data.y = w0*p0.y + w1*p1.y + w2*p2.y + w3*p3.y;
+	data.z = w0*p0.z + w1*p1.z + w2*p2.z + w3*p3.z;
+}
 GLfloatPoint Track::get(double_t t) {
 	GLfloatPoint data;
 	if (t > length()) {
 		int n = t / length();
 		t -= n*length();
 	}
-	double_t tot = start + t;
-	data.x = _x(tot);
-	data.y = _y(tot);
-	data.z = _z(tot);
+	evaluate(data, start + t);
+	return data;
+}
+//point on the centerline in world units
+GLfloatPoint Track::center(double_t t) {
+	GLfloatPoint data = get(t);
+	data.x *= scale;
+	data.y *= scale;
+	data.z *= scale;
 	return data;
 }
 void Track::set(GLfloatPoint& data, double_t t) {
 	
-	double_t tot = start + t;
-	data.x = _x(tot);
-	data.y = _y(tot);
-	data.z = _z(tot);
-
+	evaluate(data, start + t);
 }
 
 
 Track::~Track() {
-	delete[] verticies;
+}
+
+//the verticies from the last call to generateVerticies
+VertexView Track::verticies() const {
+	VertexView view = { vertexArena.empty() ? NULL : &vertexArena[0], vertexCount };
+	return view;
 }
 //returns the t-length of this track
 double_t Track::length() {
@@ -77,13 +149,9 @@ double_t Track::length() {
 
 double_t Track::tangent(double_t t, double_t dt) {
 	GLfloatPoint p0, p1;
-	double_t tot = start + t - dt;
 	//calculate the points
-	p0.x = _x(tot);
-	p0.z = _z(tot);
-	tot = start + t + dt;
-	p1.x = _x(tot);
-	p1.z = _z(tot);
+	evaluate(p0, start + t - dt);
+	evaluate(p1, start + t + dt);
 
 	double_t tang = atan((p1.z - p0.z) / (p1.x - p0.x));
 	return tang;
@@ -92,13 +160,9 @@ double_t Track::tangent(double_t t, double_t dt) {
 
 double_t Track::cosine(double_t t, double_t dt) {
 	GLfloatPoint p0, p1;
-	double_t tot = start + t - dt;
 	//calculate the points
-	p0.x = _x(tot);
-	p0.z = _z(tot);
-	tot = start + t + dt;
-	p1.x = _x(tot);
-	p1.z = _z(tot);
+	evaluate(p0, start + t - dt);
+	evaluate(p1, start + t + dt);
 
 	double_t cos = acos((p1.z - p0.z) / (p1.x - p0.x));
 	return cos;
@@ -107,13 +171,9 @@ double_t Track::cosine(double_t t, double_t dt) {
 //calculate the sine at a current point of the track, not sure if it has a purpose..
 double_t Track::sine(double_t t, double_t dt) {
 	GLfloatPoint p0, p1;
-	double_t tot = start + t - dt;
 	//calculate the points
-	p0.x = _x(tot);
-	p0.z = _z(tot);
-	tot = start + t + dt;
-	p1.x = _x(tot);
-	p1.z = _z(tot);
+	evaluate(p0, start + t - dt);
+	evaluate(p1, start + t + dt);
 
 	double_t sin = asin((p1.z - p0.z) / (p1.x - p0.x));
 	return sin;
@@ -125,30 +185,107 @@ double_t Track::normal(double_t t, double_t dt, bool left) {
 }
 
 
-//generate the verticies for the track edges.
-GLfloatPoint* Track::generateVerticies(int numVerticies, double track_width, double track_thickness) {
-	verticies = new GLfloatPoint[numVerticies];
-	const double_t dt = length() / numVerticies;
-	bool dir = false;
+//calculate the unit tangent vector (in scaled track space)
+GLfloatPoint Track::direction(double_t t, double_t dt) {
+	GLfloatPoint p0 = get(t - dt + (t < dt ? length() : 0));
+	GLfloatPoint p1 = get(t + dt);
+	GLfloatPoint dir;
+	dir.x = scale*(p1.x - p0.x);
+	dir.y = scale*(p1.y - p0.y);
+	dir.z = scale*(p1.z - p0.z);
+	double_t len = sqrt(dir.x*dir.x + dir.y*dir.y + dir.z*dir.z);
+	dir.x /= len;
+	dir.y /= len;
+	dir.z /= len;
+	return dir;
+}
+
+//generate the corners of the track cross-section at each sample:
+//top-left, top-right, bottom-right, bottom-left (left/right as seen driving along t).
+//overwrites the previous verticies in place, so it can be called every frame.
+VertexView Track::generateVerticies(int numSamples, double track_width, double track_thickness) {
+	TRACE_FUNCTION();
+	vertexCount = TRACK_CORNERS*numSamples;
+	if ((int)vertexArena.size() < vertexCount)
+		vertexArena.resize(vertexCount);
+	sampleCount = numSamples;
+	width = track_width;
+	thickness = track_thickness;
+	return regenerateVerticies(0, numSamples);
+}
+
+//take corners computed earlier (e.g. loaded from a cache) as if generateVerticies had produced them
+VertexView Track::adoptVerticies(const GLfloatPoint* corners, int numSamples, double track_width, double track_thickness) {
+	vertexCount = TRACK_CORNERS*numSamples;
+	if ((int)vertexArena.size() < vertexCount)
+		vertexArena.resize(vertexCount);
+	std::copy(corners, corners + vertexCount, vertexArena.begin());
+	sampleCount = numSamples;
+	width = track_width;
+	thickness = track_thickness;
+	return verticies();
+}
+
+//regenerate samples [first, first + count) of the last generateVerticies call, wrapping around
+VertexView Track::regenerateVerticies(int first, int count) {
+	TRACE_FUNCTION();
+	const double_t dt = length() / sampleCount;
+	const double_t halfWidth = 0.5*width;
 	GLfloatPoint trackPoint;
-	GLfloatPoint targetPoint;
 
-	for (int i = 0; i < numVerticies;i++) {
-		
-		targetPoint = *new GLfloatPoint();
+	for (int k = 0; k < count;k++) {
+		int i = (first + k) % sampleCount;
 		set(trackPoint, dt*i);
+		GLfloatPoint dir = direction(dt*i, dt);
 
-		double_t norm = normal(dt*i, dt, dir);
-		dir = !dir;
-		//alternate sides
+		//right is horizontal and perpendicular to the direction of travel
+		double_t rx = -dir.z, rz = dir.x;
+		double_t len = sqrt(rx*rx + rz*rz);
+		rx /= len;
+		rz /= len;
 
-		targetPoint.x = TRACK_MULTIPLIER*trackPoint.x + track_width*cos(norm);
-		targetPoint.z = TRACK_MULTIPLIER*trackPoint.z + track_width*sin(norm);
-		targetPoint.y = TRACK_MULTIPLIER*trackPoint.y;
-		verticies[i] = targetPoint;
-		
+		double_t cx = scale*trackPoint.x;
+		double_t cy = scale*trackPoint.y;
+		double_t cz = scale*trackPoint.z;
+		GLfloatPoint* corner = &vertexArena[TRACK_CORNERS*i];
+		corner[0].x = cx - halfWidth*rx; corner[0].y = cy; corner[0].z = cz - halfWidth*rz;
+		corner[1].x = cx + halfWidth*rx; corner[1].y = cy; corner[1].z = cz + halfWidth*rz;
+		corner[2] = corner[1];
+		corner[2].y -= thickness;
+		corner[3] = corner[0];
+		corner[3].y -= thickness;
 	}
-	return verticies;
+	return verticies();
+}
+
+//world units per track unit
+double_t Track::worldScale() const {
+	return scale;
+}
+
+//number of spline control points (0 for a parametric track)
+int Track::controlPointCount() const {
+	return (int)controlPoints.size();
+}
+
+GLfloatPoint Track::controlPoint(int i) const {
+	return controlPoints[i];
+}
+
+void Track::moveControlPoint(int i, const GLfloatPoint& point) {
+	controlPoints[i] = point;
+}
+
+//samples whose geometry depends on control point i: the spline uses four
+//points per span and direction() looks one sample either side
+void Track::influencedSamples(int i, int& first, int& count) const {
+	const double_t dt = (finish - start) / sampleCount;
+	first = (int)floor((i - 2) / dt) - 1;
+	int last = (int)ceil((i + 2) / dt) + 1;
+	count = last - first + 1;
+	if (count > sampleCount)
+		count = sampleCount;
+	first = ((first % sampleCount) + sampleCount) % sampleCount;
 }
 #define _H_TRACK_
 #endif
@@ -0,0 +1,203 @@
+//////////////////////////////////////////////////////
+// TrackAssets.h - Everything derived from one      //
+// track: mesh, sample tables, roadside geometry.   //
+//////////////////////////////////////////////////////
+
+#ifndef _H_TRACK_ASSETS_
+#define _H_TRACK_ASSETS_
+
+#include <vector>
+#include "Track.h"
+#include "TrackMesh.h"
+#include "ArcLength.h"
+#include "TrackBVH.h"
+#include "Renderer.h"
+
+// Segments are runs of this many samples; edits re-tessellate whole segments.
+const int SAMPLES_PER_SEGMENT = 8;
+
+// A run of samples [first, first + count) that was re-tessellated.
+struct SampleRange {
+	int first;
+	int count;
+};
+
+// CPU-side products of a track. Building them needs no GL context, so a
+// complete set can be prepared on a worker thread and swapped in whole.
+class TrackAssets {
+public:
+	Track* track;
+	double_t width;
+	double_t thickness;
+	int samples;
+	TrackMesh mesh;
+	ArcLengthTable arcLength;
+	TrackBVH bvh;
+	std::vector<InstanceData> railInstances;
+	InstanceData lapMarkerInstance;
+	//segments waiting for updateDirtySegments, and what the last update touched
+	std::vector<char> dirtySegments;
+	bool dirty;
+	std::vector<SampleRange> updatedRanges;
+	//box around the centerline the last update redid, before and after it
+	double_t editLower[3];
+	double_t editUpper[3];
+
+	TrackAssets(Track* ownedTrack, double_t trackWidth, double_t trackThickness);
+	~TrackAssets();
+	void rebuild(int numSamples);
+	void buildDerived();
+	void moveControlPoint(int i, const GLfloatPoint& point);
+	int updateDirtySegments();
+	void lanePoint(double_t d, double_t laneOffset, double_t height, GLfloat position[3], GLfloat forward[3]) const;
+
+private:
+	void buildRoadside();
+	void growEditBounds(const SampleRange& range);
+	TrackAssets(const TrackAssets&);
+	TrackAssets& operator=(const TrackAssets&);
+};
+
+TrackAssets::TrackAssets(Track* ownedTrack, double_t trackWidth, double_t trackThickness)
+	: track(ownedTrack), width(trackWidth), thickness(trackThickness), samples(0), dirty(false) {
+	for (int k = 0; k < 3; k++) {
+		editLower[k] = DBL_MAX;
+		editUpper[k] = -DBL_MAX;
+	}
+}
+
+TrackAssets::~TrackAssets() {
+	delete track;
+}
+
+// Re-tessellate the mesh and resample the tables at numSamples.
+void TrackAssets::rebuild(int numSamples) {
+	TRACE_FUNCTION();
+	ALLOC_SCOPE(ALLOC_TRACK);
+	samples = numSamples;
+	mesh.build(track->generateVerticies(samples, width, thickness));
+	int segments = samples / SAMPLES_PER_SEGMENT;
+	arcLength.build(*track, samples, segments > 0 ? segments : 1);
+	buildDerived();
+}
+
+// The BVH, roadside instances and edit state, which follow from the mesh
+// and tables; a scene cache restores those and calls this directly.
+void TrackAssets::buildDerived() {
+	bvh.build(arcLength, width, thickness);
+	buildRoadside();
+	dirtySegments.assign(arcLength.segmentCount(), 0);
+	dirty = false;
+}
+
+// Move a spline control point and mark the segments it reaches as dirty.
+// On a track with few points one point reaches every sample, and the run
+// can start mid-segment, so that case marks everything.
+void TrackAssets::moveControlPoint(int i, const GLfloatPoint& point) {
+	int first, count;
+	track->moveControlPoint(i, point);
+	track->influencedSamples(i, first, count);
+	const int segments = arcLength.segmentCount();
+	if (count >= samples)
+	{
+		dirtySegments.assign(segments, 1);
+		dirty = true;
+		return;
+	}
+	int firstSegment = arcLength.segmentOfSample(first);
+	int lastSegment = arcLength.segmentOfSample((first + count - 1) % samples);
+	for (int s = firstSegment;; s = (s + 1) % segments)
+	{
+		dirtySegments[s] = 1;
+		if (s == lastSegment)
+			break;
+	}
+	dirty = true;
+}
+
+// Re-tessellate and re-measure only the dirty segments, leaving the sample
+// runs that changed in updatedRanges. Returns the number of samples redone.
+int TrackAssets::updateDirtySegments() {
+	TRACE_FUNCTION();
+	ALLOC_SCOPE(ALLOC_TRACK);
+	updatedRanges.clear();
+	for (int k = 0; k < 3; k++) {
+		editLower[k] = DBL_MAX;
+		editUpper[k] = -DBL_MAX;
+	}
+	if (!dirty)
+		return 0;
+	const int segments = arcLength.segmentCount();
+	int redone = 0;
+	for (int s = 0; s < segments;) {
+		if (!dirtySegments[s]) {
+			s++;
+			continue;
+		}
+		int end = s;
+		while (end < segments && dirtySegments[end])
+			dirtySegments[end++] = 0;
+
+		SampleRange range = { arcLength.segmentStart[s], arcLength.segmentStart[end] - arcLength.segmentStart[s] };
+		growEditBounds(range);
+		mesh.rebuildRange(track->regenerateVerticies(range.first, range.count), range.first, range.count);
+		arcLength.rebuildSegments(*track, s, end - s);
+		growEditBounds(range);
+		bvh.refitSteps(range.first, range.count);
+		updatedRanges.push_back(range);
+		redone += range.count;
+		s = end;
+	}
+	//the posts are spaced by total length, so every post can shift (a fixed cost)
+	buildRoadside();
+	dirty = false;
+	return redone;
+}
+
+// Take in the centerline over a redone range, including the unchanged
+// samples either side, whose steps to it moved too.
+void TrackAssets::growEditBounds(const SampleRange& range) {
+	for (int i = range.first - 1; i <= range.first + range.count; i++) {
+		const GLfloatPoint& p = arcLength.points[(i + samples) % samples];
+		editLower[0] = std::min(editLower[0], p.x); editUpper[0] = std::max(editUpper[0], p.x);
+		editLower[1] = std::min(editLower[1], p.y); editUpper[1] = std::max(editUpper[1], p.y);
+		editLower[2] = std::min(editLower[2], p.z); editUpper[2] = std::max(editUpper[2], p.z);
+	}
+}
+
+// World position (height above the road surface) and unit direction at
+// distance d along the track, laneOffset to the right of the centerline.
+void TrackAssets::lanePoint(double_t d, double_t laneOffset, double_t height, GLfloat position[3], GLfloat forward[3]) const {
+	GLfloatPoint point, direction;
+	arcLength.frameAt(d, point, direction);
+	double_t rx = -direction.z, rz = direction.x;
+	double_t len = sqrt(rx*rx + rz*rz);
+	position[0] = GLfloat(point.x + laneOffset*rx / len);
+	position[1] = GLfloat(point.y + height);
+	position[2] = GLfloat(point.z + laneOffset*rz / len);
+	forward[0] = GLfloat(direction.x);
+	forward[1] = GLfloat(direction.y);
+	forward[2] = GLfloat(direction.z);
+}
+
+// Guardrail posts evenly spaced along the right-hand edge, and the lap
+// marker on the left-hand edge at the start line.
+void TrackAssets::buildRoadside() {
+	const double_t edge = 0.5*width + ROADSIDE_MARGIN;
+	const double_t spacing = arcLength.totalLength() / NBR_ROAD_INTERVALS;
+	GLfloat position[3], forward[3];
+
+	railInstances.resize(NBR_ROAD_INTERVALS);
+	for (int i = 0; i < NBR_ROAD_INTERVALS; i++) {
+		GLfloat* model = railInstances[i].model;
+		lanePoint(spacing*i, edge, 0, position, forward);
+		MatrixFromFrame(model, position, forward);
+		MatrixScale(model, GUARDRAIL_SCALE_FACTOR[0], GUARDRAIL_SCALE_FACTOR[1], GUARDRAIL_SCALE_FACTOR[2]);
+	}
+
+	lanePoint(0, -edge, 0, position, forward);
+	MatrixFromFrame(lapMarkerInstance.model, position, forward);
+	MatrixScale(lapMarkerInstance.model, LAP_MARKER_SCALE_FACTOR[0], LAP_MARKER_SCALE_FACTOR[1], LAP_MARKER_SCALE_FACTOR[2]);
+}
+
+#endif
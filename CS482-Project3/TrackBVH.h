@@ -0,0 +1,446 @@
+//////////////////////////////////////////////////////
+// TrackBVH.h - Bounding volume hierarchy over the  //
+// track's steps, for mapping positions and rays    //
+// back onto the track.                             //
+//////////////////////////////////////////////////////
+
+#ifndef _H_TRACK_BVH_
+#define _H_TRACK_BVH_
+
+#include <vector>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#include <functional>
+#include "ArcLength.h"
+
+// Steps per leaf; small leaves keep the exact tests few.
+const int TRACK_BVH_LEAF_SIZE = 4;
+// Deep enough for any tree built over an int number of steps.
+const int TRACK_BVH_STACK_SIZE = 64;
+
+// Where a position lies relative to the track.
+struct TrackProjection {
+	//closest point on the centerline
+	GLfloat point[3];
+	//track distance of that point, in [0, totalLength)
+	double_t distance;
+	//signed distance to the right of the centerline, as in TrackAssets::lanePoint
+	double_t lateralOffset;
+	//distance from the position to point
+	double_t separation;
+	//sample that starts the closest step
+	int step;
+};
+
+// Where a ray first meets the road surface.
+struct TrackRayHit {
+	//ray parameter, in units of the ray direction's length
+	double_t t;
+	GLfloat point[3];
+	double_t distance;
+	double_t lateralOffset;
+	int step;
+};
+
+// One primitive per step, the piece of road between sample i and i + 1.
+// Nodes bound only the centerline, which keeps nearest-point pruning
+// tight; ray tests widen a box by half the road width and the thickness
+// to cover the surface. Children follow their parent, so refit() is a
+// single reverse pass; refitSteps() redoes only the leaves holding the
+// given steps and their ancestors.
+class TrackBVH {
+public:
+	TrackBVH();
+	void build(const ArcLengthTable& table, double_t roadWidth, double_t roadThickness);
+	void refit();
+	void refitSteps(int firstSample, int sampleCount);
+	bool closestPoint(const GLfloat position[3], TrackProjection& result, bool ignoreHeight = false) const;
+	void closestPoints(const GLfloat* positions, int count, TrackProjection* results, bool ignoreHeight = false) const;
+	bool intersectRay(const GLfloat origin[3], const GLfloat direction[3], double_t maxT, TrackRayHit& hit) const;
+	int nodeCount() const;
+
+private:
+	struct Node {
+		GLfloat lower[3];
+		GLfloat upper[3];
+		//leaf: steps order[first, first + count); interior: count is 0, the
+		//left child is the next node and first is the right child
+		int first;
+		int count;
+	};
+	const ArcLengthTable* table;
+	double_t halfWidth;
+	double_t thickness;
+	std::vector<Node> nodes;
+	std::vector<int> order;
+	std::vector<int> parents;
+	std::vector<int> leafOfStep;
+	//nodes queued by refitSteps; refitMark[n] == refitPass marks node n queued
+	std::vector<int> refitQueue;
+	std::vector<unsigned> refitMark;
+	unsigned refitPass;
+
+	int buildNode(int begin, int end, int parent, std::vector<GLfloat>& centroids);
+	void refitNode(int n);
+	void stepBounds(int step, GLfloat lower[3], GLfloat upper[3]) const;
+	void stepCorners(int sample, GLfloat left[3], GLfloat right[3]) const;
+	double_t projectOnStep(int step, const GLfloat position[3], bool ignoreHeight, double_t& u) const;
+	bool closestFrom(const GLfloat position[3], int hint, TrackProjection& result, bool ignoreHeight) const;
+	void describe(int step, double_t u, const GLfloat position[3], TrackProjection& result) const;
+	static double_t boxDistance2(const Node& node, const GLfloat position[3], bool ignoreHeight);
+	bool boxRay(const Node& node, const GLfloat origin[3], const GLfloat inverse[3], double_t maxT) const;
+	static bool triangleRay(const GLfloat a[3], const GLfloat b[3], const GLfloat c[3],
+		const GLfloat origin[3], const GLfloat direction[3], double_t& t);
+};
+
+TrackBVH::TrackBVH() : table(NULL), halfWidth(0), thickness(0), refitPass(0) {
+}
+
+void TrackBVH::build(const ArcLengthTable& arcLength, double_t roadWidth, double_t roadThickness) {
+	table = &arcLength;
+	halfWidth = 0.5*roadWidth;
+	thickness = roadThickness;
+	const int steps = (int)table->points.size();
+	order.resize(steps);
+	std::vector<GLfloat> centroids(3 * steps);
+	for (int i = 0; i < steps; i++) {
+		order[i] = i;
+		const GLfloatPoint& a = table->points[i];
+		const GLfloatPoint& b = table->points[(i + 1) % steps];
+		centroids[3 * i] = 0.5f*(a.x + b.x);
+		centroids[3 * i + 1] = 0.5f*(a.y + b.y);
+		centroids[3 * i + 2] = 0.5f*(a.z + b.z);
+	}
+	nodes.clear();
+	parents.clear();
+	nodes.reserve(steps > 0 ? 2 * steps / TRACK_BVH_LEAF_SIZE + 1 : 0);
+	parents.reserve(nodes.capacity());
+	if (steps > 0)
+		buildNode(0, steps, -1, centroids);
+	leafOfStep.resize(steps);
+	for (int n = 0; n < (int)nodes.size(); n++)
+		for (int i = nodes[n].first; nodes[n].count > 0 && i < nodes[n].first + nodes[n].count; i++)
+			leafOfStep[order[i]] = n;
+	refitMark.assign(nodes.size(), 0);
+	refitPass = 0;
+	refit();
+}
+
+//top-down median split of order[begin, end) along the widest centroid axis
+int TrackBVH::buildNode(int begin, int end, int parent, std::vector<GLfloat>& centroids) {
+	int index = (int)nodes.size();
+	nodes.push_back(Node());
+	parents.push_back(parent);
+	if (end - begin <= TRACK_BVH_LEAF_SIZE) {
+		nodes[index].first = begin;
+		nodes[index].count = end - begin;
+		return index;
+	}
+	GLfloat lower[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, upper[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (int i = begin; i < end; i++)
+		for (int k = 0; k < 3; k++) {
+			lower[k] = std::min(lower[k], centroids[3 * order[i] + k]);
+			upper[k] = std::max(upper[k], centroids[3 * order[i] + k]);
+		}
+	int axis = 0;
+	for (int k = 1; k < 3; k++)
+		if (upper[k] - lower[k] > upper[axis] - lower[axis])
+			axis = k;
+	int middle = (begin + end) / 2;
+	std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+		[&](int a, int b) { return centroids[3 * a + axis] < centroids[3 * b + axis]; });
+
+	buildNode(begin, middle, index, centroids);
+	int right = buildNode(middle, end, index, centroids);
+	nodes[index].first = right;
+	nodes[index].count = 0;
+	return index;
+}
+
+//recompute every bound after the table's samples moved (same sample count)
+void TrackBVH::refit() {
+	for (int n = (int)nodes.size() - 1; n >= 0; n--)
+		refitNode(n);
+}
+
+//recompute the bounds touched by samples [firstSample, firstSample + sampleCount),
+//wrapping around the loop: the steps that start or end on them, their
+//leaves, and the ancestors of those leaves
+void TrackBVH::refitSteps(int firstSample, int sampleCount) {
+	const int steps = (int)leafOfStep.size();
+	if (steps == 0 || sampleCount <= 0)
+		return;
+	if (sampleCount + 1 >= steps) {
+		refit();
+		return;
+	}
+	if (++refitPass == 0) {
+		std::fill(refitMark.begin(), refitMark.end(), 0);
+		refitPass = 1;
+	}
+	refitQueue.clear();
+	for (int k = -1; k < sampleCount; k++) {
+		int leaf = leafOfStep[((firstSample + k) % steps + steps) % steps];
+		//stop at the first node already queued; its ancestors are too
+		for (int n = leaf; n >= 0 && refitMark[n] != refitPass; n = parents[n]) {
+			refitMark[n] = refitPass;
+			refitQueue.push_back(n);
+		}
+	}
+	//children have higher indices than their parents
+	std::sort(refitQueue.begin(), refitQueue.end(), std::greater<int>());
+	for (size_t i = 0; i < refitQueue.size(); i++)
+		refitNode(refitQueue[i]);
+}
+
+void TrackBVH::refitNode(int n) {
+	Node& node = nodes[n];
+	for (int k = 0; k < 3; k++) {
+		node.lower[k] = FLT_MAX;
+		node.upper[k] = -FLT_MAX;
+	}
+	GLfloat lower[3], upper[3];
+	if (node.count > 0) {
+		for (int i = node.first; i < node.first + node.count; i++) {
+			stepBounds(order[i], lower, upper);
+			for (int k = 0; k < 3; k++) {
+				node.lower[k] = std::min(node.lower[k], lower[k]);
+				node.upper[k] = std::max(node.upper[k], upper[k]);
+			}
+		}
+	}
+	else {
+		const Node& left = nodes[n + 1];
+		const Node& right = nodes[node.first];
+		for (int k = 0; k < 3; k++) {
+			node.lower[k] = std::min(left.lower[k], right.lower[k]);
+			node.upper[k] = std::max(left.upper[k], right.upper[k]);
+		}
+	}
+}
+
+int TrackBVH::nodeCount() const {
+	return (int)nodes.size();
+}
+
+//left and right edges of the road surface at a sample
+void TrackBVH::stepCorners(int sample, GLfloat left[3], GLfloat right[3]) const {
+	const GLfloatPoint& p = table->points[sample];
+	const GLfloatPoint& dir = table->directions[sample];
+	double_t rx = -dir.z, rz = dir.x;
+	double_t len = sqrt(rx*rx + rz*rz);
+	rx *= halfWidth / len;
+	rz *= halfWidth / len;
+	left[0] = GLfloat(p.x - rx); left[1] = p.y; left[2] = GLfloat(p.z - rz);
+	right[0] = GLfloat(p.x + rx); right[1] = p.y; right[2] = GLfloat(p.z + rz);
+}
+
+void TrackBVH::stepBounds(int step, GLfloat lower[3], GLfloat upper[3]) const {
+	const GLfloatPoint& a = table->points[step];
+	const GLfloatPoint& b = table->points[(step + 1) % (int)table->points.size()];
+	lower[0] = std::min(a.x, b.x); upper[0] = std::max(a.x, b.x);
+	lower[1] = std::min(a.y, b.y); upper[1] = std::max(a.y, b.y);
+	lower[2] = std::min(a.z, b.z); upper[2] = std::max(a.z, b.z);
+}
+
+//squared distance from position to the step's centerline; u is the fraction along the step
+double_t TrackBVH::projectOnStep(int step, const GLfloat position[3], bool ignoreHeight, double_t& u) const {
+	const GLfloatPoint& a = table->points[step];
+	const GLfloatPoint& b = table->points[(step + 1) % (int)table->points.size()];
+	double_t h = ignoreHeight ? 0 : 1;
+	double_t ab[3] = { b.x - a.x, h*(b.y - a.y), b.z - a.z };
+	double_t ap[3] = { position[0] - a.x, h*(position[1] - a.y), position[2] - a.z };
+	double_t len2 = ab[0] * ab[0] + ab[1] * ab[1] + ab[2] * ab[2];
+	u = len2 > 0 ? (ap[0] * ab[0] + ap[1] * ab[1] + ap[2] * ab[2]) / len2 : 0;
+	u = u < 0 ? 0 : (u > 1 ? 1 : u);
+	double_t d2 = 0;
+	for (int k = 0; k < 3; k++)
+		d2 += (ap[k] - u*ab[k])*(ap[k] - u*ab[k]);
+	return d2;
+}
+
+void TrackBVH::describe(int step, double_t u, const GLfloat position[3], TrackProjection& result) const {
+	const int steps = (int)table->points.size();
+	const GLfloatPoint& a = table->points[step];
+	const GLfloatPoint& b = table->points[(step + 1) % steps];
+	result.point[0] = GLfloat(a.x + u*(b.x - a.x));
+	result.point[1] = GLfloat(a.y + u*(b.y - a.y));
+	result.point[2] = GLfloat(a.z + u*(b.z - a.z));
+	double_t d0 = table->distanceAt(step);
+	result.distance = table->wrap(d0 + u*(table->distanceAt(step + 1) - d0));
+
+	double_t rx = -(b.z - a.z), rz = b.x - a.x;
+	double_t len = sqrt(rx*rx + rz*rz);
+	result.lateralOffset = len > 0 ? ((position[0] - result.point[0])*rx + (position[2] - result.point[2])*rz) / len : 0;
+	result.step = step;
+}
+
+double_t TrackBVH::boxDistance2(const Node& node, const GLfloat position[3], bool ignoreHeight) {
+	double_t d2 = 0;
+	for (int k = 0; k < 3; k++) {
+		if (k == 1 && ignoreHeight)
+			continue;
+		double_t d = 0;
+		if (position[k] < node.lower[k])
+			d = node.lower[k] - position[k];
+		else if (position[k] > node.upper[k])
+			d = position[k] - node.upper[k];
+		d2 += d*d;
+	}
+	return d2;
+}
+
+//best-first descent; a hint step seeds the search radius so coherent queries prune early
+bool TrackBVH::closestFrom(const GLfloat position[3], int hint, TrackProjection& result, bool ignoreHeight) const {
+	if (nodes.empty())
+		return false;
+	double_t u, bestU = 0;
+	double_t best = DBL_MAX;
+	int bestStep = -1;
+	if (hint >= 0 && hint < (int)table->points.size()) {
+		best = projectOnStep(hint, position, ignoreHeight, bestU);
+		bestStep = hint;
+	}
+
+	int stack[TRACK_BVH_STACK_SIZE];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const Node& node = nodes[stack[--top]];
+		if (boxDistance2(node, position, ignoreHeight) >= best)
+			continue;
+		if (node.count > 0) {
+			for (int i = node.first; i < node.first + node.count; i++) {
+				double_t d2 = projectOnStep(order[i], position, ignoreHeight, u);
+				if (d2 < best) {
+					best = d2;
+					bestU = u;
+					bestStep = order[i];
+				}
+			}
+			continue;
+		}
+		//visit the nearer child first
+		int left = int(&node - &nodes[0]) + 1, right = node.first;
+		if (boxDistance2(nodes[left], position, ignoreHeight) < boxDistance2(nodes[right], position, ignoreHeight))
+			std::swap(left, right);
+		stack[top++] = left;
+		stack[top++] = right;
+	}
+
+	describe(bestStep, bestU, position, result);
+	result.separation = sqrt(best);
+	return true;
+}
+
+// Closest centerline point to position. With ignoreHeight the search is
+// in the ground plane, which suits placing things beside the road.
+bool TrackBVH::closestPoint(const GLfloat position[3], TrackProjection& result, bool ignoreHeight) const {
+	return closestFrom(position, -1, result, ignoreHeight);
+}
+
+// Project count positions (x, y, z triples). Each query starts from the
+// previous answer, so positions sorted along the track cost little more
+// than one descent each.
+void TrackBVH::closestPoints(const GLfloat* positions, int count, TrackProjection* results, bool ignoreHeight) const {
+	int hint = -1;
+	for (int i = 0; i < count; i++) {
+		if (closestFrom(positions + 3 * i, hint, results[i], ignoreHeight))
+			hint = results[i].step;
+	}
+}
+
+//slab test against a node widened to the road surface, given the reciprocal of the ray direction
+bool TrackBVH::boxRay(const Node& node, const GLfloat origin[3], const GLfloat inverse[3], double_t maxT) const {
+	const double_t below[3] = { halfWidth, thickness, halfWidth };
+	const double_t above[3] = { halfWidth, 0, halfWidth };
+	double_t enter = 0, leave = maxT;
+	for (int k = 0; k < 3; k++) {
+		double_t t0 = (node.lower[k] - below[k] - origin[k])*inverse[k];
+		double_t t1 = (node.upper[k] + above[k] - origin[k])*inverse[k];
+		if (t0 > t1)
+			std::swap(t0, t1);
+		enter = std::max(enter, t0);
+		leave = std::min(leave, t1);
+		if (enter > leave)
+			return false;
+	}
+	return true;
+}
+
+//Moller-Trumbore, either side of the triangle
+bool TrackBVH::triangleRay(const GLfloat a[3], const GLfloat b[3], const GLfloat c[3],
+	const GLfloat origin[3], const GLfloat direction[3], double_t& t) {
+	double_t e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+	double_t e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+	double_t p[3] = { direction[1] * e2[2] - direction[2] * e2[1],
+		direction[2] * e2[0] - direction[0] * e2[2],
+		direction[0] * e2[1] - direction[1] * e2[0] };
+	double_t det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+	if (fabs(det) < 1e-12)
+		return false;
+	double_t s[3] = { origin[0] - a[0], origin[1] - a[1], origin[2] - a[2] };
+	double_t u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) / det;
+	if (u < 0 || u > 1)
+		return false;
+	double_t q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+	double_t v = (direction[0] * q[0] + direction[1] * q[1] + direction[2] * q[2]) / det;
+	if (v < 0 || u + v > 1)
+		return false;
+	t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) / det;
+	return t >= 0;
+}
+
+// First hit of origin + t*direction (0 <= t <= maxT) with the road's top surface.
+bool TrackBVH::intersectRay(const GLfloat origin[3], const GLfloat direction[3], double_t maxT, TrackRayHit& hit) const {
+	if (nodes.empty())
+		return false;
+	GLfloat inverse[3];
+	for (int k = 0; k < 3; k++)
+		inverse[k] = direction[k] != 0 ? 1.0f / direction[k] : FLT_MAX;
+
+	const int steps = (int)table->points.size();
+	double_t best = maxT;
+	int bestStep = -1;
+	int stack[TRACK_BVH_STACK_SIZE];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		int index = stack[--top];
+		const Node& node = nodes[index];
+		if (!boxRay(node, origin, inverse, best))
+			continue;
+		if (node.count == 0) {
+			stack[top++] = node.first;
+			stack[top++] = index + 1;
+			continue;
+		}
+		for (int i = node.first; i < node.first + node.count; i++) {
+			GLfloat l0[3], r0[3], l1[3], r1[3];
+			stepCorners(order[i], l0, r0);
+			stepCorners((order[i] + 1) % steps, l1, r1);
+			double_t t;
+			if ((triangleRay(l0, r0, r1, origin, direction, t) || triangleRay(l0, r1, l1, origin, direction, t)) && t < best) {
+				best = t;
+				bestStep = order[i];
+			}
+		}
+	}
+	if (bestStep < 0)
+		return false;
+
+	hit.t = best;
+	for (int k = 0; k < 3; k++)
+		hit.point[k] = GLfloat(origin[k] + best*direction[k]);
+	TrackProjection projection;
+	double_t u;
+	projectOnStep(bestStep, hit.point, true, u);
+	describe(bestStep, u, hit.point, projection);
+	hit.distance = projection.distance;
+	hit.lateralOffset = projection.lateralOffset;
+	hit.step = bestStep;
+	return true;
+}
+
+#endif
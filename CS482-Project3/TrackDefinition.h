@@ -0,0 +1,94 @@
+//////////////////////////////////////////////////////
+// TrackDefinition.h - Text track definition files  //
+// (closed spline control points plus dimensions).  //
+//////////////////////////////////////////////////////
+
+#ifndef _H_TRACK_DEFINITION_
+#define _H_TRACK_DEFINITION_
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Track.h"
+
+// File format, one directive per line ('#' starts a comment):
+//   scale <world units per track unit>
+//   width <road width>
+//   thickness <road thickness>
+//   point <x> <y> <z>        (at least four, in driving order)
+struct TrackDefinition {
+	std::vector<GLfloatPoint> controlPoints;
+	double_t scale;
+	double_t width;
+	double_t thickness;
+};
+
+// Parse a definition from text. On failure returns false and describes the problem in error.
+bool ParseTrackDefinition(const std::string& text, TrackDefinition& def, std::string& error)
+{
+	def.controlPoints.clear();
+	def.scale = TRACK_MULTIPLIER;
+	def.width = ROAD_WIDTH;
+	def.thickness = TRACK_THICKNESS;
+
+	std::istringstream input(text);
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(input, line))
+	{
+		lineNumber++;
+		size_t comment = line.find('#');
+		if (comment != std::string::npos)
+			line.erase(comment);
+		std::istringstream fields(line);
+		std::string keyword;
+		if (!(fields >> keyword))
+			continue;
+
+		bool ok;
+		if (keyword == "point")
+		{
+			GLfloatPoint point;
+			ok = (fields >> point.x >> point.y >> point.z) ? true : false;
+			if (ok)
+				def.controlPoints.push_back(point);
+		}
+		else if (keyword == "scale")
+			ok = (fields >> def.scale) && def.scale > 0;
+		else if (keyword == "width")
+			ok = (fields >> def.width) && def.width > 0;
+		else if (keyword == "thickness")
+			ok = (fields >> def.thickness) && def.thickness >= 0;
+		else
+			ok = false;
+
+		if (!ok)
+		{
+			std::ostringstream message;
+			message << "line " << lineNumber << ": cannot parse \"" << line << "\"";
+			error = message.str();
+			return false;
+		}
+	}
+	if (def.controlPoints.size() < 4)
+	{
+		error = "a track needs at least four points";
+		return false;
+	}
+	return true;
+}
+
+// Read the whole file into text; false if it cannot be opened.
+bool ReadTrackFile(const std::string& path, std::string& text)
+{
+	std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+	if (!file)
+		return false;
+	std::ostringstream contents;
+	contents << file.rdbuf();
+	text = contents.str();
+	return true;
+}
+
+#endif
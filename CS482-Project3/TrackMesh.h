@@ -0,0 +1,116 @@
+//////////////////////////////////////////////////////
+// TrackMesh.h - Closed, indexed track volume built //
+// from the cross-section corners of a Track.       //
+//////////////////////////////////////////////////////
+
+#ifndef _H_TRACK_MESH_
+#define _H_TRACK_MESH_
+
+#include "Mesh.h"
+#include "VertexCache.h"
+#include "Track.h"
+
+// Each cross-section becomes four faces (top, right wall, bottom, left wall)
+// with two verticies apiece so every face keeps a hard normal.
+const int TRACK_RING_VERTICIES = 2 * TRACK_CORNERS;
+
+class TrackMesh {
+public:
+	MeshData mesh;
+	int numSamples;
+	double acmrBefore;
+	double acmrAfter;
+
+	TrackMesh();
+	void build(VertexView corners);
+	void rebuildRange(VertexView corners, int firstSample, int count);
+
+private:
+	void writeRing(const GLfloatPoint* corners, MeshVertex* ring);
+	void buildIndices();
+};
+
+TrackMesh::TrackMesh() : numSamples(0), acmrBefore(0.0), acmrAfter(0.0) {
+}
+
+// Rebuilds in place; once the buffers have grown to size this does not allocate.
+void TrackMesh::build(VertexView corners) {
+	const int samples = corners.count / TRACK_CORNERS;
+	mesh.verticies.resize(samples * TRACK_RING_VERTICIES);
+	for (int i = 0; i < samples; i++)
+		writeRing(&corners.data[TRACK_CORNERS * i], &mesh.verticies[TRACK_RING_VERTICIES * i]);
+
+	// Topology depends only on the sample count.
+	if (samples != numSamples)
+	{
+		numSamples = samples;
+		buildIndices();
+	}
+}
+
+// Rewrite the rings of samples [firstSample, firstSample + count), wrapping
+// around the loop. The index list is unchanged.
+void TrackMesh::rebuildRange(VertexView corners, int firstSample, int count) {
+	for (int k = 0; k < count; k++)
+	{
+		int i = (firstSample + k) % numSamples;
+		writeRing(&corners.data[TRACK_CORNERS * i], &mesh.verticies[TRACK_RING_VERTICIES * i]);
+	}
+}
+
+// Expand one cross-section into its ring of face verticies.
+void TrackMesh::writeRing(const GLfloatPoint* c, MeshVertex* ring) {
+	// Frame of the cross-section: right across the top, up through the walls.
+	double_t right[3] = { c[1].x - c[0].x, c[1].y - c[0].y, c[1].z - c[0].z };
+	double_t up[3] = { c[0].x - c[3].x + c[1].x - c[2].x, c[0].y - c[3].y + c[1].y - c[2].y,
+		c[0].z - c[3].z + c[1].z - c[2].z };
+	double_t rightLength = sqrt(right[0] * right[0] + right[1] * right[1] + right[2] * right[2]);
+	double_t upLength = sqrt(up[0] * up[0] + up[1] * up[1] + up[2] * up[2]);
+	GLfloat r[3], u[3];
+	for (int k = 0; k < 3; k++)
+	{
+		r[k] = GLfloat(right[k] / rightLength);
+		u[k] = GLfloat(upLength > 0.0 ? up[k] / upLength : (k == 1 ? 1.0 : 0.0));
+	}
+
+	// Corners 0-3 are top-left, top-right, bottom-right, bottom-left.
+	const int faceCorner[TRACK_RING_VERTICIES] = { 0, 1, 1, 2, 2, 3, 3, 0 };
+	const GLfloat faceNormal[4][3] = { { u[0], u[1], u[2] }, { r[0], r[1], r[2] },
+		{ -u[0], -u[1], -u[2] }, { -r[0], -r[1], -r[2] } };
+	for (int k = 0; k < TRACK_RING_VERTICIES; k++)
+	{
+		const GLfloatPoint& p = c[faceCorner[k]];
+		const GLfloat* n = faceNormal[k / 2];
+		MeshVertex& v = ring[k];
+		v.position[0] = GLfloat(p.x);
+		v.position[1] = GLfloat(p.y);
+		v.position[2] = GLfloat(p.z);
+		v.normal[0] = n[0];
+		v.normal[1] = n[1];
+		v.normal[2] = n[2];
+	}
+}
+
+void TrackMesh::buildIndices() {
+	mesh.indices.clear();
+	for (int i = 0; i < numSamples; i++)
+	{
+		// The last ring joins the first, closing the loop.
+		GLuint ring = i * TRACK_RING_VERTICIES;
+		GLuint nextRing = ((i + 1) % numSamples) * TRACK_RING_VERTICIES;
+		for (int face = 0; face < TRACK_RING_VERTICIES; face += 2)
+		{
+			GLuint a = ring + face, b = a + 1;
+			GLuint c = nextRing + face, d = c + 1;
+			mesh.addTriangle(a, b, c);
+			mesh.addTriangle(b, d, c);
+		}
+	}
+
+	int vertexCount = numSamples * TRACK_RING_VERTICIES;
+	acmrBefore = ComputeACMR(mesh.indices, vertexCount, VERTEX_CACHE_SIZE);
+	OptimizeVertexCache(mesh.indices, vertexCount);
+	acmrAfter = ComputeACMR(mesh.indices, vertexCount, VERTEX_CACHE_SIZE);
+}
+
+#endif
@@ -0,0 +1,256 @@
+//////////////////////////////////////////////////////
+// TrackReload.h - Watches the track definition     //
+// file and rebuilds its assets in the background.  //
+//////////////////////////////////////////////////////
+
+#ifndef _H_TRACK_RELOAD_
+#define _H_TRACK_RELOAD_
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include "TrackDefinition.h"
+#include "TrackAssets.h"
+#include "Trace.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+// How long the watcher sleeps between checks for a stop request.
+const int TRACK_WATCH_TIMEOUT_MS = 250;
+// Editors often write a file in several steps; wait for them to finish.
+const int TRACK_RELOAD_SETTLE_MS = 50;
+
+// Build a complete set of assets from a definition.
+TrackAssets* BuildTrackAssets(const TrackDefinition& def, int samples)
+{
+	TrackAssets* assets = new TrackAssets(new Track(def.controlPoints, def.scale), def.width, def.thickness);
+	assets->rebuild(samples);
+	return assets;
+}
+
+// FNV-1a hash, used to skip rebuilds when a file is touched but not changed.
+unsigned long long HashText(const std::string& text)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < text.size(); i++)
+	{
+		hash ^= (unsigned char)text[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+// Watches one definition file. Each change is parsed and built on the
+// watcher thread; the render thread collects the finished assets with
+// takePending() at a frame boundary, so it never waits on a rebuild.
+class TrackReloader {
+	std::string path;
+	std::string directory;
+	std::string fileName;
+	std::thread watcher;
+	std::atomic<bool> running;
+	std::atomic<int> samples;
+	std::atomic<TrackAssets*> pending;
+	unsigned long long lastHash;
+	//watcher thread only; open for the thread's whole life
+#if defined(_WIN32)
+	HANDLE change;
+#elif defined(__linux__)
+	int notify;
+#endif
+
+public:
+	TrackReloader();
+	~TrackReloader();
+	void start(const std::string& definitionPath, unsigned long long loadedHash, int numSamples);
+	void stop();
+	void setSamples(int numSamples);
+	TrackAssets* takePending();
+
+private:
+	void run();
+	void openWatch();
+	void waitForChange();
+	void closeWatch();
+	void rebuild();
+};
+
+TrackReloader::TrackReloader() : running(false), samples(0), pending(NULL), lastHash(0)
+#if defined(_WIN32)
+	, change(INVALID_HANDLE_VALUE)
+#elif defined(__linux__)
+	, notify(-1)
+#endif
+{
+}
+
+TrackReloader::~TrackReloader() {
+	stop();
+	delete pending.exchange(NULL);
+}
+
+void TrackReloader::start(const std::string& definitionPath, unsigned long long loadedHash, int numSamples) {
+	path = definitionPath;
+	size_t slash = path.find_last_of("/\\");
+	directory = (slash == std::string::npos) ? "." : path.substr(0, slash);
+	fileName = (slash == std::string::npos) ? path : path.substr(slash + 1);
+	lastHash = loadedHash;
+	samples = numSamples;
+	running = true;
+	watcher = std::thread(&TrackReloader::run, this);
+}
+
+void TrackReloader::stop() {
+	running = false;
+	if (watcher.joinable())
+		watcher.join();
+}
+
+// Later rebuilds use this sample count.
+void TrackReloader::setSamples(int numSamples) {
+	samples = numSamples;
+}
+
+// The most recently built assets, or NULL if nothing new is ready.
+TrackAssets* TrackReloader::takePending() {
+	return pending.exchange(NULL);
+}
+
+// The watch stays open across rebuilds, so a save that lands during the
+// settle delay or a rebuild is still pending when the next wait starts.
+void TrackReloader::run() {
+	TraceThreadName("track reloader");
+	openWatch();
+	while (running)
+	{
+		waitForChange();
+		if (running)
+			rebuild();
+	}
+	closeWatch();
+}
+
+void TrackReloader::rebuild() {
+	std::this_thread::sleep_for(std::chrono::milliseconds(TRACK_RELOAD_SETTLE_MS));
+	TRACE_SCOPE("track rebuild");
+	ALLOC_SCOPE(ALLOC_TRACK);
+
+	std::string text, error;
+	if (!ReadTrackFile(path, text))
+		return;
+	unsigned long long hash = HashText(text);
+	if (hash == lastHash)
+		return;
+	lastHash = hash;
+
+	TrackDefinition def;
+	if (!ParseTrackDefinition(text, def, error))
+	{
+		std::cerr << path << ": " << error << " (keeping the current track)" << std::endl;
+		return;
+	}
+	TrackAssets* assets = BuildTrackAssets(def, samples);
+	// A build that was never picked up is superseded by this one.
+	delete pending.exchange(assets);
+}
+
+#if defined(__linux__)
+
+// Watch the directory so editors that replace the file by renaming are seen too.
+void TrackReloader::openWatch() {
+	notify = inotify_init1(IN_NONBLOCK);
+	if (notify >= 0 && inotify_add_watch(notify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0)
+		closeWatch();
+}
+
+// Block until events for the definition file have been read (or a stop
+// request). Events queued since the last call, including those raised
+// during a rebuild, are read first.
+void TrackReloader::waitForChange() {
+	if (notify < 0)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(TRACK_WATCH_TIMEOUT_MS));
+		return;
+	}
+	alignas(struct inotify_event) char buffer[4096];
+	bool changed = false;
+	while (running && !changed)
+	{
+		struct pollfd descriptor = { notify, POLLIN, 0 };
+		if (poll(&descriptor, 1, TRACK_WATCH_TIMEOUT_MS) <= 0)
+			continue;
+		// Drain everything queued; saves that land during the next rebuild
+		// queue up behind it.
+		ssize_t length;
+		while ((length = read(notify, buffer, sizeof(buffer))) > 0)
+			for (ssize_t offset = 0; offset < length;)
+			{
+				const struct inotify_event* event = (const struct inotify_event*)(buffer + offset);
+				if (event->len > 0 && fileName == event->name)
+					changed = true;
+				offset += sizeof(struct inotify_event) + event->len;
+			}
+	}
+}
+
+void TrackReloader::closeWatch() {
+	if (notify >= 0)
+		close(notify);
+	notify = -1;
+}
+
+#elif defined(_WIN32)
+
+void TrackReloader::openWatch() {
+	change = FindFirstChangeNotificationA(directory.c_str(), FALSE,
+		FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+}
+
+// Block on directory change notifications (or a stop request). The handle
+// is re-armed as soon as it fires, so changes made during the rebuild that
+// follows are recorded and satisfy the next wait at once. Any change in the
+// directory wakes us; rebuild() skips files whose contents are unchanged.
+void TrackReloader::waitForChange() {
+	if (change == INVALID_HANDLE_VALUE)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(TRACK_WATCH_TIMEOUT_MS));
+		return;
+	}
+	while (running)
+		if (WaitForSingleObject(change, TRACK_WATCH_TIMEOUT_MS) == WAIT_OBJECT_0)
+		{
+			FindNextChangeNotification(change);
+			return;
+		}
+}
+
+void TrackReloader::closeWatch() {
+	if (change != INVALID_HANDLE_VALUE)
+		FindCloseChangeNotification(change);
+	change = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+void TrackReloader::openWatch() {
+}
+
+// No change notifications: poll, relying on the content hash in rebuild().
+void TrackReloader::waitForChange() {
+	std::this_thread::sleep_for(std::chrono::milliseconds(TRACK_WATCH_TIMEOUT_MS));
+}
+
+void TrackReloader::closeWatch() {
+}
+
+#endif
+
+#endif
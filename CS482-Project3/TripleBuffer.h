@@ -0,0 +1,81 @@
+//////////////////////////////////////////////////////
+// TripleBuffer.h - Lock-free latest-value handoff  //
+// from one writer thread to one reader thread.     //
+//////////////////////////////////////////////////////
+
+#ifndef _H_TRIPLE_BUFFER_
+#define _H_TRIPLE_BUFFER_
+
+#include <atomic>
+#include "SpscRing.h"
+
+// The writer fills its back slot and publishes it by swapping it with the
+// middle slot; the reader takes the middle slot by swapping it with its
+// front slot. Neither side ever waits, the writer never overwrites what the
+// reader holds, and the reader always gets the most recently published
+// value (intermediate ones are skipped).
+template <typename T>
+class TripleBuffer {
+public:
+	TripleBuffer();
+	T& back();
+	void publish();
+	bool fresh() const;
+	bool acquire();
+	const T& front() const;
+
+private:
+	//marks a middle slot published since the reader last took one
+	static const int FRESH = 4;
+	static const int INDEX_MASK = 3;
+	struct alignas(CACHE_LINE_SIZE) Slot {
+		T value;
+	};
+	Slot slots[3];
+	alignas(CACHE_LINE_SIZE) std::atomic<int> middle;
+	alignas(CACHE_LINE_SIZE) int backIndex;	//writer only
+	alignas(CACHE_LINE_SIZE) int frontIndex;	//reader only
+
+	TripleBuffer(const TripleBuffer&);
+	TripleBuffer& operator=(const TripleBuffer&);
+};
+
+template <typename T>
+TripleBuffer<T>::TripleBuffer() : slots(), middle(1), backIndex(0), frontIndex(2) {
+}
+
+// Writer only. The slot to fill for the next publish.
+template <typename T>
+T& TripleBuffer<T>::back() {
+	return slots[backIndex].value;
+}
+
+// Writer only.
+template <typename T>
+void TripleBuffer<T>::publish() {
+	backIndex = middle.exchange(backIndex | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+}
+
+// Either side: whether a value has been published that the reader has not taken.
+template <typename T>
+bool TripleBuffer<T>::fresh() const {
+	return (middle.load(std::memory_order_acquire) & FRESH) != 0;
+}
+
+// Reader only. Moves front() to the latest published value; returns false,
+// leaving it unchanged, if nothing new has been published.
+template <typename T>
+bool TripleBuffer<T>::acquire() {
+	if (!fresh())
+		return false;
+	frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & INDEX_MASK;
+	return true;
+}
+
+// Reader only.
+template <typename T>
+const T& TripleBuffer<T>::front() const {
+	return slots[frontIndex].value;
+}
+
+#endif
@@ -0,0 +1,157 @@
+//////////////////////////////////////////////////////
+// VertexCache.h - Post-transform vertex cache      //
+// triangle reordering and ACMR measurement.        //
+//////////////////////////////////////////////////////
+
+#ifndef _H_VERTEX_CACHE_
+#define _H_VERTEX_CACHE_
+
+#include <vector>
+#include <cmath>
+
+// Simulated cache size; 32 entries is typical for current GPUs.
+const int VERTEX_CACHE_SIZE = 32;
+
+// Average cache miss ratio: transformed verticies per triangle,
+// simulating a FIFO post-transform cache of cacheSize entries.
+double ComputeACMR(const std::vector<GLuint>& indices, int vertexCount, int cacheSize)
+{
+	if (indices.empty())
+		return 0.0;
+	std::vector<int> insertedAt(vertexCount, -cacheSize - 1);
+	int misses = 0;
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		GLuint v = indices[i];
+		if (misses - insertedAt[v] > cacheSize)
+		{
+			insertedAt[v] = misses;
+			misses++;
+		}
+	}
+	return double(misses) / (indices.size() / 3);
+}
+
+// Score of a vertex from its LRU cache position and remaining triangles
+// (Forsyth, "Linear-Speed Vertex Cache Optimisation").
+double VertexCacheScore(int cachePosition, int remainingTriangles)
+{
+	if (remainingTriangles == 0)
+		return -1.0;
+	double score = 0.0;
+	if (cachePosition >= 0)
+	{
+		if (cachePosition < 3)
+			score = 0.75;
+		else
+			score = pow(1.0 - double(cachePosition - 3) / (VERTEX_CACHE_SIZE - 3), 1.5);
+	}
+	return score + 2.0 / sqrt(double(remainingTriangles));
+}
+
+// Reorder the triangles of an indexed list for post-transform cache reuse.
+// The vertex buffer is left untouched.
+void OptimizeVertexCache(std::vector<GLuint>& indices, int vertexCount)
+{
+	const int triangleCount = (int)indices.size() / 3;
+	if (triangleCount == 0)
+		return;
+
+	// Triangle adjacency per vertex.
+	std::vector<int> remaining(vertexCount, 0);
+	for (size_t i = 0; i < indices.size(); i++)
+		remaining[indices[i]]++;
+	std::vector<int> firstTriangle(vertexCount + 1, 0);
+	for (int v = 0; v < vertexCount; v++)
+		firstTriangle[v + 1] = firstTriangle[v] + remaining[v];
+	std::vector<int> vertexTriangles(indices.size());
+	std::vector<int> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+	for (int t = 0; t < triangleCount; t++)
+		for (int k = 0; k < 3; k++)
+			vertexTriangles[fill[indices[3 * t + k]]++] = t;
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<double> vertexScore(vertexCount);
+	for (int v = 0; v < vertexCount; v++)
+		vertexScore[v] = VertexCacheScore(-1, remaining[v]);
+	std::vector<double> triangleScore(triangleCount);
+	std::vector<bool> emitted(triangleCount, false);
+	for (int t = 0; t < triangleCount; t++)
+		triangleScore[t] = vertexScore[indices[3 * t]] + vertexScore[indices[3 * t + 1]] + vertexScore[indices[3 * t + 2]];
+
+	std::vector<GLuint> output;
+	output.reserve(indices.size());
+	std::vector<int> cache, nextCache;
+	cache.reserve(VERTEX_CACHE_SIZE + 3);
+	nextCache.reserve(VERTEX_CACHE_SIZE + 3);
+	int scanCursor = 0;
+	int best = -1;
+
+	for (int emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+	{
+		// Fall back to a linear scan when nothing in the cache is usable.
+		if (best < 0)
+		{
+			while (emitted[scanCursor])
+				scanCursor++;
+			best = scanCursor;
+		}
+
+		emitted[best] = true;
+		for (int k = 0; k < 3; k++)
+		{
+			GLuint v = indices[3 * best + k];
+			output.push_back(v);
+			remaining[v]--;
+			// Drop the triangle from this vertex's list.
+			for (int i = firstTriangle[v]; i < firstTriangle[v] + remaining[v] + 1; i++)
+				if (vertexTriangles[i] == best)
+				{
+					vertexTriangles[i] = vertexTriangles[firstTriangle[v] + remaining[v]];
+					break;
+				}
+		}
+
+		// Move the triangle's verticies to the front of the LRU cache.
+		nextCache.clear();
+		for (int k = 0; k < 3; k++)
+			nextCache.push_back(indices[3 * best + k]);
+		for (size_t i = 0; i < cache.size(); i++)
+			if (cache[i] != nextCache[0] && cache[i] != nextCache[1] && cache[i] != nextCache[2])
+				nextCache.push_back(cache[i]);
+		for (size_t i = VERTEX_CACHE_SIZE; i < nextCache.size(); i++)
+		{
+			cachePosition[nextCache[i]] = -1;
+			vertexScore[nextCache[i]] = VertexCacheScore(-1, remaining[nextCache[i]]);
+		}
+		if (nextCache.size() > (size_t)VERTEX_CACHE_SIZE)
+			nextCache.resize(VERTEX_CACHE_SIZE);
+		cache.swap(nextCache);
+
+		// Rescore the cached verticies and pick the best triangle touching them.
+		for (size_t i = 0; i < cache.size(); i++)
+		{
+			cachePosition[cache[i]] = (int)i;
+			vertexScore[cache[i]] = VertexCacheScore((int)i, remaining[cache[i]]);
+		}
+		best = -1;
+		double bestScore = -1.0;
+		for (size_t i = 0; i < cache.size(); i++)
+		{
+			int v = cache[i];
+			for (int j = firstTriangle[v]; j < firstTriangle[v] + remaining[v]; j++)
+			{
+				int t = vertexTriangles[j];
+				triangleScore[t] = vertexScore[indices[3 * t]] + vertexScore[indices[3 * t + 1]] + vertexScore[indices[3 * t + 2]];
+				if (triangleScore[t] > bestScore)
+				{
+					bestScore = triangleScore[t];
+					best = t;
+				}
+			}
+		}
+	}
+	indices.swap(output);
+}
+
+#endif
@@ -0,0 +1,660 @@
+//////////////////////////////////////////////////////
+// Visibility.h - Potentially visible sets of the   //
+// driver's view, one per track section, built in   //
+// the background whenever the track changes.       //
+//////////////////////////////////////////////////////
+
+#ifndef _H_VISIBILITY_
+#define _H_VISIBILITY_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "Terrain.h"
+#include "MultiView.h"
+#include "Trace.h"
+
+// Track length covered by one section, and the driver cameras sampled in
+// each: PVS_SECTION_STEPS positions along it in each of PVS_LANES lanes.
+const GLfloat PVS_SECTION_LENGTH = 10.0f;
+const int PVS_SECTION_STEPS = 5;
+const int PVS_LANES = 3;
+const int PVS_CAMERAS_PER_SECTION = PVS_SECTION_STEPS * PVS_LANES;
+// Guardrail posts are culled in runs of this many.
+const int PVS_RAIL_BATCH = 6;
+// The sampled frustums are widened by this much (degrees) to cover the
+// views between samples.
+const GLfloat PVS_ANGLE_MARGIN = 10.0f;
+// Chunks this close to a sampled camera are always kept.
+const GLfloat PVS_NEAR_DISTANCE = 8.0f;
+// Occlusion rays are marched in steps of one terrain cell, and stop short
+// of their target so it cannot hide itself.
+const GLfloat PVS_RAY_STEP = TERRAIN_CHUNK_SIZE / TERRAIN_CHUNK_CELLS;
+const GLfloat PVS_TARGET_CLEARANCE = 0.5f;
+// Ground points tested per chunk, along each side.
+const int PVS_GROUND_SAMPLES = 5;
+// How long the builder sleeps when it has nothing to build.
+const int PVS_IDLE_MS = 10;
+// After track edits the sets are updated once no edit has come for this
+// long; until then the sections that could see an edit are not culled.
+const int PVS_EDIT_SETTLE_MS = 500;
+// An update keeps a section's sets if none of its cameras moved further
+// than this (the whole lap shifts when an edit changes its length), well
+// inside the spacing of the sampled cameras.
+const GLfloat PVS_CAMERA_TOLERANCE = 0.5f;
+
+// Whether a sphere reaches into a frustum.
+bool SphereInFrustum(const Frustum& frustum, const GLfloat center[3], GLfloat radius)
+{
+	for (int p = 0; p < 6; p++)
+	{
+		const GLfloat* plane = frustum.planes[p];
+		if (plane[0] * center[0] + plane[1] * center[1] + plane[2] * center[2] + plane[3] < -radius)
+			return false;
+	}
+	return true;
+}
+
+// For each section, one bit per terrain chunk for its ground, one per
+// chunk for its trees and one per run of guardrail posts. Chunks are
+// numbered over the lattice rectangle within streaming range of the track.
+class PotentiallyVisibleSets {
+public:
+	unsigned generation;
+	int sections;
+	double_t sectionLength;
+	int originX, originZ;
+	int columns, rows;
+	int railBatches;
+	double buildMs;
+	int rebuiltSections;
+	//the sampled cameras the sets were built from, and their widened frustums
+	std::vector<Camera> cameras;
+	std::vector<Frustum> frustums;
+
+	PotentiallyVisibleSets();
+	void resize(int numSections, int numCells, int numRailBatches);
+	int section(double_t distance) const;
+	bool sectionValid(int section) const;
+	bool groundVisible(int section, int cx, int cz) const;
+	bool treesVisible(int section, int cx, int cz) const;
+	bool railBatchVisible(int section, int batch) const;
+	void setGround(int section, int cell);
+	void setTrees(int section, int cell);
+	void setRailBatch(int section, int batch);
+	void invalidateNear(const GLfloat center[3], GLfloat radius);
+	bool sameLayout(const PotentiallyVisibleSets& other) const;
+	void copySection(const PotentiallyVisibleSets& from, int section);
+	size_t bytes() const;
+	void report(std::ostream& out) const;
+
+private:
+	int cell(int cx, int cz) const;
+	bool test(int section, int base, int bit) const;
+	void set(int section, int base, int bit);
+	//words per section, and where the tree and rail bits start in it
+	int stride;
+	int treeWords;
+	int railWords;
+	std::vector<uint64_t> bits;
+	//sections an edit may have changed since they were built
+	std::vector<char> stale;
+};
+
+// What a build needs from the render thread, copied so the track can be
+// edited or replaced while it runs.
+struct PvsInput {
+	unsigned generation;
+	unsigned seed;
+	double_t trackLength;
+	double_t trackWidth;
+	int sections;
+	//PVS_CAMERAS_PER_SECTION driver cameras per section
+	std::vector<Camera> cameras;
+	//the centerline samples, and the center of each guardrail post (x, y, z)
+	ArcLengthTable arcLength;
+	std::vector<GLfloat> railPosts;
+	//the sets an update starts from; empty (no sections) for a full build
+	PotentiallyVisibleSets previous;
+};
+
+PotentiallyVisibleSets::PotentiallyVisibleSets()
+	: generation(0), sections(0), sectionLength(PVS_SECTION_LENGTH), originX(0), originZ(0), columns(0), rows(0),
+	railBatches(0), buildMs(0.0), rebuiltSections(0), stride(0), treeWords(0), railWords(0) {
+}
+
+void PotentiallyVisibleSets::resize(int numSections, int numCells, int numRailBatches) {
+	sections = numSections;
+	railBatches = numRailBatches;
+	int cellWords = (numCells + 63) / 64;
+	treeWords = cellWords;
+	railWords = 2 * cellWords;
+	stride = railWords + (numRailBatches + 63) / 64;
+	bits.assign((size_t)stride * sections, 0);
+	stale.assign(sections, 0);
+}
+
+// The section holding a distance along the lap (any distance; it wraps).
+int PotentiallyVisibleSets::section(double_t distance) const {
+	double_t length = sections * sectionLength;
+	distance = fmod(distance, length);
+	if (distance < 0.0)
+		distance += length;
+	int s = (int)(distance / sectionLength);
+	return s < sections ? s : sections - 1;
+}
+
+// False once an edit may have changed what the section sees; the section
+// is then drawn unculled until the sets are updated.
+bool PotentiallyVisibleSets::sectionValid(int section) const {
+	return !stale[section];
+}
+
+// -1 for chunks outside the lattice rectangle, which are never visible.
+int PotentiallyVisibleSets::cell(int cx, int cz) const {
+	int i = cx - originX, j = cz - originZ;
+	if (i < 0 || j < 0 || i >= columns || j >= rows)
+		return -1;
+	return j * columns + i;
+}
+
+bool PotentiallyVisibleSets::test(int section, int base, int bit) const {
+	return (bits[(size_t)section * stride + base + bit / 64] >> (bit % 64) & 1) != 0;
+}
+
+void PotentiallyVisibleSets::set(int section, int base, int bit) {
+	bits[(size_t)section * stride + base + bit / 64] |= uint64_t(1) << (bit % 64);
+}
+
+bool PotentiallyVisibleSets::groundVisible(int section, int cx, int cz) const {
+	int c = cell(cx, cz);
+	return c >= 0 && test(section, 0, c);
+}
+
+bool PotentiallyVisibleSets::treesVisible(int section, int cx, int cz) const {
+	int c = cell(cx, cz);
+	return c >= 0 && test(section, treeWords, c);
+}
+
+bool PotentiallyVisibleSets::railBatchVisible(int section, int batch) const {
+	return test(section, railWords, batch);
+}
+
+void PotentiallyVisibleSets::setGround(int section, int cell) {
+	set(section, 0, cell);
+}
+
+void PotentiallyVisibleSets::setTrees(int section, int cell) {
+	set(section, treeWords, cell);
+}
+
+void PotentiallyVisibleSets::setRailBatch(int section, int batch) {
+	set(section, railWords, batch);
+}
+
+// Mark stale every section with a camera close to the sphere or looking
+// into it.
+void PotentiallyVisibleSets::invalidateNear(const GLfloat center[3], GLfloat radius) {
+	const GLfloat reach = radius + PVS_NEAR_DISTANCE;
+	for (int s = 0; s < sections; s++)
+		for (int c = 0; c < PVS_CAMERAS_PER_SECTION && !stale[s]; c++)
+		{
+			const int camera = s * PVS_CAMERAS_PER_SECTION + c;
+			const GLfloat* eye = cameras[camera].eye;
+			GLfloat d[3] = { eye[0] - center[0], eye[1] - center[1], eye[2] - center[2] };
+			if (d[0] * d[0] + d[1] * d[1] + d[2] * d[2] <= reach * reach
+				|| SphereInFrustum(frustums[camera], center, radius))
+				stale[s] = 1;
+		}
+}
+
+// Whether sections of the two sets can be swapped bit for bit.
+bool PotentiallyVisibleSets::sameLayout(const PotentiallyVisibleSets& other) const {
+	return sections == other.sections && originX == other.originX && originZ == other.originZ
+		&& columns == other.columns && rows == other.rows && railBatches == other.railBatches;
+}
+
+void PotentiallyVisibleSets::copySection(const PotentiallyVisibleSets& from, int section) {
+	std::copy(from.bits.begin() + (size_t)section * stride, from.bits.begin() + (size_t)(section + 1) * stride,
+		bits.begin() + (size_t)section * stride);
+}
+
+size_t PotentiallyVisibleSets::bytes() const {
+	return bits.size() * sizeof(uint64_t);
+}
+
+// Size, build time, and how much of the scenery an average section keeps.
+void PotentiallyVisibleSets::report(std::ostream& out) const {
+	unsigned long long ground = 0, trees = 0, rails = 0;
+	for (int s = 0; s < sections; s++)
+	{
+		for (int c = 0; c < columns * rows; c++)
+		{
+			ground += test(s, 0, c);
+			trees += test(s, treeWords, c);
+		}
+		for (int b = 0; b < railBatches; b++)
+			rails += test(s, railWords, b);
+	}
+	int cells = columns * rows;
+	out << "Visibility: " << sections << " sections over " << columns << " x " << rows << " chunks, "
+		<< bytes() << " bytes, " << rebuiltSections << " sections built in " << buildMs << " ms; per section "
+		<< (sections > 0 ? ground / (double)sections : 0.0) << "/" << cells << " ground, "
+		<< (sections > 0 ? trees / (double)sections : 0.0) << "/" << cells << " tree chunks, "
+		<< (sections > 0 ? rails / (double)sections : 0.0) << "/" << railBatches << " rail runs" << std::endl;
+}
+
+// Ray casting against the terrain height field and the trees that clear
+// the road, for one build. A chunk's trees are generated the first time a
+// section or a ray needs them, so an update touches only the chunks near
+// the sections it rebuilds.
+class VisibilityScene {
+public:
+	VisibilityScene(const PvsInput& input, const PotentiallyVisibleSets& sets, const TrackBVH& bvh);
+	const std::vector<TreeSite>& trees(int cell) const;
+	bool unoccluded(const GLfloat eye[3], const GLfloat target[3]) const;
+
+private:
+	unsigned seed;
+	double_t trackWidth;
+	const PotentiallyVisibleSets& grid;
+	const TrackBVH& track;
+	mutable std::vector<std::vector<TreeSite> > cellTrees;
+	mutable std::vector<char> generated;
+	//scratch for generating a chunk and projecting its trees
+	mutable TerrainChunkData data;
+	mutable std::vector<GLfloat> positions;
+	mutable std::vector<TrackProjection> projections;
+};
+
+VisibilityScene::VisibilityScene(const PvsInput& input, const PotentiallyVisibleSets& sets, const TrackBVH& bvh)
+	: seed(input.seed), trackWidth(input.trackWidth), grid(sets), track(bvh), cellTrees(sets.columns * sets.rows),
+	generated(sets.columns * sets.rows, 0) {
+}
+
+// A chunk's trees as the streamer would generate them, keeping those its
+// road filter keeps.
+const std::vector<TreeSite>& VisibilityScene::trees(int cell) const {
+	std::vector<TreeSite>& kept = cellTrees[cell];
+	if (generated[cell])
+		return kept;
+	generated[cell] = 1;
+	data.cx = grid.originX + cell % grid.columns;
+	data.cz = grid.originZ + cell / grid.columns;
+	GenerateTerrainChunk(seed, data);
+	const int count = (int)data.trees.size();
+	positions.resize(3 * count);
+	projections.resize(count);
+	for (int t = 0; t < count; t++)
+		for (int k = 0; k < 3; k++)
+			positions[3 * t + k] = data.trees[t].position[k];
+	if (count > 0)
+		track.closestPoints(&positions[0], count, &projections[0], true);
+	for (int t = 0; t < count; t++)
+		if (projections[t].separation > 0.5f * trackWidth + ROADSIDE_MARGIN + 2 * data.trees[t].radius)
+			kept.push_back(data.trees[t]);
+	return kept;
+}
+
+// March from eye to target; blocked if a step lands below the ground or
+// inside a tree's cone.
+bool VisibilityScene::unoccluded(const GLfloat eye[3], const GLfloat target[3]) const {
+	GLfloat d[3] = { target[0] - eye[0], target[1] - eye[1], target[2] - eye[2] };
+	GLfloat length = sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+	int steps = (int)ceil(length / PVS_RAY_STEP);
+	for (int s = 1; s < steps; s++)
+	{
+		GLfloat t = GLfloat(s) / steps;
+		if (length * (1.0f - t) < PVS_TARGET_CLEARANCE)
+			break;
+		GLfloat p[3] = { eye[0] + t * d[0], eye[1] + t * d[1], eye[2] + t * d[2] };
+		if (TerrainHeight(seed, p[0], p[2]) > p[1])
+			return false;
+		int i = (int)floor(p[0] / TERRAIN_CHUNK_SIZE) - grid.originX;
+		int j = (int)floor(p[2] / TERRAIN_CHUNK_SIZE) - grid.originZ;
+		if (i < 0 || j < 0 || i >= grid.columns || j >= grid.rows)
+			continue;
+		const std::vector<TreeSite>& sites = trees(j * grid.columns + i);
+		for (size_t k = 0; k < sites.size(); k++)
+		{
+			const TreeSite& site = sites[k];
+			GLfloat h = (p[1] - site.position[1]) / site.height;
+			if (h < 0.0f || h > 1.0f)
+				continue;
+			GLfloat ex = p[0] - site.position[0], ez = p[2] - site.position[2];
+			GLfloat r = site.radius * (1.0f - h);
+			if (ex * ex + ez * ez < r * r)
+				return false;
+		}
+	}
+	return true;
+}
+
+// Whether any of the section's cameras sees any of the points.
+bool AnyPointVisible(const VisibilityScene& scene, const PvsInput& input, const std::vector<Frustum>& frustums,
+	int section, const GLfloat* points, int count)
+{
+	for (int c = 0; c < PVS_CAMERAS_PER_SECTION; c++)
+	{
+		int camera = section * PVS_CAMERAS_PER_SECTION + c;
+		for (int k = 0; k < count; k++)
+			if (SphereInFrustum(frustums[camera], points + 3 * k, 0.0f)
+				&& scene.unoccluded(input.cameras[camera].eye, points + 3 * k))
+				return true;
+	}
+	return false;
+}
+
+// Whether every camera of a section is where it was when the previous
+// sets were built.
+bool SectionCamerasKept(const PotentiallyVisibleSets& previous, const PvsInput& input, int section)
+{
+	for (int c = 0; c < PVS_CAMERAS_PER_SECTION; c++)
+	{
+		const Camera& before = previous.cameras[section * PVS_CAMERAS_PER_SECTION + c];
+		const Camera& after = input.cameras[section * PVS_CAMERAS_PER_SECTION + c];
+		for (int k = 0; k < 3; k++)
+			if (fabs(after.eye[k] - before.eye[k]) > PVS_CAMERA_TOLERANCE
+				|| fabs(after.center[k] - before.center[k]) > PVS_CAMERA_TOLERANCE)
+				return false;
+	}
+	return true;
+}
+
+// Sample the driver's view over each section: a chunk's ground, its trees
+// or a run of posts is in the section's set if a sampled camera has an
+// unobstructed line to one of its sample points. Sampling can miss a
+// sliver seen only between samples; the widened frustums and the near
+// distance keep that to the edges of the view. An update copies the
+// sections that are still valid and whose cameras stayed put from the
+// previous sets, and samples only the rest.
+PotentiallyVisibleSets* BuildVisibility(const PvsInput& input)
+{
+	TRACE_FUNCTION();
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	PotentiallyVisibleSets* sets = new PotentiallyVisibleSets();
+	sets->generation = input.generation;
+	sets->sectionLength = input.trackLength / input.sections;
+
+	// Every chunk the streamer could load while the cameras are on the track.
+	const std::vector<GLfloatPoint>& centerline = input.arcLength.points;
+	GLfloat lower[2] = { 0.0f, 0.0f }, upper[2] = { 0.0f, 0.0f };
+	for (size_t p = 0; p < centerline.size(); p++)
+		for (int k = 0; k < 2; k++)
+		{
+			GLfloat v = GLfloat(k == 0 ? centerline[p].x : centerline[p].z);
+			lower[k] = (p == 0 || v < lower[k]) ? v : lower[k];
+			upper[k] = (p == 0 || v > upper[k]) ? v : upper[k];
+		}
+	sets->originX = (int)floor((lower[0] - TERRAIN_STREAM_RADIUS) / TERRAIN_CHUNK_SIZE);
+	sets->originZ = (int)floor((lower[1] - TERRAIN_STREAM_RADIUS) / TERRAIN_CHUNK_SIZE);
+	sets->columns = (int)floor((upper[0] + TERRAIN_STREAM_RADIUS) / TERRAIN_CHUNK_SIZE) - sets->originX + 1;
+	sets->rows = (int)floor((upper[1] + TERRAIN_STREAM_RADIUS) / TERRAIN_CHUNK_SIZE) - sets->originZ + 1;
+	const int posts = (int)input.railPosts.size() / 3;
+	sets->resize(input.sections, sets->columns * sets->rows, (posts + PVS_RAIL_BATCH - 1) / PVS_RAIL_BATCH);
+
+	TrackBVH bvh;
+	bvh.build(input.arcLength, input.trackWidth, 0.0);
+	VisibilityScene scene(input, *sets, bvh);
+	sets->cameras = input.cameras;
+	std::vector<Frustum>& frustums = sets->frustums;
+	frustums.resize(input.cameras.size());
+	for (size_t c = 0; c < input.cameras.size(); c++)
+	{
+		Camera widened = input.cameras[c];
+		widened.fovy += PVS_ANGLE_MARGIN;
+		FrustumFromCamera(widened, frustums[c]);
+	}
+	const PotentiallyVisibleSets& previous = input.previous;
+	const bool update = previous.sections > 0 && previous.sameLayout(*sets);
+
+	const GLfloat step = TERRAIN_CHUNK_SIZE / (PVS_GROUND_SAMPLES - 1);
+	GLfloat ground[3 * PVS_GROUND_SAMPLES * PVS_GROUND_SAMPLES];
+	std::vector<GLfloat> points;
+	for (int s = 0; s < input.sections; s++)
+	{
+		if (update && previous.sectionValid(s) && SectionCamerasKept(previous, input, s))
+		{
+			sets->copySection(previous, s);
+			continue;
+		}
+		sets->rebuiltSections++;
+		for (int j = 0; j < sets->rows; j++)
+			for (int i = 0; i < sets->columns; i++)
+			{
+				const int cell = j * sets->columns + i;
+				const GLfloat x0 = (sets->originX + i) * TERRAIN_CHUNK_SIZE, z0 = (sets->originZ + j) * TERRAIN_CHUNK_SIZE;
+				GLfloat center[3] = { x0 + 0.5f * TERRAIN_CHUNK_SIZE, GROUND_BOTTOM, z0 + 0.5f * TERRAIN_CHUNK_SIZE };
+				const GLfloat radius = 0.75f * TERRAIN_CHUNK_SIZE + MAX_TREE_HEIGHT;
+				bool nearby = false, inView = false;
+				for (int c = 0; c < PVS_CAMERAS_PER_SECTION; c++)
+				{
+					const int camera = s * PVS_CAMERAS_PER_SECTION + c;
+					const GLfloat* eye = input.cameras[camera].eye;
+					GLfloat dx = std::max(std::max(x0 - eye[0], eye[0] - (x0 + TERRAIN_CHUNK_SIZE)), 0.0f);
+					GLfloat dz = std::max(std::max(z0 - eye[2], eye[2] - (z0 + TERRAIN_CHUNK_SIZE)), 0.0f);
+					nearby = nearby || dx * dx + dz * dz <= PVS_NEAR_DISTANCE * PVS_NEAR_DISTANCE;
+					inView = inView || SphereInFrustum(frustums[camera], center, radius);
+				}
+				if (nearby)
+				{
+					sets->setGround(s, cell);
+					sets->setTrees(s, cell);
+					continue;
+				}
+				if (!inView)
+					continue;
+
+				// The ground, sampled on a grid just above its surface.
+				int n = 0;
+				for (int b = 0; b < PVS_GROUND_SAMPLES; b++)
+					for (int a = 0; a < PVS_GROUND_SAMPLES; a++, n++)
+					{
+						ground[3 * n] = x0 + a * step;
+						ground[3 * n + 2] = z0 + b * step;
+						ground[3 * n + 1] = TerrainHeight(input.seed, ground[3 * n], ground[3 * n + 2]) + 0.05f;
+					}
+				if (AnyPointVisible(scene, input, frustums, s, ground, n))
+					sets->setGround(s, cell);
+
+				// The trees, by their tips and the middle of their trunks.
+				const std::vector<TreeSite>& sites = scene.trees(cell);
+				points.clear();
+				for (size_t t = 0; t < sites.size(); t++)
+				{
+					const TreeSite& site = sites[t];
+					const GLfloat tip[3] = { site.position[0], site.position[1] + site.height, site.position[2] };
+					const GLfloat middle[3] = { site.position[0], site.position[1] + 0.5f * site.height, site.position[2] };
+					points.insert(points.end(), tip, tip + 3);
+					points.insert(points.end(), middle, middle + 3);
+				}
+				// The trunk point is inside the tree's own cone, so it is
+				// pulled out to the surface facing the track.
+				for (size_t t = 0; t < sites.size(); t++)
+				{
+					GLfloat* middle = &points[6 * t + 3];
+					const GLfloat* eye = input.cameras[s * PVS_CAMERAS_PER_SECTION + PVS_CAMERAS_PER_SECTION / 2].eye;
+					GLfloat ex = eye[0] - middle[0], ez = eye[2] - middle[2];
+					GLfloat len = sqrt(ex * ex + ez * ez);
+					if (len > 0.0f)
+					{
+						middle[0] += ex / len * (0.5f * sites[t].radius + PVS_TARGET_CLEARANCE);
+						middle[2] += ez / len * (0.5f * sites[t].radius + PVS_TARGET_CLEARANCE);
+					}
+				}
+				if (!points.empty() && AnyPointVisible(scene, input, frustums, s, &points[0], (int)points.size() / 3))
+					sets->setTrees(s, cell);
+			}
+
+		// Guardrail posts, by their middle and top.
+		for (int b = 0; b < sets->railBatches; b++)
+		{
+			points.clear();
+			for (int p = b * PVS_RAIL_BATCH; p < posts && p < (b + 1) * PVS_RAIL_BATCH; p++)
+			{
+				const GLfloat* post = &input.railPosts[3 * p];
+				for (int k = 0; k < 2; k++)
+				{
+					const GLfloat point[3] = { post[0], post[1] + k * 0.5f * GUARDRAIL_SCALE_FACTOR[1], post[2] };
+					points.insert(points.end(), point, point + 3);
+				}
+			}
+			if (AnyPointVisible(scene, input, frustums, s, &points[0], (int)points.size() / 3))
+				sets->setRailBatch(s, b);
+		}
+	}
+	sets->buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+	return sets;
+}
+
+// Builds sets on a thread of its own. The render thread requests a build
+// when the track is replaced, which drops the current sets at once, and
+// picks up the result with update() at a frame boundary; a request made
+// while a build runs supersedes it. Edits only mark the sections that could
+// see them stale, and once they settle an update rebuilds just those.
+class VisibilityBuilder {
+public:
+	VisibilityBuilder();
+	~VisibilityBuilder();
+	void start();
+	void stop();
+	void request(PvsInput* input);
+	void trackEdited(const TrackAssets& track);
+	bool editsSettled() const;
+	void requestUpdate(PvsInput* input);
+	bool update();
+	const PotentiallyVisibleSets* current() const;
+
+private:
+	void run();
+	void submit(PvsInput* input);
+	std::thread worker;
+	std::atomic<bool> running;
+	std::atomic<PvsInput*> requested;
+	std::atomic<PotentiallyVisibleSets*> finished;
+	//render thread only
+	unsigned generation;
+	PotentiallyVisibleSets* sets;
+	bool editsPending;
+	std::chrono::steady_clock::time_point lastEdit;
+
+	VisibilityBuilder(const VisibilityBuilder&);
+	VisibilityBuilder& operator=(const VisibilityBuilder&);
+};
+
+VisibilityBuilder::VisibilityBuilder()
+	: running(false), requested(NULL), finished(NULL), generation(0), sets(NULL), editsPending(false) {
+}
+
+VisibilityBuilder::~VisibilityBuilder() {
+	stop();
+	delete requested.exchange(NULL);
+	delete finished.exchange(NULL);
+	delete sets;
+}
+
+void VisibilityBuilder::start() {
+	running = true;
+	worker = std::thread(&VisibilityBuilder::run, this);
+}
+
+void VisibilityBuilder::stop() {
+	running = false;
+	if (worker.joinable())
+		worker.join();
+}
+
+// Render thread only. Takes ownership of input.
+void VisibilityBuilder::request(PvsInput* input) {
+	delete sets;
+	sets = NULL;
+	submit(input);
+}
+
+// Render thread only, after TrackAssets::updateDirtySegments. Marks stale
+// the sections that could see the redone stretch, its trees or the ground
+// they stood on, and drops any build in flight, which predates the edit.
+void VisibilityBuilder::trackEdited(const TrackAssets& track) {
+	if (track.editLower[0] > track.editUpper[0])
+		return;
+	++generation;
+	editsPending = true;
+	lastEdit = std::chrono::steady_clock::now();
+	if (sets == NULL)
+		return;
+	const GLfloat reach = GLfloat(0.5 * track.width) + ROADSIDE_MARGIN + 2 * MAXIMUM_TREE_BASE_RADIUS;
+	GLfloat center[3];
+	GLfloat radius = 0.0f;
+	for (int k = 0; k < 3; k++)
+	{
+		center[k] = GLfloat(0.5 * (track.editLower[k] + track.editUpper[k]));
+		GLfloat half = GLfloat(0.5 * (track.editUpper[k] - track.editLower[k])) + (k == 1 ? MAX_TREE_HEIGHT : reach);
+		radius += half * half;
+	}
+	sets->invalidateNear(center, sqrt(radius));
+}
+
+// Whether edits are waiting and none has come for PVS_EDIT_SETTLE_MS.
+bool VisibilityBuilder::editsSettled() const {
+	return editsPending
+		&& std::chrono::steady_clock::now() - lastEdit >= std::chrono::milliseconds(PVS_EDIT_SETTLE_MS);
+}
+
+// Render thread only. Like request, but the current sets stay in use
+// (their stale sections unculled) and the build starts from a copy.
+void VisibilityBuilder::requestUpdate(PvsInput* input) {
+	if (sets != NULL)
+		input->previous = *sets;
+	submit(input);
+}
+
+void VisibilityBuilder::submit(PvsInput* input) {
+	input->generation = ++generation;
+	editsPending = false;
+	delete requested.exchange(input);
+}
+
+// Render thread only. Adopts a finished build for the latest request;
+// returns true if the sets changed.
+bool VisibilityBuilder::update() {
+	PotentiallyVisibleSets* built = finished.exchange(NULL);
+	if (built == NULL)
+		return false;
+	if (built->generation != generation)
+	{
+		delete built;
+		return false;
+	}
+	delete sets;
+	sets = built;
+	return true;
+}
+
+// The sets for the current track, or NULL while a full build runs.
+const PotentiallyVisibleSets* VisibilityBuilder::current() const {
+	return sets;
+}
+
+void VisibilityBuilder::run() {
+	TraceThreadName("visibility");
+	ALLOC_SCOPE(ALLOC_TRACK);
+	while (running)
+	{
+		PvsInput* input = requested.exchange(NULL);
+		if (input == NULL)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(PVS_IDLE_MS));
+			continue;
+		}
+		PotentiallyVisibleSets* built = BuildVisibility(*input);
+		delete input;
+		delete finished.exchange(built);
+	}
+}
+
+#endif